@@ -2,3 +2,4 @@
 
 clang-format -style=Google -i include/megabit/*.hpp
 clang-format -style=Google -i src/*.cpp
+clang-format -style=Google -i tools/standin_server/*.?pp
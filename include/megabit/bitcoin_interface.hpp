@@ -24,9 +24,19 @@
 #include <QWidget>
 #include <bitcoin/client/obelisk_client.hpp>
 #include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <set>
 #include <thread>
 
+#include "../include/megabit/block_scanner.hpp"
+#include "../include/megabit/connection_pool.hpp"
 #include "../include/megabit/constants.hpp"
+#include "../include/megabit/mempool_tracker.hpp"
+#include "../include/megabit/request_executor.hpp"
+#include "../include/megabit/request_log.hpp"
+#include "../include/megabit/server_list.hpp"
 #include "../include/megabit/utils.hpp"
 
 struct AddressHistory {
@@ -108,10 +118,13 @@ struct AddressHistory {
   }
 };
 
+// bip44 accounts use p2pkh addresses, bip84 accounts use native
+// segwit (p2wpkh) addresses
+enum class AccountType { bip44, bip84 };
+
 using Seed = libbitcoin::long_hash;
 using HDKey = libbitcoin::wallet::hd_private;
 using Mnemonic = libbitcoin::wallet::word_list;
-using LibbitcoinClient = libbitcoin::client::obelisk_client;
 
 using Unspent = std::pair<libbitcoin::ec_secret, AddressHistory::Internal>;
 using UnspentList = std::vector<Unspent>;
@@ -148,11 +161,22 @@ struct TxBlockInfo {
   libbitcoin::chain::transaction tx;
 };
 
+// the key hash a payment is sent to, paid to a p2wpkh output when
+// parsed from a bech32 address and to a p2pkh output otherwise
+struct PaymentDestination {
+  libbitcoin::short_hash key_hash;
+  bool witness;
+};
+
+// a single (destination, amount in satoshis) payment output
+using Recipient = std::pair<PaymentDestination, uint64_t>;
+using RecipientList = std::vector<Recipient>;
+
 struct PendingTransaction {
   PendingTransaction(
       const libbitcoin::chain::transaction& _tx,
       const UnspentList& _selected_unspent_list, uint64_t& _amount,
-      const libbitcoin::wallet::payment_address _destination_address,
+      const PaymentDestination _destination_address,
       const uint64_t _target_fee_per_kb, const uint64_t _change_amount,
       const libbitcoin::wallet::payment_address _change_address,
       bool _subtract_fee_from_amount)
@@ -163,16 +187,58 @@ struct PendingTransaction {
         target_fee_per_kb(_target_fee_per_kb),
         change_amount(_change_amount),
         change_address(_change_address),
-        subtract_fee_from_amount(_subtract_fee_from_amount) {}
+        subtract_fee_from_amount(_subtract_fee_from_amount),
+        recipients({{_destination_address, _amount}}) {}
+
+  // batch payment; the tx is already fully signed and the change
+  // amount is the final (post fee) value of the change output
+  PendingTransaction(const libbitcoin::chain::transaction& _tx,
+                     const UnspentList& _selected_unspent_list,
+                     const RecipientList& _recipients, uint64_t _amount,
+                     const uint64_t _target_fee_per_kb,
+                     const uint64_t _change_amount,
+                     const libbitcoin::wallet::payment_address _change_address)
+      : tx(_tx),
+        selected_unspent_list(_selected_unspent_list),
+        amount(_amount),
+        destination_address(_recipients.front().first),
+        target_fee_per_kb(_target_fee_per_kb),
+        change_amount(_change_amount),
+        change_address(_change_address),
+        subtract_fee_from_amount(false),
+        recipients(_recipients) {}
+
+  bool is_batch() const { return (recipients.size() > 1); }
+
+  // bip125 opt-in replace-by-fee
+  bool signals_rbf() const {
+    for (const auto& input : tx.inputs()) {
+      if (input.sequence() <= megabit::constants::rbf_input_sequence) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  uint64_t input_amount() const {
+    uint64_t total = 0;
+    for (const auto& unspent : selected_unspent_list) {
+      total += unspent.second.value;
+    }
+    return total;
+  }
+
+  uint64_t fee() const { return (input_amount() - tx.total_output_value()); }
 
   const libbitcoin::chain::transaction tx;
   const UnspentList selected_unspent_list;
   uint64_t amount;
-  const libbitcoin::wallet::payment_address destination_address;
+  const PaymentDestination destination_address;
   const uint64_t target_fee_per_kb;
   const uint64_t change_amount;
   const libbitcoin::wallet::payment_address change_address;
   bool subtract_fee_from_amount;
+  const RecipientList recipients;
 };
 
 using TxUpdaterFunction =
@@ -181,6 +247,22 @@ using TxUpdaterFunction =
 
 using ErrorHandler = std::function<void(const libbitcoin::code& error)>;
 using BlockHeightHandler = std::function<void(size_t height)>;
+
+// results of the asynchronous requests
+struct AddressHistoryResult {
+  bool success;
+  AddressHistory history;
+};
+
+struct TxBlockInfoResult {
+  bool success;
+  TxBlockInfo tx_block_info;
+};
+
+struct BlockHeightResult {
+  libbitcoin::code error;
+  size_t height;
+};
 using AddressSubscriptionHandler =
     std::function<void(const libbitcoin::code& code)>;
 
@@ -190,6 +272,31 @@ struct AddressBalance {
   uint64_t unspent;
 };
 
+struct ConsolidationPolicy {
+  // consolidation is skipped when the fee rate is above this
+  uint64_t max_fee_per_kb;
+  // only utxos worth at most this much are merged
+  uint64_t max_utxo_value;
+  // upper bound on the number of inputs merged per transaction
+  size_t max_inputs_per_tx;
+};
+
+struct UnconfirmedSpendPolicy {
+  // if set, the change of our own broadcast transactions can be
+  // spent before it has confirmed
+  bool spend_unconfirmed_change;
+  // longest chain of unconfirmed transactions (including the new
+  // one) that spending unconfirmed change may create
+  size_t max_chain_depth;
+};
+
+// one of our own broadcast transactions that hasn't confirmed yet
+struct BroadcastTransaction {
+  libbitcoin::chain::transaction tx;
+  // number of unconfirmed transactions in its chain, including itself
+  size_t chain_depth;
+};
+
 static constexpr uint32_t locktime = 0;
 static constexpr uint32_t script_version = 5;
 static constexpr uint32_t transaction_version = 1;
@@ -204,25 +311,83 @@ class BitcoinInterface : public QObject {
 
   void SetNetwork(const std::string& network);
   void SetNumAccounts(const size_t num_accounts);
-  void SetServerInfo(const std::string& libbitcoin_server_address,
-                     const std::string& libbitcoin_server_public_key);
+  void SetUnconfirmedSpendPolicy(const UnconfirmedSpendPolicy& policy);
+  void SetAccountTypes(const std::vector<AccountType>& account_types);
+  AccountType GetAccountType(uint32_t account_index) const;
+  // appends a new account of the specified type after the existing
+  // accounts (must be called after initialization)
+  void AddAccount(AccountType account_type);
+  // requests fail over from the first server to the others in order
+  // of latency (measured during initialization)
+  void SetServers(const std::vector<ServerInfo>& servers);
+  // reads (history, transactions and headers) that are slow on one
+  // server are duplicated to another, see ServerList::PerformRead
+  void SetHedging(bool hedging);
+  // transactions whose spent outputs are all known locally are
+  // checked here before broadcasting; this also asks the server to
+  // validate them (transactions that can't be checked locally always
+  // go to the server)
+  void SetServerValidation(bool server_validation);
+  // records server requests and responses to a log, or answers them
+  // from one instead of the servers (at the recorded speed, or as
+  // fast as possible if flat_out), see RequestLog.  Must be set
+  // before initialization.
+  bool SetRequestLog(RequestLogMode mode, const std::string& file_name,
+                     bool flat_out);
+
+  ConnectionPool& GetSubscriptionPool();
+  ConnectionPoolMetrics GetConnectionPoolMetrics();
+  FailoverMetrics GetFailoverMetrics();
+  LatencyMetrics GetLatencyMetrics();
+  RequestSchedulerMetrics GetSchedulerMetrics();
+  // per server, including the current concurrency limit
+  std::vector<ServerStats> GetServerStats();
 
   bool InitializeFromSeed(const Seed& seed);
   /* bool InitializeFromMnemonic(const Mnemonic& mnemonic, */
   /*                             const std::string& passphrase); */
 
-  libbitcoin::wallet::payment_address GetPaymentAddress(
-      const std::string address);
+  // parses a base58 pay to key hash or a (p2wpkh) bech32 address on
+  // our network into a destination.  Returns false if address is
+  // neither.
+  bool GetPaymentDestination(const std::string& address,
+                             PaymentDestination& destination) const;
+  // the address string of a destination
+  std::string GetDestinationString(
+      const PaymentDestination& destination) const;
 
   const std::string GetNextAddressForAccount(uint32_t account_index,
                                              uint32_t internal);
 
+  // every cached external and internal address of all accounts
+  std::vector<std::string> GetWalletAddresses() const;
+
+  // returns the address that the server indexes the history of the
+  // specified (p2pkh or bech32) address by
+  libbitcoin::wallet::payment_address GetQueryAddress(
+      const std::string& address) const;
+
   const libbitcoin::data_chunk GetAddressAsPngData(const std::string& address,
                                                    bool prefix = true);
 
   void GetBlockHeight(ErrorHandler on_error, BlockHeightHandler handler);
 
+  // requests run on the i/o threads, so several can be outstanding at
+  // once.  The synchronous request methods wait on these.
+  std::future<AddressHistoryResult> GetAddressHistoryAsync(
+      const std::string& address);
+  std::future<TxBlockInfoResult> GetTransactionInfoAsync(
+      const libbitcoin::hash_digest& tx_hash, bool unconfirmed = false);
+  std::future<bool> TransactionIsValidAsync(
+      const libbitcoin::chain::transaction& transaction);
+  std::future<bool> SendTransactionAsync(
+      const libbitcoin::chain::transaction& transaction);
+  std::future<BlockHeightResult> GetBlockHeightAsync();
+
   void SetBlockHeight(const size_t block_height);
+  // marks the cached history of an address stale, so that it's
+  // refreshed on the next request
+  void InvalidateAddressHistory(const std::string& address);
 
   const uint64_t GetAccountBalance(bool& error, uint32_t account_index,
                                    TxUpdaterFunction update_fn);
@@ -233,35 +398,100 @@ class BitcoinInterface : public QObject {
                                megabit::constants::satoshi_per_btc);
   }
 
-  // constructs a payment from the utxos in the specified account
-  // index
+  // constructs a signed payment from the utxos in the specified
+  // account index.  The selected utxos are reserved until they are
+  // released, so no other payment will try to spend them.
   //
   // if the amount specified is 0, all available funds will be sent
   // (this is used for sweeping everything in the specified
   // account index) and the amount will be returned in amount
-  bool InitiateSendPayment(
+  std::shared_ptr<PendingTransaction> CreatePendingPayment(
       const uint32_t account_index, uint64_t& amount,
-      const libbitcoin::wallet::payment_address destination_address,
-      const uint64_t target_fee_per_kb, bool subtract_fee_from_amount);
-
-  // creates a transaction from the selected unpent outputs
+      const PaymentDestination destination_address,
+      const uint64_t target_fee_per_kb, bool subtract_fee_from_amount,
+      bool signal_rbf = false);
+
+  // constructs a single payment to every recipient in the list from
+  // the utxos in the specified account index.  Coin selection, fee
+  // estimation and signing are each done once for the whole batch
+  // and any change (minus the fee) is returned to our change
+  // address.  The selected utxos are reserved as above.
+  std::shared_ptr<PendingTransaction> CreatePendingBatchPayment(
+      const uint32_t account_index, const RecipientList& recipients,
+      const uint64_t target_fee_per_kb, bool signal_rbf = false);
+
+  // parses a csv file of "address,amount" lines (amount in BTC) into
+  // a recipient list.  Blank lines and lines starting with '#' are
+  // skipped.  On failure, error contains a user readable reason.
+  bool LoadRecipientsFromCsv(const std::string& file_name,
+                             RecipientList& recipients, std::string& error);
+
+  // rebuilds the pending transaction from the same (still reserved)
+  // inputs and outputs at a higher fee rate.  The fee rate is raised
+  // as needed to satisfy the bip125 replacement rules.  Throws if
+  // the original doesn't signal replace-by-fee, if its outputs are
+  // already being spent (the spending transactions would be
+  // invalidated), or if the change (or amount, when subtracting the
+  // fee) can't cover the new fee.
+  std::shared_ptr<PendingTransaction> CreateReplacementPayment(
+      const PendingTransaction& original, const uint64_t target_fee_per_kb);
+
+  // creates a child transaction spending the change output of the
+  // unconfirmed parent back to our change address, with a fee that
+  // brings the fee rate of both transactions together up to the
+  // target.  The change output is reserved as any other utxo.
+  std::shared_ptr<PendingTransaction> CreateChildPaysForParentPayment(
+      const uint32_t account_index, const PendingTransaction& parent,
+      const uint64_t target_fee_per_kb);
+
+  // creates a transaction from the selected unpent outputs.  If
+  // signal_rbf is set, the inputs opt in to replace-by-fee.
   libbitcoin::chain::transaction CreateSignedTransaction(
       const UnspentList& unspent, uint64_t& amount,
-      const libbitcoin::wallet::payment_address destination_address,
+      const PaymentDestination destination_address,
       const uint64_t target_fee_per_kb, const uint64_t change_amount,
       const libbitcoin::wallet::payment_address change_address,
-      bool subtract_fee_from_amount);
+      bool subtract_fee_from_amount, bool signal_rbf = false);
+
+  // creates a transaction paying every recipient from the selected
+  // unspent outputs, pulling the fee from the change amount
+  libbitcoin::chain::transaction CreateSignedBatchTransaction(
+      const UnspentList& unspent, const RecipientList& recipients,
+      const uint64_t target_fee_per_kb, uint64_t& change_amount,
+      const libbitcoin::wallet::payment_address change_address,
+      bool signal_rbf = false);
 
   // creates a transaction from the selected unpent outputs, then
   // signs and broadcasts the transaction to the bitcoin network.
   bool CreateAndBroadcastTransaction(
       const UnspentList& unspent, uint64_t& amount,
-      const libbitcoin::wallet::payment_address destination_address,
+      const PaymentDestination destination_address,
       const uint64_t target_fee_per_kb, const uint64_t change_amount,
       const libbitcoin::wallet::payment_address change_address,
       bool subtract_fee_from_amount);
 
-  bool SendPendingTransaction();
+  bool ValidatePendingTransaction(
+      const PendingTransaction& pending_transaction);
+  bool BroadcastPendingTransaction(
+      const PendingTransaction& pending_transaction);
+
+  // utxo reservations: reserving fails if any of the utxos are
+  // already reserved.  Reserved utxos are never selected for new
+  // payments.  Utxos of broadcast transactions stay reserved.
+  bool ReserveUnspent(const UnspentList& unspent_list);
+  void ReleaseUnspent(const UnspentList& unspent_list);
+
+  // merges the small utxos of the specified account index into as
+  // few outputs (each paid to a fresh change address) as the policy
+  // allows, and broadcasts the resulting transactions.  Utxos that
+  // would cost more in fees to spend than they are worth are
+  // skipped, as are batches left below the dust threshold after the
+  // fee.  The number of transactions sent is returned in
+  // num_transactions.
+  bool ConsolidateUnspent(const uint32_t account_index,
+                          const uint64_t target_fee_per_kb,
+                          const ConsolidationPolicy& policy,
+                          size_t& num_transactions);
 
   bool RetrieveUnspentAndChangeAddress(
       UnspentList& selected_unspent,
@@ -274,26 +504,122 @@ class BitcoinInterface : public QObject {
   bool GetTransactionInfo(const libbitcoin::hash_digest& tx_hash,
                           TxBlockInfo& tx_block_info, bool unconfirmed = false);
 
-  std::shared_ptr<PendingTransaction> GetPendingTransaction() {
-    return pending_transaction_;
-  }
-
   uint64_t GetUnconfirmedTransactionAmount(
       const libbitcoin::chain::transaction& tx);
 
+  // tracks an unconfirmed transaction paying to or spending from the
+  // wallet accounts in the mempool tracker (our own broadcasts are
+  // tracked as outgoing when they're sent).  Returns false if it was
+  // already tracked or doesn't touch the wallet.
+  bool TrackUnconfirmedTransaction(const libbitcoin::chain::transaction& tx,
+                                   bool outgoing = false);
+  PendingBalance GetPendingBalance(uint32_t account_index);
+  // looks every tracked transaction up in the blockchain, and stops
+  // tracking and returns those that have confirmed.  Transactions
+  // missing from the mempool for a few checks in a row are dropped.
+  std::vector<ConfirmedTransaction> PromoteConfirmedTransactions();
+  // the history of a bech32 address is requested by its key hash
+  // (see GetQueryAddress), which relies on the server indexing
+  // p2wpkh outputs that way.  The first confirmed transaction paying
+  // one of our p2wpkh outputs is looked up in that history to check.
+  // Returns false if the output is missing, i.e. segwit balances
+  // can't be trusted.
+  bool VerifyWitnessIndexing(
+      const std::vector<ConfirmedTransaction>& confirmed);
+  // for a transaction known to have confirmed at the height (e.g.
+  // from a notification).  Returns false if it wasn't tracked.
+  bool PromoteConfirmedTransaction(const libbitcoin::hash_digest& tx_hash,
+                                   size_t height,
+                                   ConfirmedTransaction& confirmed);
+
   uint64_t GetCalculatedFee(const libbitcoin::chain::transaction& tx,
                             const uint64_t target_fee_per_kb);
 
+  // serialized size with witness data discounted, i.e. the weight / 4
+  // rounded up (see bip141)
+  size_t GetVirtualSize(const libbitcoin::chain::transaction& tx) const;
+  // the virtual size of the unsigned transaction spending unspent
+  // once its inputs are signed, by the type of each input
+  size_t GetSignedVirtualSize(const libbitcoin::chain::transaction& tx,
+                              const UnspentList& unspent) const;
+
+  // the (unique) key hashes that the transaction pays to, or spends
+  // from with a p2pkh or p2wpkh input
+  std::vector<libbitcoin::short_hash> GetTransactionKeyHashes(
+      const libbitcoin::chain::transaction& tx) const;
+
  private:
   const libbitcoin::wallet::hd_private GetKey(uint32_t account,
                                               uint32_t internal,
                                               uint32_t index) const;
 
+  void CacheAccountAddresses(uint32_t account);
+
+  libbitcoin::short_hash GetKeyHash(
+      const libbitcoin::wallet::hd_private& key) const;
+
+  // returns the p2pkh or bech32 address of the key, depending on the
+  // account type
+  std::string GetEncodedAddress(
+      uint32_t account, const libbitcoin::wallet::hd_private& key) const;
+
+  // returns a p2wpkh script for our own bip84 key hashes, otherwise
+  // a p2pkh script
+  libbitcoin::chain::script GetOutputScript(
+      const libbitcoin::wallet::payment_address& address) const;
+  libbitcoin::chain::script GetOutputScript(
+      const PaymentDestination& destination) const;
+  bool IsWitnessKeyHash(const libbitcoin::short_hash& key_hash) const;
+
+  std::vector<std::string> GetOutputAddresses(
+      const libbitcoin::chain::output& output) const;
+
+  bool GetOutputKeyHash(const libbitcoin::chain::output& output,
+                        libbitcoin::short_hash& key_hash) const;
+  bool GetAccountIndex(const libbitcoin::short_hash& key_hash,
+                       uint32_t& account_index) const;
+  // the value of a wallet output, from the mempool tracker, our
+  // broadcasts or the history cache before asking the server
+  bool GetSpentOutputValue(const libbitcoin::chain::output_point& point,
+                           const libbitcoin::short_hash& key_hash,
+                           uint64_t& value);
+
   bool GetAddressHistory(const libbitcoin::ec_secret& key,
                          AddressHistory& history);
 
   bool GetAddressHistory(const std::string& address, AddressHistory& history);
 
+  bool RetrieveAndReserveUnspent(
+      UnspentList& selected_unspent,
+      libbitcoin::wallet::payment_address& change_address,
+      uint64_t& change_amount, const uint32_t account_index,
+      uint64_t& amount);
+
+  bool IsReserved(const libbitcoin::chain::point& point);
+  // a confirmed spend can't be double spent, so its inputs no longer
+  // need to be reserved
+  void ReleaseSpentReservations(const libbitcoin::chain::transaction& tx);
+
+  // our own broadcast transactions are tracked until their outputs
+  // are confirmed, so that their change can be spent before then
+  void TrackBroadcastTransaction(const libbitcoin::chain::transaction& tx);
+  void ForgetBroadcastTransaction(const libbitcoin::hash_digest& tx_hash);
+  bool GetBroadcastTransaction(const libbitcoin::hash_digest& tx_hash,
+                               libbitcoin::chain::transaction& tx);
+  bool IsSpendableUnconfirmed(const libbitcoin::chain::point& point);
+  // true if an output of the transaction is reserved by a payment or
+  // spent by one of our tracked broadcast transactions
+  bool HasOutputsInUse(const libbitcoin::chain::transaction& tx);
+  AddressHistory::InternalList GetUnconfirmedChange(
+      const libbitcoin::wallet::hd_private& key);
+  // returns the first change address of the account index with no
+  // history or unconfirmed change whose key hash isn't in excluded,
+  // looking past the gap limit as needed.  The result is invalid if
+  // a history couldn't be retrieved.
+  libbitcoin::wallet::payment_address GetUnusedChangeAddress(
+      const uint32_t account_index,
+      const std::set<libbitcoin::short_hash>& excluded);
+
   libbitcoin::chain::points_value GetUnspentOutputsForAccountIndex(
       const uint32_t account_index, UnspentList& unspent_list,
       libbitcoin::wallet::payment_address& change_address,
@@ -306,30 +632,165 @@ class BitcoinInterface : public QObject {
                              libbitcoin::chain::transaction& output_tx);
 
   bool TransactionIsValid(const libbitcoin::chain::transaction& transaction);
+  // checks the structure, amounts and input scripts of a signed
+  // transaction against the outputs it spends.  checked is false if
+  // an output isn't in the prevout cache (and the scripts weren't
+  // verified).
+  bool ValidateTransactionLocally(
+      const libbitcoin::chain::transaction& transaction, bool& checked);
+  void CachePrevout(const libbitcoin::chain::point& point,
+                    const libbitcoin::chain::output& output);
+  bool GetCachedPrevout(const libbitcoin::chain::point& point,
+                        libbitcoin::chain::output& output);
+  void ReleasePrevouts(const libbitcoin::chain::transaction& transaction);
 
   bool SendTransaction(const libbitcoin::chain::transaction& transaction);
 
+  // the blocking requests, run by the i/o threads
+  bool FetchAddressHistory(const std::string& address,
+                           AddressHistory& history);
+  bool FetchTransactionInfo(const libbitcoin::hash_digest& tx_hash,
+                            TxBlockInfo& tx_block_info, bool unconfirmed);
+  bool ValidateTransaction(const libbitcoin::chain::transaction& transaction);
+  bool PublishTransaction(const libbitcoin::chain::transaction& transaction);
+  BlockHeightResult FetchBlockHeight();
+  // requests the rows of the address at or above from_height
+  bool RequestHistory(const libbitcoin::wallet::payment_address& query_address,
+                      size_t from_height,
+                      libbitcoin::chain::history::list& rows,
+                      const ErrorHandler& on_error);
+  // passes the cached rows to on_cached (under the cache lock, so
+  // they aren't copied) if they're current, otherwise returns false
+  // and the height to refresh them from (0 for a full fetch)
+  bool GetCachedHistory(
+      const libbitcoin::short_hash& key_hash,
+      const std::function<void(const libbitcoin::chain::history::list&)>&
+          on_cached,
+      size_t& from_height);
+  // merges the rows from from_height into the cached history, which
+  // is then complete up to height, and returns the merged rows.
+  // Fails if the cached history is gone or doesn't hold an output
+  // that the new rows spend, in which case it must be fetched in full.
+  bool MergeCachedHistory(const libbitcoin::short_hash& key_hash,
+                          size_t from_height, size_t height,
+                          libbitcoin::chain::history::list& rows);
+  // drops the least recently used histories while the cache holds
+  // more than max_cached_history_rows rows
+  void TrimHistoryCache();
+  bool FetchBlockTransactionHashes(size_t height,
+                                   libbitcoin::hash_list& tx_hashes);
+  bool FetchBlockHash(size_t height, libbitcoin::hash_digest& block_hash);
+  bool FetchTransaction(const libbitcoin::hash_digest& tx_hash,
+                        libbitcoin::chain::transaction& tx);
+
+  // brings the history cache up to the current block height, either
+  // by scanning the new blocks for wallet activity and marking the
+  // histories it touches stale, or by marking every history stale,
+  // whichever needs fewer requests
+  void SyncHistoryCache();
+  bool ScanBlocks(size_t from_height, size_t to_height,
+                  const BlockScanner& scanner,
+                  std::set<libbitcoin::short_hash>& touched);
+  void InvalidateHistories(
+      const std::vector<libbitcoin::short_hash>& key_hashes);
+
+  // returns true if a block the history cache was synced at is no
+  // longer in the chain, with the height of the highest one that
+  // still is in fork_height (0 if none is)
+  bool FindReorganisation(size_t tip, size_t& fork_height);
+  // undoes the cached rows above the fork height, using the undo
+  // index to visit only the histories that have any, and marks those
+  // histories stale.  The blocks above the fork are then scanned
+  // again like any new blocks.
+  void RollbackHistoryCache(size_t fork_height);
+  // remembers the hash of the block the cache was synced to and
+  // forgets those below the reorg depth (with history_cache_lock_ held)
+  void RecordBlockHash(size_t height, const libbitcoin::hash_digest& hash);
+  // adds the recent rows of a cached history to the undo index (with
+  // history_cache_lock_ held)
+  void IndexHistoryHeights(const libbitcoin::short_hash& key_hash,
+                           const libbitcoin::chain::history::list& rows,
+                           size_t height);
+
   size_t GetCurrentBlockHeight();
 
   bool initialized_;
   size_t gap_limit_;
   size_t num_accounts_;
+  std::vector<AccountType> account_types_;
   uint64_t prefixes_;
   uint32_t public_prefix_;
   uint32_t private_prefix_;
   HDKey bip32_root_private_key_;
-  LibbitcoinClient client_{megabit::constants::timeout_seconds,
-                           megabit::constants::num_retries};
-  LibbitcoinClient block_height_client_{megabit::constants::timeout_seconds,
-                                        megabit::constants::num_retries};
-  std::string libbitcoin_server_address_;
-  std::string libbitcoin_server_public_key_;
+  HDKey bip44_coin_type_key_;
+  HDKey bip84_coin_type_key_;
+  // every request leases a client of its own (from the best ranked
+  // server), so the gui and worker threads never share one.
+  // Subscriptions are long lived and are kept in a separate pool to
+  // the primary server so they can't starve requests
+  ServerList servers_;
+  ConnectionPool subscription_pool_{
+      megabit::constants::max_subscription_connections};
   size_t block_height_;
   uint8_t payment_address_version_;
+  std::string bech32_prefix_;
   uint32_t bip44_coin_type_;
-  std::shared_ptr<PendingTransaction> pending_transaction_;
+  std::mutex reservation_lock_;
+  std::unordered_set<libbitcoin::chain::point> reserved_unspent_;
+  // the outputs spent by the transactions we've signed, for local
+  // validation and re-signing.  Released once the spending
+  // transaction confirms, or its payment is canceled or fails.
+  std::mutex prevout_lock_;
+  std::unordered_map<libbitcoin::chain::point, libbitcoin::chain::output>
+      prevout_cache_;
+  bool server_validation_;
+  UnconfirmedSpendPolicy unconfirmed_spend_policy_;
+  // set once a p2wpkh output has been found in the server's history
+  bool witness_indexing_verified_;
+  std::mutex broadcast_lock_;
+  std::unordered_map<libbitcoin::hash_digest, BroadcastTransaction>
+      broadcast_transactions_;
   std::unordered_set<std::string> external_address_cache_;
   std::unordered_set<std::string> internal_address_cache_;
+  // the bip84 key hashes and the account index of every wallet key
+  // hash.  Written on the ui thread as accounts and addresses are
+  // added, and read by the payment, consolidation, promotion and
+  // subscription threads.
+  mutable std::mutex key_hash_lock_;
+  std::set<libbitcoin::short_hash> witness_key_hashes_;
+  std::unordered_map<libbitcoin::short_hash, uint32_t> key_hash_accounts_;
+  MempoolTracker mempool_;
+  RequestLog request_log_;
+  struct CachedHistory {
+    libbitcoin::chain::history::list rows;
+    // the block height the rows were complete at
+    size_t height;
+    // set when the address may have rows above that height
+    bool stale;
+    // history_cache_uses_ when it was last read or merged
+    uint64_t last_used;
+  };
+
+  // history rows by query key hash.  The block scan cursor is the
+  // height up to which new activity has been flagged as stale.
+  // Histories missing from the cache are fetched in full, stale ones
+  // from a little below their height.
+  std::mutex history_sync_lock_;
+  std::mutex history_cache_lock_;
+  std::unordered_map<libbitcoin::short_hash, CachedHistory> history_cache_;
+  size_t history_cache_rows_;
+  uint64_t history_cache_uses_;
+  size_t history_cache_height_;
+  // the hashes of the blocks the cache was synced at, and the undo
+  // index of the cached histories with an output or spend at each
+  // height, over the last max_reorg_depth blocks
+  std::map<size_t, libbitcoin::hash_digest> block_hashes_;
+  std::map<size_t, std::set<libbitcoin::short_hash>> history_heights_;
+  double scan_transactions_per_block_;
+
+  // declared last, so that outstanding requests complete before the
+  // state they use is destroyed
+  RequestExecutor request_executor_{megabit::constants::max_pool_connections};
 };
 
 #endif  // __BITCOIN_INTERFACE_HPP
@@ -0,0 +1,75 @@
+/*
+ * This file is part of Megabit, a BIP44 HD wallet built on
+ * libbitcoin.
+ *
+ * Copyright (C) 2017 Neill Miller (neillm@thecodefactory.org)
+ *
+ * Megabit is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Megabit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Megabit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __BLOCK_SCANNER_HPP
+#define __BLOCK_SCANNER_HPP
+
+#include <bitcoin/bitcoin.hpp>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+// matches the key hashes and spent outpoints of block transactions
+// against the wallet.  Almost nothing in a block belongs to the
+// wallet, so candidates are first checked against a bloom filter
+// over the wallet's key hashes and outpoints, which is far smaller
+// (and faster to probe) than the exact sets it guards.
+class BlockScanner {
+ public:
+  using OutpointMap =
+      std::unordered_map<libbitcoin::chain::point, libbitcoin::short_hash>;
+
+  // outpoints map each known wallet output to the key hash it pays
+  BlockScanner(const std::vector<libbitcoin::short_hash>& key_hashes,
+               OutpointMap outpoints, double false_positive_rate);
+
+  bool Matches(const libbitcoin::short_hash& key_hash) const;
+  // if the outpoint is a wallet output, returns the key hash it pays
+  bool Matches(const libbitcoin::chain::point& outpoint,
+               libbitcoin::short_hash& key_hash) const;
+
+  // scanning costs a request for the transaction hashes of every
+  // block and one per transaction, refreshing addresses a history
+  // request each
+  static bool ShouldScanBlocks(size_t num_blocks, size_t num_addresses,
+                               double transactions_per_block);
+
+ private:
+  class BloomFilter {
+   public:
+    BloomFilter(size_t num_elements, double false_positive_rate);
+
+    void Insert(uint64_t hash);
+    bool MayContain(uint64_t hash) const;
+
+   private:
+    std::vector<bool> bits_;
+    size_t num_hashes_;
+  };
+
+  static uint64_t Hash(const libbitcoin::short_hash& key_hash);
+
+  BloomFilter key_hash_filter_;
+  BloomFilter outpoint_filter_;
+  std::set<libbitcoin::short_hash> key_hashes_;
+  const OutpointMap outpoints_;
+};
+
+#endif  // __BLOCK_SCANNER_HPP
@@ -0,0 +1,94 @@
+/*
+ * This file is part of Megabit, a BIP44 HD wallet built on
+ * libbitcoin.
+ *
+ * Copyright (C) 2017 Neill Miller (neillm@thecodefactory.org)
+ *
+ * Megabit is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Megabit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Megabit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CHAIN_TIP_LISTENER_HPP
+#define __CHAIN_TIP_LISTENER_HPP
+
+#include <QThread>
+#include <atomic>
+#include <bitcoin/protocol.hpp>
+#include <chrono>
+#include <mutex>
+
+#include "bitcoin_interface.hpp"
+
+// tracks the chain tip for the lifetime of the wallet on one thread.
+// The server's block and heartbeat services push each new block as
+// soon as the server accepts it.  Polling of the last height is the
+// fallback: it backs off while the tip is unchanged, and is only a
+// slow safety net while the heartbeat shows that pushes are arriving.
+class ChainTipListener : public QObject {
+  Q_OBJECT
+
+ public:
+  explicit ChainTipListener(BitcoinInterface& bitcoin_interface)
+      : bitcoin_interface_(bitcoin_interface),
+        running_(true),
+        server_changed_(false),
+        height_(0) {}
+
+  ~ChainTipListener() {}
+
+  // thread safe.  The block and heartbeat service endpoints are
+  // derived from the query service address.
+  void SetServerInfo(const std::string& libbitcoin_server_address,
+                     const std::string& libbitcoin_server_public_key);
+
+  // thread safe.  Run returns (and finished is emitted) within a
+  // monitor period.
+  void Stop();
+
+ public slots:
+  void Run();
+
+ signals:
+  void finished();
+  void NewTip(quint32 height);
+  void ChainTipError(QString error);
+
+ private:
+  using Clock = std::chrono::steady_clock;
+  using Socket = libbitcoin::protocol::zmq::socket;
+
+  bool ConnectServices(libbitcoin::protocol::zmq::context& context,
+                       std::unique_ptr<Socket>& block_socket,
+                       std::unique_ptr<Socket>& heartbeat_socket);
+  std::unique_ptr<Socket> ConnectService(
+      libbitcoin::protocol::zmq::context& context, uint16_t port_offset,
+      const std::string& libbitcoin_server_address,
+      const std::string& libbitcoin_server_public_key);
+
+  // returns true if the tip changed
+  bool OnBlockMessage(libbitcoin::protocol::zmq::message& message);
+  bool PollHeight();
+  bool SetHeight(size_t height);
+
+  BitcoinInterface& bitcoin_interface_;
+  std::atomic<bool> running_;
+
+  std::mutex server_lock_;
+  bool server_changed_;
+  std::string libbitcoin_server_address_;
+  std::string libbitcoin_server_public_key_;
+
+  size_t height_;
+};
+
+#endif  // __CHAIN_TIP_LISTENER_HPP
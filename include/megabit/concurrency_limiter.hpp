@@ -0,0 +1,108 @@
+/*
+ * This file is part of Megabit, a BIP44 HD wallet built on
+ * libbitcoin.
+ *
+ * Copyright (C) 2017 Neill Miller (neillm@thecodefactory.org)
+ *
+ * Megabit is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Megabit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Megabit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CONCURRENCY_LIMITER_HPP
+#define __CONCURRENCY_LIMITER_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+
+#include "../include/megabit/constants.hpp"
+
+struct ConcurrencyMetrics {
+  // requests allowed in flight at once, and those that are
+  double limit;
+  size_t in_flight;
+  size_t peak_in_flight;
+  // times the limit was cut, and requests that waited for a slot
+  uint64_t decreases;
+  uint64_t waits;
+
+  friend std::ostream& operator<<(std::ostream& out,
+                                  const ConcurrencyMetrics& metrics) {
+    out << "Concurrency[limit=" << metrics.limit
+        << ", in flight=" << metrics.in_flight
+        << ", peak in flight=" << metrics.peak_in_flight
+        << ", decreases=" << metrics.decreases << ", waits=" << metrics.waits
+        << "]";
+    return out;
+  }
+};
+
+enum class RequestOutcome {
+  success,
+  // the server is overloaded (oversubscribed, or timed out)
+  congested,
+  failed
+};
+
+// limits the requests in flight to one server with AIMD, as TCP does
+// for its congestion window: every success adds 1/limit to the limit
+// (about one more slot per round of requests), and congestion halves
+// it, at most once per decrease interval so that a burst of timeouts
+// from the same round only counts once.  Requests wait for a slot
+// while the limit is reached.
+class ConcurrencyLimiter {
+ public:
+  // a slot for one request, released with the request's outcome
+  class Permit {
+   public:
+    Permit() : limiter_(nullptr) {}
+    explicit Permit(ConcurrencyLimiter* limiter) : limiter_(limiter) {}
+    Permit(Permit&& other) : limiter_(other.limiter_) {
+      other.limiter_ = nullptr;
+    }
+    Permit(const Permit&) = delete;
+    Permit& operator=(const Permit&) = delete;
+    // requests that didn't report an outcome leave the limit as is
+    ~Permit() { Release(RequestOutcome::failed); }
+
+    explicit operator bool() const { return limiter_ != nullptr; }
+
+    void Release(RequestOutcome outcome);
+
+   private:
+    ConcurrencyLimiter* limiter_;
+  };
+
+  explicit ConcurrencyLimiter(
+      size_t max_limit = megabit::constants::max_pool_connections);
+
+  // returns an empty permit if no slot was released within the
+  // timeout
+  Permit Acquire(std::chrono::milliseconds timeout = std::chrono::milliseconds(
+                     megabit::constants::pool_acquire_timeout_ms));
+
+  ConcurrencyMetrics GetMetrics();
+
+ private:
+  void Release(RequestOutcome outcome);
+
+  const double max_limit_;
+  std::mutex lock_;
+  std::condition_variable available_;
+  std::chrono::steady_clock::time_point last_decrease_;
+  ConcurrencyMetrics metrics_;
+};
+
+#endif  // __CONCURRENCY_LIMITER_HPP
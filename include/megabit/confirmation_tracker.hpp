@@ -0,0 +1,68 @@
+/*
+ * This file is part of Megabit, a BIP44 HD wallet built on
+ * libbitcoin.
+ *
+ * Copyright (C) 2017 Neill Miller (neillm@thecodefactory.org)
+ *
+ * Megabit is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Megabit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Megabit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CONFIRMATION_TRACKER_HPP
+#define __CONFIRMATION_TRACKER_HPP
+
+#include <QPersistentModelIndex>
+#include <map>
+#include <vector>
+
+#include "../include/megabit/constants.hpp"
+
+struct ConfirmationChange {
+  QPersistentModelIndex row;
+  size_t confirmations;
+};
+
+// the confirmations of the transaction table rows, kept by the
+// height of their transaction.  A row is only tracked until it has
+// max_confirmations, so each new tip only visits the rows of the
+// most recent blocks, all of which gain a confirmation.  Rows are
+// referred to by persistent indices, which follow them as the table
+// is sorted.
+class ConfirmationTracker {
+ public:
+  explicit ConfirmationTracker(
+      size_t max_confirmations = megabit::constants::num_confirmations)
+      : max_confirmations_(max_confirmations), tip_height_(0) {}
+
+  // tracks the row of a transaction at the height (0 if it's
+  // unconfirmed), replacing any unconfirmed height it was tracked
+  // at.  Returns its confirmations as of the current tip.
+  size_t Track(const QPersistentModelIndex& row, size_t height);
+
+  // returns the rows whose confirmations changed, and stops tracking
+  // those that reached max_confirmations (or were removed)
+  std::vector<ConfirmationChange> SetTipHeight(size_t tip_height);
+
+  // capped at max_confirmations
+  size_t GetConfirmations(size_t height) const;
+  size_t GetMaxConfirmations() const { return max_confirmations_; }
+
+  void Clear() { rows_.clear(); }
+
+ private:
+  const size_t max_confirmations_;
+  size_t tip_height_;
+  std::multimap<size_t, QPersistentModelIndex> rows_;
+};
+
+#endif  // __CONFIRMATION_TRACKER_HPP
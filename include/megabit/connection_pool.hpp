@@ -0,0 +1,132 @@
+/*
+ * This file is part of Megabit, a BIP44 HD wallet built on
+ * libbitcoin.
+ *
+ * Copyright (C) 2017 Neill Miller (neillm@thecodefactory.org)
+ *
+ * Megabit is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Megabit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Megabit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CONNECTION_POOL_HPP
+#define __CONNECTION_POOL_HPP
+
+#include <bitcoin/client/obelisk_client.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#include "../include/megabit/constants.hpp"
+
+using LibbitcoinClient = libbitcoin::client::obelisk_client;
+
+struct ConnectionPoolMetrics {
+  // connections (established sessions) opened over the pool lifetime
+  uint64_t connects;
+  uint64_t acquisitions;
+  uint64_t acquire_timeouts;
+  // time spent waiting for a connection, in microseconds
+  uint64_t total_acquire_wait_us;
+  uint64_t max_acquire_wait_us;
+  // connections currently open, and those of them that are leased
+  size_t connections;
+  size_t in_use;
+  size_t peak_in_use;
+
+  friend std::ostream& operator<<(std::ostream& out,
+                                  const ConnectionPoolMetrics& metrics) {
+    out << "ConnectionPool[connects=" << metrics.connects
+        << ", acquisitions=" << metrics.acquisitions
+        << ", timeouts=" << metrics.acquire_timeouts << ", avg wait="
+        << (metrics.acquisitions
+                ? (metrics.total_acquire_wait_us / metrics.acquisitions)
+                : 0)
+        << "us, max wait=" << metrics.max_acquire_wait_us
+        << "us, connections=" << metrics.connections
+        << ", in use=" << metrics.in_use
+        << ", peak in use=" << metrics.peak_in_use << "]";
+    return out;
+  }
+};
+
+// hands out connected obelisk clients to one thread at a time.
+// Connections are opened on demand (the CurveZMQ handshake is only
+// paid once per connection), are kept open when they're returned,
+// and the total number open never exceeds max_connections.
+// Acquiring waits for a connection to be returned when all of them
+// are in use.
+class ConnectionPool {
+ public:
+  // a leased client, returned to the pool when the lease is destroyed
+  class Lease {
+   public:
+    Lease() : pool_(nullptr) {}
+    Lease(ConnectionPool* pool, std::unique_ptr<LibbitcoinClient> client)
+        : pool_(pool), client_(std::move(client)) {}
+    Lease(Lease&& other) = default;
+    Lease& operator=(Lease&& other);
+    Lease(const Lease&) = delete;
+    Lease& operator=(const Lease&) = delete;
+    ~Lease() { Release(false); }
+
+    explicit operator bool() const { return static_cast<bool>(client_); }
+    LibbitcoinClient* operator->() const { return client_.get(); }
+    LibbitcoinClient& operator*() const { return *client_; }
+
+    // closes the connection rather than returning it to the pool
+    // (e.g. when it carries subscriptions or has timed out)
+    void Discard() { Release(true); }
+
+   private:
+    void Release(bool discard);
+
+    ConnectionPool* pool_;
+    std::unique_ptr<LibbitcoinClient> client_;
+  };
+
+  explicit ConnectionPool(
+      size_t max_connections = megabit::constants::max_pool_connections);
+
+  // idle connections to a previous server are closed
+  void SetServerInfo(const std::string& libbitcoin_server_address,
+                     const std::string& libbitcoin_server_public_key);
+
+  // returns an empty lease if no connection could be established, or
+  // none was returned to the pool within the timeout
+  Lease Acquire(std::chrono::milliseconds timeout = std::chrono::milliseconds(
+                    megabit::constants::pool_acquire_timeout_ms));
+
+  ConnectionPoolMetrics GetMetrics();
+
+ private:
+  std::unique_ptr<LibbitcoinClient> Connect(
+      const std::string& libbitcoin_server_address,
+      const std::string& libbitcoin_server_public_key);
+  void Release(std::unique_ptr<LibbitcoinClient> client, bool discard);
+
+  const size_t max_connections_;
+  std::mutex lock_;
+  std::condition_variable available_;
+  std::string libbitcoin_server_address_;
+  std::string libbitcoin_server_public_key_;
+  std::vector<std::unique_ptr<LibbitcoinClient>> idle_;
+  std::vector<LibbitcoinClient*> leased_;
+  // leased connections to a previous server, closed when returned
+  std::vector<LibbitcoinClient*> stale_;
+  ConnectionPoolMetrics metrics_;
+};
+
+#endif  // __CONNECTION_POOL_HPP
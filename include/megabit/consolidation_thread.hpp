@@ -18,49 +18,41 @@
  * along with Megabit.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#ifndef __SEND_PAYMENT_THREAD_HPP
-#define __SEND_PAYMENT_THREAD_HPP
+#ifndef __CONSOLIDATION_THREAD_HPP
+#define __CONSOLIDATION_THREAD_HPP
 
 #include <QThread>
 
 #include "bitcoin_interface.hpp"
 
-class SendPaymentThread : public QObject {
+class ConsolidationThread : public QObject {
   Q_OBJECT
 
  public:
-  explicit SendPaymentThread(
-      BitcoinInterface& bitcoin_interface, const uint32_t account_index,
-      uint64_t& amount,
-      const libbitcoin::wallet::payment_address destination_address,
-      const uint64_t target_fee_per_kb, bool subtract_fee_from_amount)
+  explicit ConsolidationThread(BitcoinInterface& bitcoin_interface,
+                               const size_t num_accounts,
+                               const uint64_t target_fee_per_kb,
+                               const ConsolidationPolicy& policy)
       : bitcoin_interface_(bitcoin_interface),
-        account_index_(account_index),
-        amount_(amount),
-        destination_address_(destination_address),
+        num_accounts_(num_accounts),
         target_fee_per_kb_(target_fee_per_kb),
-        subtract_fee_from_amount_(subtract_fee_from_amount),
-        send_called_(false) {}
+        policy_(policy) {}
 
-  ~SendPaymentThread() {}
+  ~ConsolidationThread() {}
 
  public slots:
-  void SendPayment();
-  void OnSendUserConfirmedPayment();
+  void Consolidate();
 
  signals:
-  void GetUserSendPaymentConfirmation();
   void finished();
-  void SendPaymentError(QString error);
+  void ConsolidationComplete(quint32 num_transactions);
+  void ConsolidationError(QString error);
 
  private:
   BitcoinInterface& bitcoin_interface_;
-  uint32_t account_index_;
-  uint64_t& amount_;
-  libbitcoin::wallet::payment_address destination_address_;
+  size_t num_accounts_;
   uint64_t target_fee_per_kb_;
-  bool subtract_fee_from_amount_;
-  bool send_called_;
+  ConsolidationPolicy policy_;
 };
 
-#endif  // __SEND_PAYMENT_THREAD_HPP
+#endif  // __CONSOLIDATION_THREAD_HPP
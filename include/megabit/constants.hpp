@@ -67,6 +67,154 @@ static constexpr uint32_t bip44_coin_type_testnet =
     bip44_hardened_derivation_testnet;
 static constexpr uint32_t bip44_account = bip44_hardened_derivation;
 
+// bip84: https://github.com/bitcoin/bips/blob/master/bip-0084.mediawiki
+static constexpr uint32_t bip84_purpose =
+    bip44_hardened_derivation + 84;  // 0x80000054
+
+// bip173 human readable parts of bech32 (native segwit) addresses
+static constexpr auto bech32_mainnet_prefix = "bc";
+static constexpr auto bech32_testnet_prefix = "tb";
+
+// approximate serialized sizes (in bytes) of p2pkh transaction
+// parts, used to estimate fees before a transaction is built
+static constexpr size_t tx_overhead_size = 10;
+static constexpr size_t p2pkh_input_size = 148;
+static constexpr size_t p2pkh_output_size = 34;
+// signature + public key push of a signed p2pkh input
+static constexpr size_t p2pkh_input_script_size = 107;
+// item count, signature and public key of a signed p2wpkh input's
+// witness, and the marker and flag bytes of a witness transaction
+static constexpr size_t p2wpkh_witness_size = 108;
+static constexpr size_t witness_marker_size = 2;
+
+// outputs below this value are not relayed by the network
+static constexpr uint64_t dust_threshold = 546;
+
+// batch payments are rejected above this many recipients (keeps the
+// transaction below the 100KB standard size limit)
+static constexpr size_t max_batch_recipients = 2500;
+
+// defaults for utxo consolidation: only outputs worth at most
+// consolidation_max_utxo_value are merged, and only while the fee
+// rate is at or below consolidation_max_fee_per_kb
+static constexpr uint64_t consolidation_max_fee_per_kb = 5000;
+static constexpr uint64_t consolidation_max_utxo_value = 100000;
+static constexpr size_t consolidation_max_inputs = 100;
+
+// payments built and broadcast at the same time by the payment queue
+static constexpr int max_concurrent_payments = 4;
+// times utxo selection is repeated when another payment reserved
+// some of the selected utxos first
+static constexpr size_t max_reservation_attempts = 3;
+
+// bounds on the connections (sockets) held open to the server for
+// requests and for address subscriptions.  Every wallet address is
+// subscribed on one connection, the other is spare for reconnects.
+static constexpr size_t max_pool_connections = 8;
+static constexpr size_t max_subscription_connections = 2;
+// how long a request waits for a connection to be returned
+static constexpr uint32_t pool_acquire_timeout_ms = 30000;
+
+// a server whose connection failed is tried last for a backoff that
+// doubles with every consecutive failure
+static constexpr uint32_t server_backoff_base_ms = 1000;
+static constexpr uint32_t server_backoff_max_ms = 300000;
+
+// hedged reads are duplicated to a second server once they're slower
+// than this percentile of the recent latencies of their server (or
+// the default delay until enough have been seen)
+static constexpr double hedge_latency_percentile = 0.95;
+static constexpr size_t min_hedge_latency_samples = 16;
+static constexpr size_t max_hedge_latency_samples = 128;
+static constexpr uint32_t default_hedge_delay_ms = 1000;
+static constexpr uint32_t min_hedge_delay_ms = 20;
+// threads running hedged attempts, per pooled connection (a read has
+// at most its own attempt and a hedge running at once)
+static constexpr size_t hedge_threads_per_connection = 2;
+// requests kept for the p50/p99 latency metrics
+static constexpr size_t max_latency_samples = 1024;
+// the server and scheduler metrics are logged this often
+static constexpr uint32_t metrics_log_interval_ms = 60000;
+
+// requests in flight to a server start at this limit, and it adapts
+// (up to max_pool_connections) to how the server keeps up.  The
+// limit is cut by the factor on congestion, at most once an interval.
+static constexpr size_t initial_concurrency_limit = 2;
+static constexpr double concurrency_decrease_factor = 0.5;
+static constexpr uint32_t concurrency_decrease_interval_ms = 1000;
+
+// the subscription dispatcher polls its connection for notifications
+// for this long per pass (obelisk_client::monitor takes whole
+// seconds), and renews all subscriptions well before the server
+// expires them
+static constexpr uint32_t subscription_monitor_period_s = 1;
+static constexpr uint32_t subscription_renewal_s = 300;
+static constexpr uint32_t subscription_retry_ms = 10000;
+// notifications can arrive before the server has indexed their
+// transaction, so its lookup is retried after a delay that doubles
+// from the base up to the max.  Once the retries run out, the
+// notification is handled as unroutable.
+static constexpr uint32_t notification_retry_base_ms = 100;
+static constexpr uint32_t notification_retry_max_ms = 3200;
+static constexpr uint32_t notification_max_retries = 8;
+// a tracked unconfirmed transaction is dropped once it's been missing
+// from the server's mempool at this many block checks in a row
+static constexpr uint32_t max_mempool_misses = 3;
+
+// the server's heartbeat and block services listen on the ports
+// following its query service port
+static constexpr uint16_t heartbeat_service_port_offset = 1;
+static constexpr uint16_t block_service_port_offset = 2;
+// the chain tip is polled between the min and max intervals when
+// blocks aren't pushed, otherwise at the push interval.  Pushes are
+// assumed lost when no heartbeat arrives within the timeout.
+static constexpr int32_t chain_tip_monitor_period_ms = 250;
+static constexpr uint32_t chain_tip_min_poll_ms = 5000;
+static constexpr uint32_t chain_tip_max_poll_ms = 60000;
+static constexpr uint32_t chain_tip_push_poll_ms = 600000;
+static constexpr uint32_t heartbeat_timeout_ms = 30000;
+
+// wallet addresses are subscribed by key hash prefixes, using as few
+// prefixes as keep the chance of an unrelated output matching below
+// the rate, but never more than max_address_subscriptions
+static constexpr size_t max_address_subscriptions = 1024;
+static constexpr double max_subscription_false_positive_rate = 0.001;
+
+// wallet histories are refreshed by scanning the blocks since the
+// last refresh when that takes fewer requests than re-fetching every
+// address.  Blocks are assumed to hold this many transactions until
+// some have been scanned.
+static constexpr double block_scan_transactions_per_block = 2000.0;
+static constexpr double block_scan_false_positive_rate = 0.0001;
+// stale histories are refreshed from this many blocks below the
+// height they were complete at, so that rows from blocks reorganised
+// since are replaced
+static constexpr size_t history_refresh_overlap = 6;
+// the history cache holds at most this many rows in total.  Beyond
+// it, the least recently used histories are dropped (down to three
+// quarters of it) and fetched in full when next needed.
+static constexpr size_t max_cached_history_rows = 200000;
+// the hashes of the blocks the history cache was synced at, and the
+// heights of the cached rows, are kept for this many blocks below the
+// tip.  Reorganisations within them roll back only the histories
+// with rows above the fork, deeper ones empty the cache.
+static constexpr size_t max_reorg_depth = 100;
+// transfers of an address history are processed in pages of this
+// many, bounding the transactions held and requested at once
+static constexpr size_t history_page_size = 32;
+
+// bip125: inputs with a sequence below 0xfffffffe signal that the
+// transaction may be replaced by one paying a higher fee
+static constexpr uint32_t rbf_input_sequence = 0xfffffffd;
+// minimum fee rate (satoshi per KB) by which a replacement must
+// increase the fee, paying for its own relay
+static constexpr uint64_t incremental_relay_fee_per_kb = 1000;
+
+// longest chain of our own unconfirmed transactions that a new
+// payment may extend by spending unconfirmed change (well below the
+// network's ancestor limit of 25)
+static constexpr size_t max_unconfirmed_chain_depth = 10;
+
 static constexpr uint32_t qr_code_size = 12;
 
 // secure endpoint of the official mainnet community server
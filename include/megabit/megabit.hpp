@@ -32,14 +32,17 @@
 #include <QSplashScreen>
 #include <QTableWidgetItem>
 #include <QTemporaryFile>
-#include <boost/smart_ptr/detail/spinlock.hpp>
 #include <unordered_map>
+#include <unordered_set>
 
-#include "address_monitor_thread.hpp"
 #include "bitcoin_interface.hpp"
-#include "block_height_thread.hpp"
-#include "send_payment_thread.hpp"
+#include "chain_tip_listener.hpp"
+#include "confirmation_tracker.hpp"
+#include "consolidation_thread.hpp"
+#include "payment_queue.hpp"
 #include "settings.hpp"
+#include "subscription_dispatcher.hpp"
+#include "transaction_promoter.hpp"
 
 #define safe_delete(x) \
   if (x) delete x
@@ -56,27 +59,36 @@ struct Configuration {
   bool first_time;
   size_t num_accounts;
   QStringList account_names;
+  std::vector<AccountType> account_types;
   QString network;
+  // new payments opt in to replace-by-fee so that they can be bumped
+  bool signal_rbf;
   QString checksum;
   QString currency;
   QString creation_time;
   QString encrypted_seed;
   QString server_address;
   QString server_public_key;
+  // tried in order of latency after the configured server fails
+  std::vector<ServerInfo> fallback_servers;
+  // duplicate slow reads to a second server
+  bool hedge_requests;
+  // "record" or "replay" server requests with the capture file
+  QString capture_mode;
+  QString capture_file;
+  bool capture_flat_out;
   uint64_t low_fee_per_kb;
   uint64_t medium_fee_per_kb;
   uint64_t high_fee_per_kb;
+  ConsolidationPolicy consolidation_policy;
+  UnconfirmedSpendPolicy unconfirmed_spend_policy;
+  // also validate locally checked transactions on the server
+  bool server_validation;
   size_t current_tab_index;
   size_t current_account_index;
   std::unordered_map<std::string, double> currency_value_map;
 };
 
-struct AddressMonitorObj {
-  QThread* address_monitor_thread;
-  AddressMonitorThread* address_monitor_worker;
-  std::shared_ptr<AddressMonitorInfo> address_monitor_info;
-};
-
 class Megabit : public QMainWindow {
   Q_OBJECT
 
@@ -96,6 +108,7 @@ class Megabit : public QMainWindow {
   void OnFeeDataRead();
 
   void GetCurrencyData();
+  void LogServerMetrics();
   void OnCurrencyDataRead();
 
   void ShowWalletLoader();
@@ -103,17 +116,24 @@ class Megabit : public QMainWindow {
 
   void OnAccountNameEdited(int row, int column);
 
-  void GetBlockHeight();
-  void OnGetBlockHeight();
-  void OnBlockHeightError(QString error);
+  void OnNewTip(quint32 height);
+  void OnChainTipError(QString error);
+  void OnTransactionsPromoted(quint32 generation,
+                              ConfirmedTransactionList confirmed);
+  void OnWitnessHistoryMissing();
 
   void SendPayment();
+  void SendBatchPayment();
   void OnPaymentSent();
 
   void AddAccount();
 
+  void ConsolidateOutputs();
+  void OnConsolidationComplete(quint32 num_transactions);
+  void OnConsolidationError(QString error);
+
   void MonitorAddress(std::string address);
-  void OnMonitorAddressComplete();
+  void OnAddressActivity(QString address, quint32 height, QString tx_hash);
   void OnAddressSubscriptionError(QString error);
 
   void RefreshTransactions();
@@ -138,7 +158,12 @@ class Megabit : public QMainWindow {
 
   void OnCopyReceiveAddress();
 
-  void OnGetUserSendPaymentConfirmation();
+  void OnPaymentReady(quint32 payment_id);
+  void OnPaymentFailed(quint32 payment_id, QString error);
+  void OnPaymentStateChanged(quint32 payment_id, int state);
+  void BumpPaymentFees();
+  void OnPaymentFeeBumped(quint32 payment_id);
+  void OnFeeBumpFailed(quint32 payment_id, QString error);
   void OnSendPaymentError(QString error);
 
  signals:
@@ -146,7 +171,6 @@ class Megabit : public QMainWindow {
   void WalletLoaded();
   void ProgressUpdated(uint32_t account_index, uint32_t row,
                        const TxInfo tx_info);
-  void SendUserConfirmedPayment();
 
  private:
   void ShowSplashScreen();
@@ -164,6 +188,10 @@ class Megabit : public QMainWindow {
 
   void ClearPaymentFields();
 
+  void OnGetUserSendBatchPaymentConfirmation(
+      quint32 payment_id, std::shared_ptr<PendingTransaction> pending_tx,
+      uint64_t fee);
+
   void AddressSubscriptionHandler(const libbitcoin::code& error,
                                   uint16_t sequence, size_t height,
                                   const libbitcoin::hash_digest& tx_hash);
@@ -171,6 +199,22 @@ class Megabit : public QMainWindow {
   void AddUnconfirmedTransaction(const std::string address,
                                  const libbitcoin::chain::transaction& tx);
 
+  // moves the amounts of newly confirmed transactions from the
+  // pending to the confirmed account balances, and marks their rows
+  // in the transaction table confirmed, without reloading the wallet
+  void PromoteTransactions(const std::vector<ConfirmedTransaction>& confirmed);
+  // sent payments are kept until they confirm, so they can be bumped
+  void ForgetConfirmedPayments(
+      const std::vector<ConfirmedTransaction>& confirmed);
+  // shows the confirmed balance of each account, with the pending
+  // amounts of the mempool tracker
+  void UpdateAccountBalances();
+  // tracks the confirmations of a transaction table row, and sets
+  // its tooltips to them
+  void TrackConfirmations(int row, size_t height);
+  void SetConfirmationTooltips(const QPersistentModelIndex& row,
+                               size_t confirmations);
+
   QLabel* status;
   Ui::Megabit* ui;
   CreateWalletWizard* wizard_;
@@ -195,14 +239,31 @@ class Megabit : public QMainWindow {
   bool payment_status_;
   Configuration config_;
   BitcoinInterface bitcoin_interface_;
+  PaymentQueue payment_queue_;
   QNetworkAccessManager network_manager_;
 
   std::vector<QTemporaryFile*> qrcode_image_files_;
   std::unordered_map<uint32_t, uint64_t> account_balance_map_;
 
-  boost::detail::spinlock address_monitor_map_lock_;
-  std::unordered_map<std::string, std::shared_ptr<AddressMonitorObj>>
-      address_monitor_map_;
+  // the tip is tracked by a single listener for the wallet lifetime
+  QThread* chain_tip_thread_;
+  ChainTipListener* chain_tip_listener_;
+
+  // every wallet address is subscribed on the dispatcher's single
+  // connection and thread
+  QThread* subscription_thread_;
+  SubscriptionDispatcher* subscription_dispatcher_;
+  // tracked unconfirmed transactions are checked on each new tip off
+  // the ui thread.  The generation changes on every refresh.
+  QThread* promotion_thread_;
+  TransactionPromoter* transaction_promoter_;
+  quint32 promotion_generation_;
+  bool witness_history_warned_;
+  // unconfirmed transactions already inserted into the transaction
+  // table since it was last refreshed, and those since promoted
+  std::unordered_set<std::string> notified_transactions_;
+  std::unordered_set<std::string> promoted_transactions_;
+  ConfirmationTracker confirmation_tracker_;
 };
 
 #endif  // __MEGABIT_HPP
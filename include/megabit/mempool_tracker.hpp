@@ -0,0 +1,92 @@
+/*
+ * This file is part of Megabit, a BIP44 HD wallet built on
+ * libbitcoin.
+ *
+ * Copyright (C) 2017 Neill Miller (neillm@thecodefactory.org)
+ *
+ * Megabit is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Megabit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Megabit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __MEMPOOL_TRACKER_HPP
+#define __MEMPOOL_TRACKER_HPP
+
+#include <bitcoin/bitcoin.hpp>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// an unconfirmed transaction paying or spending wallet accounts
+struct MempoolEntry {
+  libbitcoin::chain::transaction tx;
+  // value paid to, and spent from, each account index
+  std::map<uint32_t, uint64_t> received;
+  std::map<uint32_t, uint64_t> spent;
+  // broadcast by this wallet, rather than seen in a notification
+  bool outgoing;
+  // consecutive checks that found the transaction neither confirmed
+  // nor in the server's mempool
+  uint32_t misses;
+};
+
+struct PendingBalance {
+  uint64_t incoming;
+  uint64_t outgoing;
+};
+
+// a tracked transaction that has been confirmed
+struct ConfirmedTransaction {
+  libbitcoin::hash_digest tx_hash;
+  size_t height;
+  MempoolEntry entry;
+};
+
+// the wallet's unconfirmed transactions, keyed by hash, with the
+// pending balance of each account kept up to date as transactions
+// are added and removed, so that neither needs a history rescan.
+// Thread safe.
+class MempoolTracker {
+ public:
+  // returns false if the transaction is already tracked.  Tracked
+  // transactions spending any of the same outputs (i.e. replaced
+  // ones) are dropped.
+  bool Add(const MempoolEntry& entry);
+  // returns false if the transaction isn't tracked
+  bool Remove(const libbitcoin::hash_digest& tx_hash, MempoolEntry& entry);
+  bool Contains(const libbitcoin::hash_digest& tx_hash);
+
+  // counts a check that didn't find the transaction, and stops
+  // tracking it after max_misses consecutive ones.  Returns true if
+  // it was dropped.
+  bool Missed(const libbitcoin::hash_digest& tx_hash, uint32_t max_misses);
+  void Found(const libbitcoin::hash_digest& tx_hash);
+
+  std::vector<libbitcoin::hash_digest> GetTransactionHashes();
+  PendingBalance GetPendingBalance(uint32_t account_index);
+
+  // the value of an output of a tracked transaction
+  bool GetOutputValue(const libbitcoin::chain::output_point& point,
+                      uint64_t& value);
+
+ private:
+  void Erase(
+      std::unordered_map<libbitcoin::hash_digest, MempoolEntry>::iterator
+          entry_iter);
+
+  std::mutex lock_;
+  std::unordered_map<libbitcoin::hash_digest, MempoolEntry> entries_;
+  std::map<uint32_t, PendingBalance> balances_;
+};
+
+#endif  // __MEMPOOL_TRACKER_HPP
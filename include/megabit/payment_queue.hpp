@@ -0,0 +1,133 @@
+/*
+ * This file is part of Megabit, a BIP44 HD wallet built on
+ * libbitcoin.
+ *
+ * Copyright (C) 2017 Neill Miller (neillm@thecodefactory.org)
+ *
+ * Megabit is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Megabit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Megabit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __PAYMENT_QUEUE_HPP
+#define __PAYMENT_QUEUE_HPP
+
+#include <QObject>
+#include <QThreadPool>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "bitcoin_interface.hpp"
+
+enum class PaymentState : int {
+  queued,
+  building,
+  awaiting_confirmation,
+  validating,
+  broadcasting,
+  sent,
+  failed,
+  canceled,
+  bumping_fee
+};
+
+struct QueuedPayment {
+  uint32_t account_index;
+  RecipientList recipients;
+  uint64_t target_fee_per_kb;
+  bool subtract_fee_from_amount;
+  bool require_confirmation;
+  bool signal_rbf;
+  PaymentState state;
+  std::shared_ptr<PendingTransaction> pending_transaction;
+  // set once the payment has been bumped by a child paying its fee
+  std::shared_ptr<PendingTransaction> child_transaction;
+};
+
+// builds, validates and broadcasts payments on a pool of worker
+// threads so that several payments can be in flight at once.  Every
+// payment reserves the utxos it selects (see
+// BitcoinInterface::ReserveUnspent) so no two payments can spend the
+// same output.  Reservations of payments that fail or are canceled
+// are released.  Payments are forgotten once they fail, are canceled
+// or their transaction confirms.
+class PaymentQueue : public QObject {
+  Q_OBJECT
+
+ public:
+  explicit PaymentQueue(BitcoinInterface& bitcoin_interface,
+                        int max_concurrent_payments =
+                            megabit::constants::max_concurrent_payments);
+  ~PaymentQueue();
+
+  // queues a payment to every recipient (a single recipient is a
+  // regular payment, more than one is a batch payment) and returns
+  // its id.  If require_confirmation is set, the payment waits after
+  // it has been built (emitting PaymentReady) until Confirm or
+  // Cancel is called with its id.  If signal_rbf is set, the
+  // payment can later be replaced by BumpFee.
+  uint32_t Enqueue(const uint32_t account_index,
+                   const RecipientList& recipients,
+                   const uint64_t target_fee_per_kb,
+                   bool subtract_fee_from_amount, bool require_confirmation,
+                   bool signal_rbf);
+
+  void Confirm(uint32_t payment_id);
+  void Cancel(uint32_t payment_id);
+
+  // raises the fee of a sent, but unconfirmed, payment to the target
+  // fee rate.  Payments that signal replace-by-fee are replaced,
+  // otherwise a child spending the change pays for the payment.
+  void BumpFee(uint32_t payment_id, const uint64_t target_fee_per_kb);
+
+  // forgets the sent payment made by the confirmed transaction (or
+  // whose fee it bumped), since it can no longer be bumped
+  void ForgetConfirmedPayment(const libbitcoin::hash_digest& tx_hash);
+
+  std::vector<uint32_t> GetPaymentIds(PaymentState state);
+
+  PaymentState GetState(uint32_t payment_id);
+  std::shared_ptr<PendingTransaction> GetPendingTransaction(
+      uint32_t payment_id);
+
+ signals:
+  void PaymentStateChanged(quint32 payment_id, int state);
+  void PaymentReady(quint32 payment_id);
+  void PaymentSent(quint32 payment_id);
+  void PaymentFailed(quint32 payment_id, QString error);
+  void PaymentFeeBumped(quint32 payment_id);
+  void FeeBumpFailed(quint32 payment_id, QString error);
+
+ private:
+  void Build(uint32_t payment_id);
+  void Broadcast(uint32_t payment_id);
+  void Bump(uint32_t payment_id, const uint64_t target_fee_per_kb);
+
+  void SetState(uint32_t payment_id, PaymentState state);
+  // moves the payment from one state to another, unless it has left
+  // the first state already (e.g. a payment confirmed or canceled
+  // twice)
+  bool TransitionState(uint32_t payment_id, PaymentState from,
+                       PaymentState to);
+  void Fail(uint32_t payment_id, const QString& error);
+  void Forget(uint32_t payment_id);
+  void Run(std::function<void()> task);
+
+  BitcoinInterface& bitcoin_interface_;
+  QThreadPool thread_pool_;
+  std::mutex payments_lock_;
+  uint32_t next_payment_id_;
+  std::unordered_map<uint32_t, QueuedPayment> payments_;
+};
+
+#endif  // __PAYMENT_QUEUE_HPP
@@ -0,0 +1,165 @@
+/*
+ * This file is part of Megabit, a BIP44 HD wallet built on
+ * libbitcoin.
+ *
+ * Copyright (C) 2017 Neill Miller (neillm@thecodefactory.org)
+ *
+ * Megabit is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Megabit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Megabit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __REQUEST_EXECUTOR_HPP
+#define __REQUEST_EXECUTOR_HPP
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+// request classes, most urgent first
+enum class RequestPriority : uint8_t {
+  interactive_send = 0,
+  receive_address,
+  subscription,
+  background
+};
+
+static constexpr size_t num_request_priorities = 4;
+
+struct RequestClassMetrics {
+  uint64_t requests;
+  // time spent queued, and from submission to completion, over the
+  // most recent requests of the class
+  uint64_t p50_wait_us;
+  uint64_t p99_wait_us;
+  uint64_t p50_us;
+  uint64_t p99_us;
+};
+
+struct RequestSchedulerMetrics {
+  std::array<RequestClassMetrics, num_request_priorities> classes;
+
+  friend std::ostream& operator<<(std::ostream& out,
+                                  const RequestSchedulerMetrics& metrics) {
+    static const char* names[num_request_priorities] = {
+        "send", "receive", "subscription", "background"};
+    out << "Scheduler[";
+    for (size_t i = 0; i < num_request_priorities; i++) {
+      const auto& metric = metrics.classes[i];
+      out << (i ? ", " : "") << names[i] << ": requests=" << metric.requests
+          << " wait p50=" << metric.p50_wait_us
+          << "us p99=" << metric.p99_wait_us << "us, p50=" << metric.p50_us
+          << "us p99=" << metric.p99_us << "us";
+    }
+    out << "]";
+    return out;
+  }
+};
+
+// runs blocking server requests on dedicated i/o threads and hands
+// back futures, so callers can issue several requests before waiting
+// on any of them.  Each i/o thread holds at most one connection at a
+// time, so there are as many threads as pooled connections.
+//
+// queued requests are started in priority order, so interactive work
+// overtakes a queued background scan (though never interrupts a
+// running request).  A request has the priority of the thread that
+// submits it, see PriorityScope.
+class RequestExecutor {
+ public:
+  // sets the priority of the requests submitted by the current thread
+  // for its lifetime.  Requests submitted from within a request
+  // inherit its priority.
+  class PriorityScope {
+   public:
+    explicit PriorityScope(RequestPriority priority);
+    ~PriorityScope();
+
+    PriorityScope(const PriorityScope&) = delete;
+    PriorityScope& operator=(const PriorityScope&) = delete;
+
+   private:
+    const RequestPriority previous_;
+  };
+
+  explicit RequestExecutor(size_t num_threads);
+  // outstanding requests are completed before the threads exit
+  ~RequestExecutor();
+
+  RequestExecutor(const RequestExecutor&) = delete;
+  RequestExecutor& operator=(const RequestExecutor&) = delete;
+
+  // requests submitted from an i/o thread (e.g. by a synchronous
+  // wrapper called within another request) run immediately, so that
+  // the threads can't all end up waiting on queued requests
+  template <typename T>
+  std::future<T> Submit(std::function<T()> request);
+
+  bool InIoThread() const;
+  static RequestPriority GetPriority();
+
+  RequestSchedulerMetrics GetMetrics();
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Task {
+    std::function<void()> run;
+    RequestPriority priority;
+    Clock::time_point queued;
+  };
+
+  struct ClassSamples {
+    uint64_t requests = 0;
+    std::vector<uint64_t> wait_us;
+    std::vector<uint64_t> latency_us;
+    size_t next = 0;
+  };
+
+  void Post(std::function<void()> task);
+  void Run();
+  void Record(RequestPriority priority, Clock::duration wait,
+              Clock::duration latency);
+
+  std::mutex lock_;
+  std::condition_variable available_;
+  std::array<std::deque<Task>, num_request_priorities> tasks_;
+  bool stopping_;
+  std::vector<std::thread> threads_;
+
+  std::mutex metrics_lock_;
+  std::array<ClassSamples, num_request_priorities> samples_;
+};
+
+template <typename T>
+std::future<T> RequestExecutor::Submit(std::function<T()> request) {
+  auto task = std::make_shared<std::packaged_task<T()>>(request);
+  auto future = task->get_future();
+  if (InIoThread()) {
+    const auto started = Clock::now();
+    (*task)();
+    Record(GetPriority(), Clock::duration::zero(), Clock::now() - started);
+  } else {
+    Post([task]() { (*task)(); });
+  }
+  return future;
+}
+
+#endif  // __REQUEST_EXECUTOR_HPP
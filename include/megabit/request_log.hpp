@@ -0,0 +1,104 @@
+/*
+ * This file is part of Megabit, a BIP44 HD wallet built on
+ * libbitcoin.
+ *
+ * Copyright (C) 2017 Neill Miller (neillm@thecodefactory.org)
+ *
+ * Megabit is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Megabit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Megabit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __REQUEST_LOG_HPP
+#define __REQUEST_LOG_HPP
+
+#include <bitcoin/bitcoin.hpp>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <vector>
+
+enum class RequestType : uint8_t {
+  address_history = 1,
+  transaction_info = 2,
+  validate_transaction = 3,
+  broadcast_transaction = 4,
+  block_height = 5,
+  block_transaction_hashes = 6,
+  transaction = 7,
+  block_hash = 8
+};
+
+enum class RequestLogMode { off, record, replay };
+
+// captures server requests and their responses, with timing, to a
+// compact binary log, and answers the same requests from the log
+// later without a network.  Requests and responses are opaque byte
+// strings encoded by the caller.
+//
+// the log starts with the magic "MBRL" and a version byte, followed
+// by a record per request:
+//
+//   [ type:1 ] [ start_us:var ] [ elapsed_us:var ]
+//   [ request_size:var ] [ request ] [ response_size:var ] [ response ]
+//
+// where start is the time since recording began.  When replaying,
+// identical requests are answered with their recorded responses in
+// order (repeating the last once they run out), after the recorded
+// elapsed time unless replaying flat out.
+class RequestLog {
+ public:
+  using Clock = std::chrono::steady_clock;
+  using Encoder = std::function<libbitcoin::data_chunk()>;
+
+  RequestLog();
+
+  bool Open(RequestLogMode mode, const std::string& file_name,
+            bool flat_out);
+  RequestLogMode GetMode() const;
+
+  // returns false unless replaying.  Requests missing from the log are
+  // answered with an empty response.
+  bool Replay(RequestType type, const libbitcoin::data_chunk& request,
+              libbitcoin::data_chunk& response);
+
+  // records the response (only encoded when recording) of a request
+  // that started at the specified time
+  void Record(RequestType type, const libbitcoin::data_chunk& request,
+              Clock::time_point started, const Encoder& encode_response);
+
+ private:
+  struct Response {
+    std::chrono::microseconds elapsed;
+    libbitcoin::data_chunk data;
+  };
+
+  struct Responses {
+    std::vector<Response> list;
+    size_t next = 0;
+  };
+
+  using Key = std::pair<uint8_t, libbitcoin::data_chunk>;
+
+  bool Load(std::ifstream& input);
+
+  std::mutex lock_;
+  RequestLogMode mode_;
+  bool flat_out_;
+  Clock::time_point opened_;
+  std::ofstream output_;
+  std::map<Key, Responses> responses_;
+};
+
+#endif  // __REQUEST_LOG_HPP
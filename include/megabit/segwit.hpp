@@ -0,0 +1,82 @@
+/*
+ * This file is part of Megabit, a BIP44 HD wallet built on
+ * libbitcoin.
+ *
+ * Copyright (C) 2017 Neill Miller (neillm@thecodefactory.org)
+ *
+ * Megabit is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Megabit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Megabit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SEGWIT_HPP
+#define __SEGWIT_HPP
+
+#include <bitcoin/bitcoin.hpp>
+
+namespace megabit {
+
+namespace segwit {
+
+// bip173: https://github.com/bitcoin/bips/blob/master/bip-0173.mediawiki
+std::string bech32_encode(const std::string& hrp,
+                          const libbitcoin::data_chunk& values);
+bool bech32_decode(std::string& hrp, libbitcoin::data_chunk& values,
+                   const std::string& encoded);
+
+// version 0 witness (p2wpkh) address of a public key hash
+std::string witness_address(const libbitcoin::short_hash& key_hash,
+                            const std::string& hrp);
+bool decode_witness_address(libbitcoin::short_hash& key_hash,
+                            const std::string& address,
+                            const std::string& hrp);
+
+libbitcoin::chain::script to_pay_witness_key_hash_script(
+    const libbitcoin::short_hash& key_hash);
+bool is_pay_witness_key_hash(const libbitcoin::chain::script& script,
+                             libbitcoin::short_hash& key_hash);
+
+// bip143: https://github.com/bitcoin/bips/blob/master/bip-0143.mediawiki
+//
+// computes hashPrevouts, hashSequence and hashOutputs of a
+// transaction once, so that signing every input is linear in the
+// transaction size rather than quadratic as with the legacy
+// signature hash.  Only sighash_algorithm::all is supported, and the
+// cache must be rebuilt if the inputs' outpoints or sequences, or the
+// outputs, of the transaction are modified.
+class SighashCache {
+ public:
+  explicit SighashCache(const libbitcoin::chain::transaction& tx);
+
+  libbitcoin::hash_digest signature_hash(
+      uint32_t input_index, const libbitcoin::short_hash& key_hash,
+      uint64_t value, uint8_t sighash_type) const;
+
+ private:
+  const libbitcoin::chain::transaction& tx_;
+  libbitcoin::hash_digest hash_prevouts_;
+  libbitcoin::hash_digest hash_sequence_;
+  libbitcoin::hash_digest hash_outputs_;
+};
+
+bool create_witness_endorsement(libbitcoin::endorsement& out,
+                                const libbitcoin::ec_secret& secret,
+                                const SighashCache& sighash_cache,
+                                uint32_t input_index,
+                                const libbitcoin::short_hash& key_hash,
+                                uint64_t value, uint8_t sighash_type);
+
+}  // namespace segwit
+
+}  // namespace megabit
+
+#endif  // __SEGWIT_HPP
@@ -0,0 +1,243 @@
+/*
+ * This file is part of Megabit, a BIP44 HD wallet built on
+ * libbitcoin.
+ *
+ * Copyright (C) 2017 Neill Miller (neillm@thecodefactory.org)
+ *
+ * Megabit is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Megabit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Megabit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SERVER_LIST_HPP
+#define __SERVER_LIST_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "../include/megabit/concurrency_limiter.hpp"
+#include "../include/megabit/connection_pool.hpp"
+#include "../include/megabit/request_executor.hpp"
+
+struct ServerInfo {
+  std::string address;
+  std::string public_key;
+};
+
+using ServerErrorHandler = std::function<void(const libbitcoin::code& error)>;
+
+// issues calls on the client and waits for them.  Errors must be
+// reported through the handler that's passed in, so that connection
+// failures can be told apart from request failures.
+using ServerRequest = std::function<void(LibbitcoinClient& client,
+                                         const ServerErrorHandler& on_error)>;
+
+struct ServerStats {
+  std::string address;
+  // moving average of the request latency, in microseconds
+  uint64_t latency_us;
+  uint64_t max_latency_us;
+  uint64_t requests;
+  uint64_t failures;
+  uint32_t consecutive_failures;
+  bool backing_off;
+  ConcurrencyMetrics concurrency;
+};
+
+struct FailoverMetrics {
+  // requests that succeeded on another server after a failure
+  uint64_t failovers;
+  // requests that failed on every server
+  uint64_t exhausted;
+  // time from the start of a request that failed over until it
+  // succeeded, in microseconds
+  uint64_t total_failover_us;
+  uint64_t max_failover_us;
+
+  friend std::ostream& operator<<(std::ostream& out,
+                                  const FailoverMetrics& metrics) {
+    out << "Failover[failovers=" << metrics.failovers
+        << ", exhausted=" << metrics.exhausted << ", avg time="
+        << (metrics.failovers
+                ? (metrics.total_failover_us / metrics.failovers)
+                : 0)
+        << "us, max time=" << metrics.max_failover_us << "us]";
+    return out;
+  }
+};
+
+struct LatencyMetrics {
+  uint64_t requests;
+  // reads duplicated to a second server, and those where the
+  // duplicate responded first
+  uint64_t hedged;
+  uint64_t hedge_wins;
+  // over the most recent requests, as seen by the caller
+  uint64_t p50_us;
+  uint64_t p99_us;
+
+  friend std::ostream& operator<<(std::ostream& out,
+                                  const LatencyMetrics& metrics) {
+    out << "Latency[requests=" << metrics.requests
+        << ", hedged=" << metrics.hedged
+        << ", hedge wins=" << metrics.hedge_wins
+        << ", p50=" << metrics.p50_us << "us, p99=" << metrics.p99_us
+        << "us]";
+    return out;
+  }
+};
+
+// the configured servers, each with its own connection pool, ranked
+// by latency.  Requests are sent to the best ranked server, and are
+// sent again to the next one when the connection to it fails.  A
+// failing server is skipped for an exponentially growing backoff, and
+// connected to again afterwards.
+//
+// the requests in flight to each server are limited by a
+// ConcurrencyLimiter, which backs off when the server reports that
+// it's oversubscribed or times out.
+class ServerList {
+ public:
+  explicit ServerList(
+      size_t max_connections = megabit::constants::max_pool_connections);
+
+  // servers that are no longer listed are only disabled, since their
+  // connections may still be leased
+  void SetServers(const std::vector<ServerInfo>& servers);
+
+  // measures the latency of every server, so that requests start out
+  // on the fastest.  Returns false if no server could be reached.
+  bool Probe();
+
+  // returns false if the request failed on every server, in which case
+  // on_error was called with the last connection failure.  Request
+  // failures (e.g. not_found) are passed to on_error without failing
+  // over.
+  bool Perform(const ServerRequest& request, const ServerErrorHandler& on_error);
+
+  // for idempotent reads.  When hedging is enabled and a read takes
+  // longer than the hedge_percentile latency of its server, a
+  // duplicate is sent to the next server and the first response wins.
+  // The attempts run on the list's own i/o threads with a copy of the
+  // request, which must only write to the result it's passed.
+  template <typename Result>
+  bool PerformRead(
+      const std::function<void(LibbitcoinClient& client,
+                               const ServerErrorHandler& on_error,
+                               Result& result)>& request,
+      Result& result, const ServerErrorHandler& on_error);
+
+  void SetHedging(bool hedging);
+
+  // the best ranked server (used for subscriptions, which aren't
+  // failed over)
+  ServerInfo GetPrimary();
+
+  std::vector<ServerStats> GetServerStats();
+  FailoverMetrics GetFailoverMetrics();
+  LatencyMetrics GetLatencyMetrics();
+  ConnectionPoolMetrics GetConnectionPoolMetrics();
+
+  static bool IsConnectionError(const libbitcoin::code& error);
+
+ private:
+  struct Server {
+    ServerInfo info;
+    std::unique_ptr<ConnectionPool> pool;
+    std::unique_ptr<ConcurrencyLimiter> limiter;
+    ServerStats stats;
+    bool enabled;
+    std::chrono::steady_clock::time_point backoff_until;
+    // recent request latencies, for the hedging delay
+    std::vector<uint64_t> latency_samples;
+    size_t next_sample;
+  };
+
+  // runs attempt(client, on_error, index) on the index'th ranked
+  // server, and returns the index of the first attempt that succeeded.
+  // prepare is called with the number of ranked servers (i.e. the
+  // bound on index) before any attempt runs.  An attempt that throws
+  // counts as failed.
+  using HedgedAttempt =
+      std::function<void(LibbitcoinClient& client,
+                         const ServerErrorHandler& on_error, size_t index)>;
+  bool PerformHedged(const std::function<void(size_t count)>& prepare,
+                     const HedgedAttempt& attempt, size_t& winner,
+                     const ServerErrorHandler& on_error);
+  std::chrono::microseconds GetHedgeDelay(Server* server);
+  void RecordLatency(uint64_t latency_us);
+
+  // enabled servers by latency, those backing off last
+  std::vector<Server*> GetRanked();
+  void OnSuccess(Server* server, uint64_t latency_us);
+  void OnFailure(Server* server);
+
+  const size_t max_connections_;
+  std::mutex lock_;
+  std::vector<std::unique_ptr<Server>> servers_;
+  FailoverMetrics failover_metrics_;
+
+  bool hedging_;
+  LatencyMetrics latency_metrics_;
+  std::vector<uint64_t> latency_samples_;
+  size_t next_latency_sample_;
+  // runs the hedged attempts.  Declared last, so that attempts that
+  // lost but are still running finish before the rest of the list is
+  // destroyed.
+  RequestExecutor attempt_executor_;
+};
+
+template <typename Result>
+bool ServerList::PerformRead(
+    const std::function<void(LibbitcoinClient& client,
+                             const ServerErrorHandler& on_error,
+                             Result& result)>& request,
+    Result& result, const ServerErrorHandler& on_error) {
+  bool hedging = false;
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    hedging = hedging_;
+  }
+  if (!hedging) {
+    return Perform(
+        [&request, &result](LibbitcoinClient& client,
+                            const ServerErrorHandler& on_request_error) {
+          request(client, on_request_error, result);
+        },
+        on_error);
+  }
+
+  // attempts that lose keep writing to their own result, so the
+  // results outlive this call
+  auto results = std::make_shared<std::vector<Result>>();
+  const auto prepare = [results](size_t count) { results->resize(count); };
+  const auto attempt = [request, results](LibbitcoinClient& client,
+                                          const ServerErrorHandler& on_error,
+                                          size_t index) {
+    request(client, on_error, results->at(index));
+  };
+
+  size_t winner = 0;
+  if (!PerformHedged(prepare, attempt, winner, on_error)) {
+    return false;
+  }
+  result = results->at(winner);
+  return true;
+}
+
+#endif  // __SERVER_LIST_HPP
@@ -0,0 +1,145 @@
+/*
+ * This file is part of Megabit, a BIP44 HD wallet built on
+ * libbitcoin.
+ *
+ * Copyright (C) 2017 Neill Miller (neillm@thecodefactory.org)
+ *
+ * Megabit is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Megabit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Megabit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SUBSCRIPTION_DISPATCHER_HPP
+#define __SUBSCRIPTION_DISPATCHER_HPP
+
+#include <QThread>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include "bitcoin_interface.hpp"
+#include "subscription_planner.hpp"
+
+// called on the dispatcher (or its retry) thread for each subscribed
+// wallet address touched by a transaction
+using AddressNotificationHandler = std::function<void(
+    const std::string& address, const libbitcoin::code& code,
+    uint16_t sequence, size_t height, const libbitcoin::hash_digest& tx_hash)>;
+
+// called for notifications that couldn't be routed to an address
+// (e.g. the transaction still wasn't indexed by the server after
+// every retry)
+using UnroutedNotificationHandler =
+    std::function<void(size_t height, const libbitcoin::hash_digest& tx_hash)>;
+
+// owns a single server connection on which every wallet address is
+// subscribed.  Addresses are subscribed by the key hash prefixes of
+// a SubscriptionPlanner, so large wallets need few subscriptions.
+// Notifications only carry a transaction hash, so the transaction is
+// fetched and routed to the handler of each wallet address it pays
+// or spends from, and prefix false positives are dropped.  The
+// thread and socket count don't depend on the number of addresses.
+//
+// transactions that can't be fetched yet are queued and looked up
+// again with a short exponential backoff on a retry thread, so that
+// notifications are routed as soon as the server has indexed them
+// rather than after the connection's (whole second) monitor pass.
+class SubscriptionDispatcher : public QObject {
+  Q_OBJECT
+
+ public:
+  explicit SubscriptionDispatcher(BitcoinInterface& bitcoin_interface)
+      : bitcoin_interface_(bitcoin_interface),
+        running_(true),
+        planner_(megabit::constants::max_address_subscriptions,
+                 megabit::constants::max_subscription_false_positive_rate),
+        replan_(false),
+        false_positives_(0),
+        retries_(0) {}
+
+  ~SubscriptionDispatcher() {}
+
+  // thread safe.  Subscribing an address that's already subscribed
+  // only replaces its handler.
+  void Subscribe(const std::string& address,
+                 AddressNotificationHandler handler);
+  void SetUnroutedHandler(UnroutedNotificationHandler handler);
+
+  // thread safe.  Run returns (and finished is emitted) within a
+  // monitor period (plus any lookup being retried).
+  void Stop();
+
+ public slots:
+  void Run();
+
+ signals:
+  void finished();
+  void SubscriptionError(QString error);
+
+ private:
+  struct Subscription {
+    std::string address;
+    libbitcoin::wallet::payment_address query_address;
+    AddressNotificationHandler handler;
+  };
+
+  // a notification whose transaction couldn't be fetched yet
+  struct PendingNotification {
+    uint16_t sequence;
+    size_t height;
+    libbitcoin::hash_digest tx_hash;
+    uint32_t retries;
+    std::chrono::steady_clock::time_point retry_at;
+  };
+
+  bool Connect();
+  void SubscribePending();
+  void ResubscribeAll();
+  void OnNotification(const libbitcoin::code& code, uint16_t sequence,
+                      size_t height, const libbitcoin::hash_digest& tx_hash);
+  // returns false if the transaction couldn't be fetched
+  bool Route(uint16_t sequence, size_t height,
+             const libbitcoin::hash_digest& tx_hash);
+  // runs on the retry thread until stopped
+  void RetryPending();
+  void Unrouted(size_t height, const libbitcoin::hash_digest& tx_hash);
+
+  BitcoinInterface& bitcoin_interface_;
+  std::atomic<bool> running_;
+  ConnectionPool::Lease client_;
+  std::chrono::steady_clock::time_point last_renewal_;
+
+  std::mutex subscriptions_lock_;
+  // keyed by the hash the server indexes the address by
+  std::map<libbitcoin::short_hash, Subscription> subscriptions_;
+  UnroutedNotificationHandler unrouted_handler_;
+
+  // the prefixes are planned again when addresses are added, and
+  // those not yet subscribed on the connection are subscribed
+  const SubscriptionPlanner planner_;
+  bool replan_;
+  std::vector<libbitcoin::binary> subscribed_prefixes_;
+  std::atomic<uint64_t> false_positives_;
+
+  // queued by the dispatcher thread, retried by the retry thread
+  std::mutex pending_lock_;
+  std::condition_variable pending_changed_;
+  std::vector<PendingNotification> pending_;
+  std::thread retry_thread_;
+  // only used on the retry thread
+  uint64_t retries_;
+};
+
+#endif  // __SUBSCRIPTION_DISPATCHER_HPP
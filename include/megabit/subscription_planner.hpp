@@ -0,0 +1,63 @@
+/*
+ * This file is part of Megabit, a BIP44 HD wallet built on
+ * libbitcoin.
+ *
+ * Copyright (C) 2017 Neill Miller (neillm@thecodefactory.org)
+ *
+ * Megabit is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Megabit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Megabit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SUBSCRIPTION_PLANNER_HPP
+#define __SUBSCRIPTION_PLANNER_HPP
+
+#include <bitcoin/bitcoin.hpp>
+#include <vector>
+
+struct SubscriptionPlan {
+  // every prefix has the same length, in bits (a full key hash is
+  // short_hash_size * byte_bits and matches exactly)
+  size_t prefix_bits;
+  std::vector<libbitcoin::binary> prefixes;
+  // chance that an unrelated output key hash matches one of the
+  // prefixes
+  double false_positive_rate;
+};
+
+// groups wallet key hashes under a few bit prefixes, so that a wallet
+// with thousands of addresses needs only a few server subscriptions.
+// Notifications matching a prefix but no wallet key hash are false
+// positives, which must be discarded by the subscriber.
+class SubscriptionPlanner {
+ public:
+  explicit SubscriptionPlanner(size_t max_subscriptions,
+                               double max_false_positive_rate)
+      : max_subscriptions_(max_subscriptions),
+        max_false_positive_rate_(max_false_positive_rate) {}
+
+  // the plan with the fewest prefixes whose false positive rate is at
+  // most max_false_positive_rate.  If that needs more than
+  // max_subscriptions prefixes, the longest prefixes within
+  // max_subscriptions are used instead, at a higher false positive
+  // rate.
+  SubscriptionPlan Plan(std::vector<libbitcoin::short_hash> key_hashes) const;
+
+  static bool Matches(const libbitcoin::binary& prefix,
+                      const libbitcoin::short_hash& key_hash);
+
+ private:
+  const size_t max_subscriptions_;
+  const double max_false_positive_rate_;
+};
+
+#endif  // __SUBSCRIPTION_PLANNER_HPP
@@ -0,0 +1,62 @@
+/*
+ * This file is part of Megabit, a BIP44 HD wallet built on
+ * libbitcoin.
+ *
+ * Copyright (C) 2017 Neill Miller (neillm@thecodefactory.org)
+ *
+ * Megabit is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Megabit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Megabit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TRANSACTION_PROMOTER_HPP
+#define __TRANSACTION_PROMOTER_HPP
+
+#include <QMetaType>
+#include <QObject>
+#include <vector>
+
+#include "bitcoin_interface.hpp"
+#include "mempool_tracker.hpp"
+
+using ConfirmedTransactionList = std::vector<ConfirmedTransaction>;
+Q_DECLARE_METATYPE(ConfirmedTransactionList)
+
+// checks the tracked unconfirmed transactions for confirmations on
+// its own thread, since the lookups block on the server.  The
+// confirmed transactions are delivered with the generation they were
+// requested with, so that results overtaken by a refresh of the
+// whole wallet can be dropped.  Confirmed segwit payments are also
+// used to check that the server indexes p2wpkh outputs (see
+// BitcoinInterface::VerifyWitnessIndexing).
+class TransactionPromoter : public QObject {
+  Q_OBJECT
+
+ public:
+  explicit TransactionPromoter(BitcoinInterface& bitcoin_interface)
+      : bitcoin_interface_(bitcoin_interface) {}
+
+  ~TransactionPromoter() {}
+
+ public slots:
+  void Promote(quint32 generation);
+
+ signals:
+  void TransactionsPromoted(quint32 generation,
+                            ConfirmedTransactionList confirmed);
+  void WitnessHistoryMissing();
+
+ private:
+  BitcoinInterface& bitcoin_interface_;
+};
+
+#endif  // __TRANSACTION_PROMOTER_HPP
@@ -88,6 +88,9 @@ bool get_user_wallet_seed(libbitcoin::long_hash& seed,
 std::string to_string(const libbitcoin::chain::output& output);
 std::string to_string(const libbitcoin::chain::transaction& tx);
 
+// the value below which the fraction p of the samples lie
+uint64_t percentile(std::vector<uint64_t> samples, double p);
+
 template <class T>
 libbitcoin::data_chunk get_checksum(T& data) {
   libbitcoin::data_chunk checksum(megabit::constants::checksum_length);
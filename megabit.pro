@@ -21,28 +21,52 @@ INCLUDEPATH = include/megabit/
 QMAKE_CXXFLAGS += -fpermissive -Wno-ignored-qualifiers -Wno-deprecated-declarations -static
 
 SOURCES += src/utils.cpp \
+           src/segwit.cpp \
+           src/connection_pool.cpp \
+           src/concurrency_limiter.cpp \
+           src/server_list.cpp \
+           src/request_executor.cpp \
+           src/request_log.cpp \
+           src/block_scanner.cpp \
+           src/mempool_tracker.cpp \
            src/bitcoin_interface.cpp \
            src/createwalletintroduction.cpp \
            src/createwalletgenerate.cpp \
            src/createwalletconfirm.cpp \
            src/createwalletwizard.cpp \
-           src/block_height_thread.cpp \
-           src/address_monitor_thread.cpp \
-           src/send_payment_thread.cpp \
+           src/chain_tip_listener.cpp \
+           src/subscription_planner.cpp \
+           src/subscription_dispatcher.cpp \
+           src/confirmation_tracker.cpp \
+           src/payment_queue.cpp \
+           src/consolidation_thread.cpp \
+           src/transaction_promoter.cpp \
            src/settings.cpp \
            src/megabit.cpp \
            src/main.cpp
 
 HEADERS += include/megabit/constants.hpp \
            include/megabit/utils.hpp \
+           include/megabit/segwit.hpp \
+           include/megabit/connection_pool.hpp \
+           include/megabit/concurrency_limiter.hpp \
+           include/megabit/server_list.hpp \
+           include/megabit/request_executor.hpp \
+           include/megabit/request_log.hpp \
+           include/megabit/block_scanner.hpp \
+           include/megabit/mempool_tracker.hpp \
            include/megabit/bitcoin_interface.hpp \
            include/megabit/createwalletintroduction.hpp \
            include/megabit/createwalletgenerate.hpp \
            include/megabit/createwalletconfirm.hpp \
            include/megabit/createwalletwizard.hpp \
-           include/megabit/block_height_thread.hpp \
-           include/megabit/address_monitor_thread.hpp \
-           include/megabit/send_payment_thread.hpp \
+           include/megabit/chain_tip_listener.hpp \
+           include/megabit/subscription_planner.hpp \
+           include/megabit/subscription_dispatcher.hpp \
+           include/megabit/confirmation_tracker.hpp \
+           include/megabit/payment_queue.hpp \
+           include/megabit/consolidation_thread.hpp \
+           include/megabit/transaction_promoter.hpp \
            include/megabit/settings.hpp \
            include/megabit/constants.hpp \
            include/megabit/megabit.hpp
@@ -20,7 +20,216 @@
 
 #include "include/megabit/bitcoin_interface.hpp"
 
+#include <algorithm>
+#include <boost/algorithm/string.hpp>
+#include <chrono>
+#include <fstream>
+
 #include "include/megabit/constants.hpp"
+#include "include/megabit/segwit.hpp"
+
+namespace {
+
+// encodings of the server responses in the request log, each
+// starting with whether the request succeeded
+
+libbitcoin::data_chunk EncodeStatus(bool success) {
+  return {static_cast<uint8_t>(success ? 1 : 0)};
+}
+
+bool DecodeStatus(const libbitcoin::data_chunk& response) {
+  return !response.empty() && response[0];
+}
+
+libbitcoin::data_chunk EncodeHistory(
+    bool success, const libbitcoin::chain::history::list& rows) {
+  libbitcoin::data_chunk response;
+  libbitcoin::data_sink ostream(response);
+  libbitcoin::ostream_writer sink(ostream);
+  sink.write_byte(success ? 1 : 0);
+  sink.write_variable_little_endian(rows.size());
+  for (const auto& row : rows) {
+    row.output.to_data(sink);
+    sink.write_variable_little_endian(row.output_height);
+    row.spend.to_data(sink);
+    sink.write_variable_little_endian(row.spend_height);
+    sink.write_variable_little_endian(row.value);
+  }
+  ostream.flush();
+  return response;
+}
+
+bool DecodeHistory(const libbitcoin::data_chunk& response,
+                   libbitcoin::chain::history::list& rows) {
+  libbitcoin::data_source istream(response);
+  libbitcoin::istream_reader source(istream);
+  const auto success = source.read_byte();
+  const auto count = source.read_variable_little_endian();
+  for (uint64_t i = 0; source && (i < count); i++) {
+    libbitcoin::chain::history row;
+    row.output.from_data(source);
+    row.output_height =
+        static_cast<size_t>(source.read_variable_little_endian());
+    row.spend.from_data(source);
+    row.spend_height =
+        static_cast<size_t>(source.read_variable_little_endian());
+    row.value = source.read_variable_little_endian();
+    rows.push_back(row);
+  }
+  return source && success;
+}
+
+libbitcoin::data_chunk EncodeTxBlockInfo(bool success,
+                                         const TxBlockInfo& tx_block_info) {
+  libbitcoin::data_chunk response;
+  libbitcoin::data_sink ostream(response);
+  libbitcoin::ostream_writer sink(ostream);
+  sink.write_byte(success ? 1 : 0);
+  if (success) {
+    sink.write_variable_little_endian(tx_block_info.height);
+    sink.write_variable_little_endian(tx_block_info.index);
+    tx_block_info.header.to_data(sink);
+    tx_block_info.tx.to_data(sink, true, true);
+  }
+  ostream.flush();
+  return response;
+}
+
+bool DecodeTxBlockInfo(const libbitcoin::data_chunk& response,
+                       TxBlockInfo& tx_block_info) {
+  libbitcoin::data_source istream(response);
+  libbitcoin::istream_reader source(istream);
+  if (!source.read_byte() || !source) {
+    return false;
+  }
+  tx_block_info.height =
+      static_cast<size_t>(source.read_variable_little_endian());
+  tx_block_info.index =
+      static_cast<size_t>(source.read_variable_little_endian());
+  return tx_block_info.header.from_data(source) &&
+         tx_block_info.tx.from_data(source, true, true);
+}
+
+libbitcoin::data_chunk EncodeBlockHeight(const BlockHeightResult& result) {
+  libbitcoin::data_chunk response;
+  libbitcoin::data_sink ostream(response);
+  libbitcoin::ostream_writer sink(ostream);
+  sink.write_byte(result.error ? 0 : 1);
+  sink.write_4_bytes_little_endian(
+      static_cast<uint32_t>(result.error.value()));
+  sink.write_variable_little_endian(result.height);
+  ostream.flush();
+  return response;
+}
+
+BlockHeightResult DecodeBlockHeight(const libbitcoin::data_chunk& response) {
+  libbitcoin::data_source istream(response);
+  libbitcoin::istream_reader source(istream);
+  source.read_byte();
+  const auto error = source.read_4_bytes_little_endian();
+  const auto height = source.read_variable_little_endian();
+  if (!source) {
+    return {libbitcoin::error::not_found, 0};
+  }
+  return {static_cast<libbitcoin::error::error_code_t>(error),
+          static_cast<size_t>(height)};
+}
+
+libbitcoin::data_chunk EncodeHeightRequest(size_t height) {
+  return libbitcoin::to_chunk(
+      libbitcoin::to_little_endian(static_cast<uint32_t>(height)));
+}
+
+libbitcoin::data_chunk EncodeHashList(bool success,
+                                      const libbitcoin::hash_list& hashes) {
+  libbitcoin::data_chunk response;
+  libbitcoin::data_sink ostream(response);
+  libbitcoin::ostream_writer sink(ostream);
+  sink.write_byte(success ? 1 : 0);
+  sink.write_variable_little_endian(hashes.size());
+  for (const auto& hash : hashes) {
+    sink.write_hash(hash);
+  }
+  ostream.flush();
+  return response;
+}
+
+bool DecodeHashList(const libbitcoin::data_chunk& response,
+                    libbitcoin::hash_list& hashes) {
+  libbitcoin::data_source istream(response);
+  libbitcoin::istream_reader source(istream);
+  const auto success = source.read_byte();
+  const auto count = source.read_variable_little_endian();
+  for (uint64_t i = 0; source && (i < count); i++) {
+    hashes.push_back(source.read_hash());
+  }
+  return source && success;
+}
+
+libbitcoin::data_chunk EncodeBlockHash(bool success,
+                                       const libbitcoin::hash_digest& hash) {
+  libbitcoin::data_chunk response{static_cast<uint8_t>(success ? 1 : 0)};
+  if (success) {
+    libbitcoin::extend_data(response, hash);
+  }
+  return response;
+}
+
+bool DecodeBlockHash(const libbitcoin::data_chunk& response,
+                     libbitcoin::hash_digest& hash) {
+  libbitcoin::data_source istream(response);
+  libbitcoin::istream_reader source(istream);
+  if (!source.read_byte() || !source) {
+    return false;
+  }
+  hash = source.read_hash();
+  return bool(source);
+}
+
+libbitcoin::data_chunk EncodeTransaction(
+    bool success, const libbitcoin::chain::transaction& tx) {
+  libbitcoin::data_chunk response;
+  libbitcoin::data_sink ostream(response);
+  libbitcoin::ostream_writer sink(ostream);
+  sink.write_byte(success ? 1 : 0);
+  if (success) {
+    tx.to_data(sink, true, true);
+  }
+  ostream.flush();
+  return response;
+}
+
+bool DecodeTransaction(const libbitcoin::data_chunk& response,
+                       libbitcoin::chain::transaction& tx) {
+  libbitcoin::data_source istream(response);
+  libbitcoin::istream_reader source(istream);
+  if (!source.read_byte() || !source) {
+    return false;
+  }
+  return tx.from_data(source, true, true);
+}
+
+// p2wpkh inputs carry the public key as the last witness item and
+// p2pkh inputs as the last push of the input script
+bool GetInputKeyHash(const libbitcoin::chain::input& input,
+                     libbitcoin::short_hash& key_hash) {
+  libbitcoin::data_chunk pub_key_data;
+  const auto& witness_stack = input.witness().stack();
+  if (witness_stack.size() == 2) {
+    pub_key_data = witness_stack.back();
+  } else if (!input.script().operations().empty()) {
+    pub_key_data = input.script().operations().back().data();
+  }
+
+  if ((pub_key_data.size() != libbitcoin::ec_compressed_size) &&
+      (pub_key_data.size() != libbitcoin::ec_uncompressed_size)) {
+    return false;
+  }
+  key_hash = libbitcoin::bitcoin_short_hash(pub_key_data);
+  return true;
+}
+
+}  // namespace
 
 BitcoinInterface::BitcoinInterface() {
   initialized_ = false;
@@ -29,7 +238,17 @@ BitcoinInterface::BitcoinInterface() {
   gap_limit_ = megabit::constants::bip44_gap_limit;
   prefixes_ = libbitcoin::wallet::hd_private::mainnet;
   payment_address_version_ = libbitcoin::wallet::payment_address::mainnet_p2kh;
+  bech32_prefix_ = megabit::constants::bech32_mainnet_prefix;
   bip44_coin_type_ = megabit::constants::bip44_coin_type_mainnet;
+  unconfirmed_spend_policy_ = {true,
+                               megabit::constants::max_unconfirmed_chain_depth};
+  history_cache_rows_ = 0;
+  history_cache_uses_ = 0;
+  history_cache_height_ = 0;
+  server_validation_ = false;
+  witness_indexing_verified_ = false;
+  scan_transactions_per_block_ =
+      megabit::constants::block_scan_transactions_per_block;
 }
 
 void BitcoinInterface::SetNetwork(const std::string& network) {
@@ -41,11 +260,13 @@ void BitcoinInterface::SetNetwork(const std::string& network) {
     prefixes_ = libbitcoin::wallet::hd_private::mainnet;
     payment_address_version_ =
         libbitcoin::wallet::payment_address::mainnet_p2kh;
+    bech32_prefix_ = megabit::constants::bech32_mainnet_prefix;
     bip44_coin_type_ = megabit::constants::bip44_coin_type_mainnet;
   } else {
     prefixes_ = libbitcoin::wallet::hd_private::testnet;
     payment_address_version_ =
         libbitcoin::wallet::payment_address::testnet_p2kh;
+    bech32_prefix_ = megabit::constants::bech32_testnet_prefix;
     bip44_coin_type_ = megabit::constants::bip44_coin_type_testnet;
   }
 }
@@ -54,28 +275,83 @@ void BitcoinInterface::SetNumAccounts(const size_t num_accounts) {
   num_accounts_ = num_accounts;
 }
 
-void BitcoinInterface::SetServerInfo(
-    const std::string& libbitcoin_server_address,
-    const std::string& libbitcoin_server_public_key) {
-  libbitcoin_server_address_ = libbitcoin_server_address;
-  libbitcoin_server_public_key_ = libbitcoin_server_public_key;
+void BitcoinInterface::SetUnconfirmedSpendPolicy(
+    const UnconfirmedSpendPolicy& policy) {
+  std::lock_guard<std::mutex> lock(broadcast_lock_);
+  unconfirmed_spend_policy_ = policy;
+}
+
+void BitcoinInterface::SetAccountTypes(
+    const std::vector<AccountType>& account_types) {
+  account_types_ = account_types;
+}
+
+AccountType BitcoinInterface::GetAccountType(uint32_t account_index) const {
+  return ((account_index < account_types_.size())
+              ? account_types_[account_index]
+              : AccountType::bip44);
+}
+
+void BitcoinInterface::AddAccount(AccountType account_type) {
+  account_types_.resize(num_accounts_, AccountType::bip44);
+  account_types_.push_back(account_type);
+  CacheAccountAddresses(num_accounts_++);
+}
+
+void BitcoinInterface::SetServers(const std::vector<ServerInfo>& servers) {
+  MEGABIT_ASSERT(!servers.empty());
+  servers_.SetServers(servers);
+  subscription_pool_.SetServerInfo(servers.front().address,
+                                   servers.front().public_key);
+}
+
+ConnectionPool& BitcoinInterface::GetSubscriptionPool() {
+  return subscription_pool_;
+}
+
+ConnectionPoolMetrics BitcoinInterface::GetConnectionPoolMetrics() {
+  return servers_.GetConnectionPoolMetrics();
+}
+
+FailoverMetrics BitcoinInterface::GetFailoverMetrics() {
+  return servers_.GetFailoverMetrics();
+}
+
+LatencyMetrics BitcoinInterface::GetLatencyMetrics() {
+  return servers_.GetLatencyMetrics();
+}
+
+RequestSchedulerMetrics BitcoinInterface::GetSchedulerMetrics() {
+  return request_executor_.GetMetrics();
+}
+
+std::vector<ServerStats> BitcoinInterface::GetServerStats() {
+  return servers_.GetServerStats();
+}
+
+void BitcoinInterface::SetHedging(bool hedging) {
+  servers_.SetHedging(hedging);
+}
+
+void BitcoinInterface::SetServerValidation(bool server_validation) {
+  server_validation_ = server_validation;
+}
+
+bool BitcoinInterface::SetRequestLog(RequestLogMode mode,
+                                     const std::string& file_name,
+                                     bool flat_out) {
+  return request_log_.Open(mode, file_name, flat_out);
 }
 
 bool BitcoinInterface::InitializeFromSeed(const Seed& seed) {
-  std::cout << "Connecting to " << libbitcoin_server_address_
-            << " using public key " << libbitcoin_server_public_key_
-            << std::endl;
-  bool ret = false;
-  if (libbitcoin_server_public_key_.empty()) {
-    ret = client_.connect(libbitcoin_server_address_) &&
-          block_height_client_.connect(libbitcoin_server_address_);
-  } else {
-    ret = client_.connect(
-              libbitcoin_server_address_, {},
-              libbitcoin::config::sodium(libbitcoin_server_public_key_), {}) &&
-          block_height_client_.connect(
-              libbitcoin_server_address_, {},
-              libbitcoin::config::sodium(libbitcoin_server_public_key_), {});
+  // the first connection to every server is established (and kept in
+  // its pool) up front to verify the server settings and rank them
+  // replayed sessions never reach a server
+  const bool ret =
+      (request_log_.GetMode() == RequestLogMode::replay) || servers_.Probe();
+  if (ret) {
+    const auto primary = servers_.GetPrimary();
+    subscription_pool_.SetServerInfo(primary.address, primary.public_key);
   }
 
   if (ret) {
@@ -88,66 +364,158 @@ bool BitcoinInterface::InitializeFromSeed(const Seed& seed) {
     std::memset(seed_chunk.data(), 0, seed_chunk.size());
     megabit::utils::mem_unlock_region(seed_chunk);
 
-    // Cache bip44 derived addresses for each account
-    size_t cur_gap_limit = 0;
+    // m/44'/coin_type' and m/84'/coin_type'
+    bip44_coin_type_key_ =
+        bip32_root_private_key_
+            .derive_private(megabit::constants::bip44_purpose)
+            .derive_private(bip44_coin_type_);
+    bip84_coin_type_key_ =
+        bip32_root_private_key_
+            .derive_private(megabit::constants::bip84_purpose)
+            .derive_private(bip44_coin_type_);
+
+    // Cache derived addresses for each account
     for (size_t account = 0; account < num_accounts_; account++) {
-      /* std::cout << "bip44 m/" */
-      /*           << "44'" */
-      /*           << "/" */
-      /*           << "0'" */
-      /*           << "/" << std::endl; */
-      for (size_t internal = 0; internal < 2; internal++) {
-        const auto chain = (internal ? "change" : "external");
-        /*     std::cout << " " << chain << " addresses m/44'/0'/" << account <<
-         */
-        /* "'/" */
-        /*               << internal << "/" << std::endl; */
-
-        cur_gap_limit = gap_limit_;
-        for (size_t index = 0; index < cur_gap_limit; index++) {
-          // cache all addresses associated with our wallet accounts
-          const auto& key = GetKey(account, internal, index);
-          libbitcoin::ec_compressed point{};
-          libbitcoin::secret_to_public(point, key);
-          libbitcoin::wallet::payment_address address(point,
-                                                      payment_address_version_);
-          if (internal) {
-            internal_address_cache_.insert(address.encoded());
-          } else {
-            external_address_cache_.insert(address.encoded());
-          }
+      CacheAccountAddresses(account);
+    }
+
+    initialized_ = ret;
+  }
+  return ret;
+}
 
-          /*       std::cout << "   m/44'/0'/" << account << "'/" << internal <<
-           * "/" */
-          /*                 << std::setfill('0') << std::setw(4) << index */
-          /*                 << std::setfill(' ') << std::setw(35) << */
-          /* address.encoded() */
-          /*                 << ", (key=" */
-          /*                 << libbitcoin::wallet::ec_private(secret).encoded()
-           * << */
-          /* ")" */
-          /*                 << std::endl; */
+void BitcoinInterface::CacheAccountAddresses(uint32_t account) {
+  const auto is_witness = (GetAccountType(account) == AccountType::bip84);
+  for (size_t internal = 0; internal < 2; internal++) {
+    for (size_t index = 0; index < gap_limit_; index++) {
+      // cache all addresses associated with our wallet accounts
+      const auto key = GetKey(account, internal, index);
+      const auto key_hash = GetKeyHash(key);
+      {
+        std::lock_guard<std::mutex> lock(key_hash_lock_);
+        if (is_witness) {
+          witness_key_hashes_.insert(key_hash);
         }
+        key_hash_accounts_[key_hash] = account;
+      }
+
+      const auto address = GetEncodedAddress(account, key);
+      if (internal) {
+        internal_address_cache_.insert(address);
+      } else {
+        external_address_cache_.insert(address);
       }
     }
+  }
+}
 
-    initialized_ = ret;
+bool BitcoinInterface::GetPaymentDestination(
+    const std::string& address, PaymentDestination& destination) const {
+  if (megabit::segwit::decode_witness_address(destination.key_hash, address,
+                                              bech32_prefix_)) {
+    destination.witness = true;
+    return true;
   }
-  return ret;
+
+  // only pay to key hash outputs are constructed for base58
+  // addresses, so other versions (e.g. p2sh) are rejected
+  const libbitcoin::wallet::payment_address payment_address(address);
+  if (!payment_address ||
+      (payment_address.version() != payment_address_version_)) {
+    return false;
+  }
+  destination.key_hash = payment_address.hash();
+  destination.witness = false;
+  return true;
 }
 
-libbitcoin::wallet::payment_address BitcoinInterface::GetPaymentAddress(
-    const std::string address) {
-  return libbitcoin::wallet::payment_address(
-      address /* , payment_address_version_ */);
+std::string BitcoinInterface::GetDestinationString(
+    const PaymentDestination& destination) const {
+  if (destination.witness) {
+    return megabit::segwit::witness_address(destination.key_hash,
+                                            bech32_prefix_);
+  }
+  return libbitcoin::wallet::payment_address(destination.key_hash,
+                                             payment_address_version_)
+      .encoded();
+}
+
+libbitcoin::short_hash BitcoinInterface::GetKeyHash(
+    const libbitcoin::wallet::hd_private& key) const {
+  return libbitcoin::bitcoin_short_hash(
+      megabit::utils::public_from_private(key.secret()));
+}
+
+std::string BitcoinInterface::GetEncodedAddress(
+    uint32_t account, const libbitcoin::wallet::hd_private& key) const {
+  if (GetAccountType(account) == AccountType::bip84) {
+    return megabit::segwit::witness_address(GetKeyHash(key), bech32_prefix_);
+  }
+
+  return libbitcoin::wallet::payment_address(libbitcoin::wallet::ec_public(key),
+                                             payment_address_version_)
+      .encoded();
+}
+
+libbitcoin::wallet::payment_address BitcoinInterface::GetQueryAddress(
+    const std::string& address) const {
+  // the server indexes outputs by key hash, so the history of a
+  // witness address is requested using the p2pkh address of the
+  // same key hash
+  libbitcoin::short_hash key_hash;
+  if (megabit::segwit::decode_witness_address(key_hash, address,
+                                              bech32_prefix_)) {
+    return libbitcoin::wallet::payment_address(key_hash,
+                                               payment_address_version_);
+  }
+  return libbitcoin::wallet::payment_address(address);
+}
+
+libbitcoin::chain::script BitcoinInterface::GetOutputScript(
+    const libbitcoin::wallet::payment_address& address) const {
+  // our own bip84 addresses (i.e. change) are paid to p2wpkh outputs
+  return GetOutputScript(
+      PaymentDestination{address.hash(), IsWitnessKeyHash(address.hash())});
+}
+
+libbitcoin::chain::script BitcoinInterface::GetOutputScript(
+    const PaymentDestination& destination) const {
+  if (destination.witness) {
+    return megabit::segwit::to_pay_witness_key_hash_script(
+        destination.key_hash);
+  }
+
+  return libbitcoin::chain::script{
+      libbitcoin::chain::script::to_pay_key_hash_pattern(
+          destination.key_hash)};
+}
+
+bool BitcoinInterface::IsWitnessKeyHash(
+    const libbitcoin::short_hash& key_hash) const {
+  std::lock_guard<std::mutex> lock(key_hash_lock_);
+  return (witness_key_hashes_.count(key_hash) != 0);
+}
+
+std::vector<std::string> BitcoinInterface::GetOutputAddresses(
+    const libbitcoin::chain::output& output) const {
+  libbitcoin::short_hash key_hash;
+  if (megabit::segwit::is_pay_witness_key_hash(output.script(), key_hash)) {
+    return {megabit::segwit::witness_address(key_hash, bech32_prefix_)};
+  }
+
+  std::vector<std::string> addresses;
+  for (const auto& address : libbitcoin::wallet::payment_address::extract(
+           output.script(), payment_address_version_)) {
+    addresses.push_back(address.encoded());
+  }
+  return addresses;
 }
 
 const libbitcoin::wallet::hd_private BitcoinInterface::GetKey(
     uint32_t account, uint32_t internal, uint32_t index) const {
-  static const auto purpose_key =
-      bip32_root_private_key_.derive_private(megabit::constants::bip44_purpose);
-  static const auto coin_type_key =
-      purpose_key.derive_private(bip44_coin_type_);
+  const auto& coin_type_key =
+      ((GetAccountType(account) == AccountType::bip84) ? bip84_coin_type_key_
+                                                       : bip44_coin_type_key_);
 
   const auto account_key =
       coin_type_key.derive_private(megabit::constants::bip44_account + account);
@@ -173,12 +541,17 @@ const libbitcoin::data_chunk BitcoinInterface::GetAddressAsPngData(
 const std::string BitcoinInterface::GetNextAddressForAccount(
     uint32_t account_index, uint32_t internal) {
   MEGABIT_ASSERT(internal < 2);
+  RequestExecutor::PriorityScope priority(RequestPriority::receive_address);
 
   size_t cur_gap_limit = gap_limit_;
   for (size_t index = 0; index < cur_gap_limit; index++) {
     const auto& key = GetKey(account_index, internal, index);
-    libbitcoin::wallet::payment_address address(
-        libbitcoin::wallet::ec_public(key), payment_address_version_);
+    const auto address = GetEncodedAddress(account_index, key);
+    // addresses past the gap limit aren't cached with the account
+    {
+      std::lock_guard<std::mutex> lock(key_hash_lock_);
+      key_hash_accounts_[GetKeyHash(key)] = account_index;
+    }
 
     AddressHistory history{};
     if (!GetAddressHistory(key.secret(), history)) {
@@ -191,14 +564,22 @@ const std::string BitcoinInterface::GetNextAddressForAccount(
       ++cur_gap_limit;
     } else {
       // insert next receive address into external cache
-      external_address_cache_.insert(address.encoded());
+      external_address_cache_.insert(address);
 
-      return address.encoded();
+      return address;
     }
   }
   return {};
 }
 
+std::vector<std::string> BitcoinInterface::GetWalletAddresses() const {
+  std::vector<std::string> addresses(external_address_cache_.begin(),
+                                     external_address_cache_.end());
+  addresses.insert(addresses.end(), internal_address_cache_.begin(),
+                   internal_address_cache_.end());
+  return addresses;
+}
+
 /* const uint64_t BitcoinInterface::GetAccountBalance( */
 /*     uint32_t account_index, TxUpdaterFunction update_fn) { */
 /*   uint64_t total_balance = 0; */
@@ -266,7 +647,7 @@ const std::string BitcoinInterface::GetNextAddressForAccount(
  * libbitcoin::wallet::payment_address::extract(output.script(),
  * payment_address_version_); */
 /*               for(auto& cur_address : addresses) { */
-/*                   if (internal_address_cache_.find(cur_address.encoded()) !=
+/*                   if (internal_address_cache_.find(cur_address) !=
  * internal_address_cache_.end()) { */
 /*                       change_amount += output.value(); */
 /*                       std::cout << "  SPEND ADDRESS " <<
@@ -333,6 +714,7 @@ const uint64_t BitcoinInterface::GetAccountBalance(
     bool& error, uint32_t account_index, TxUpdaterFunction update_fn) {
   uint64_t total_balance = 0;
   size_t cur_gap_limit = gap_limit_;
+  SyncHistoryCache();
 
   // internal == 0 indicates a receive address
   // internal == 1 indicates a change address
@@ -342,14 +724,27 @@ const uint64_t BitcoinInterface::GetAccountBalance(
       break;
     }
 
+    // the receive and change address histories are requested
+    // together, rather than one after the other
+    std::future<AddressHistoryResult> history_requests[2];
     for (size_t internal = 0; internal < 2; internal++) {
       const auto& key = GetKey(account_index, internal, index);
+      history_requests[internal] = GetAddressHistoryAsync(
+          libbitcoin::wallet::payment_address(
+              libbitcoin::wallet::ec_public(key.secret()),
+              payment_address_version_)
+              .encoded());
+    }
 
-      AddressHistory history{};
-      if (!GetAddressHistory(key.secret(), history)) {
+    for (size_t internal = 0; internal < 2; internal++) {
+      const auto& key = GetKey(account_index, internal, index);
+
+      auto history_result = history_requests[internal].get();
+      if (!history_result.success) {
         error = true;
         break;
       }
+      const auto& history = history_result.history;
 
       // if the address was already used, or has a balance, process
       // past it by extending the cur_gap_limit
@@ -375,14 +770,42 @@ const uint64_t BitcoinInterface::GetAccountBalance(
 
       TxBlockInfo tx_block_info{};
       TxBlockInfo output_tx_block_info{};
-      for (const auto& transfer : history.transfers) {
+      const auto& transfers = history.transfers;
+      const auto page_size = megabit::constants::history_page_size;
+      std::vector<std::future<TxBlockInfoResult>> spend_requests;
+      std::vector<std::future<TxBlockInfoResult>> output_requests;
+      for (size_t i = 0; i < transfers.size(); i++) {
+        // the transactions of a page of transfers are requested
+        // together, and only a page of them is held at a time however
+        // long the history is
+        if (i % page_size == 0) {
+          spend_requests.clear();
+          output_requests.clear();
+          const auto end = std::min(i + page_size, transfers.size());
+          for (auto j = i; j < end; j++) {
+            if (is_spend) {
+              spend_requests.push_back(
+                  GetTransactionInfoAsync(transfers[j].spend.hash()));
+            }
+            output_requests.push_back(
+                GetTransactionInfoAsync(transfers[j].output.hash()));
+          }
+        }
+
+        const auto& transfer = transfers[i];
+        auto output_result = output_requests[i % page_size].get();
         if (is_spend) {
           std::cout << "+++++++++++++++++++++++++++++++++++++++++++++++++++++++"
                        "+++++++++"
                     << std::endl;
           // Used to compute the spent amount only
-          GetTransactionInfo(transfer.spend.hash(), tx_block_info);
-          GetTransactionInfo(transfer.output.hash(), output_tx_block_info);
+          auto spend_result = spend_requests[i % page_size].get();
+          if (spend_result.success) {
+            tx_block_info = std::move(spend_result.tx_block_info);
+          }
+          if (output_result.success) {
+            output_tx_block_info = std::move(output_result.tx_block_info);
+          }
 
           // FIXME: Sent from account 5 shows, but there's no Received from
           // account 5(!!!)
@@ -402,20 +825,19 @@ const uint64_t BitcoinInterface::GetAccountBalance(
           for (const auto& output : output_tx_block_info.tx.outputs()) {
             std::cout << "output value (spend amount?): " << output.value()
                       << std::endl;
-            for (auto& cur_address :
-                 output.addresses(payment_address_version_)) {
+            for (const auto& cur_address : GetOutputAddresses(output)) {
               /* auto addresses =
                * libbitcoin::wallet::payment_address::extract(output.script(),
                * payment_address_version_); */
               /* for(auto& cur_address : addresses) { */
-              if (external_address_cache_.find(cur_address.encoded()) !=
+              if (external_address_cache_.find(cur_address) !=
                   internal_address_cache_.end()) {
                 received_change_amount += output.value();
-                std::cout << "  spend address " << cur_address.encoded()
+                std::cout << "  spend address " << cur_address
                           << " *is* a change address" << std::endl;
               } else {
                 received_amount += output.value();
-                std::cout << "  spend address " << cur_address.encoded()
+                std::cout << "  spend address " << cur_address
                           << " is not one of ours" << std::endl;
               }
             }
@@ -435,20 +857,19 @@ const uint64_t BitcoinInterface::GetAccountBalance(
           for (const auto& output : tx_block_info.tx.outputs()) {
             std::cout << "OUTPUT VALUE (SPEND AMOUNT?): " << output.value()
                       << std::endl;
-            for (auto& cur_address :
-                 output.addresses(payment_address_version_)) {
+            for (const auto& cur_address : GetOutputAddresses(output)) {
               /* auto addresses =
                * libbitcoin::wallet::payment_address::extract(output.script(),
                * payment_address_version_); */
               /* for(auto& cur_address : addresses) { */
-              if (internal_address_cache_.find(cur_address.encoded()) !=
+              if (internal_address_cache_.find(cur_address) !=
                   internal_address_cache_.end()) {
                 change_amount += output.value();
-                std::cout << "  spend address " << cur_address.encoded()
+                std::cout << "  spend address " << cur_address
                           << " *is* a change address" << std::endl;
               } else {
                 amount += output.value();
-                std::cout << "  spend address " << cur_address.encoded()
+                std::cout << "  spend address " << cur_address
                           << " is not one of ours" << std::endl;
               }
             }
@@ -472,7 +893,9 @@ const uint64_t BitcoinInterface::GetAccountBalance(
                        "---------"
                     << std::endl;
         } else {
-          GetTransactionInfo(transfer.output.hash(), tx_block_info);
+          if (output_result.success) {
+            tx_block_info = std::move(output_result.tx_block_info);
+          }
           /* amount += transfer.value; */
           amount = transfer.value;
           std::cout << "got receive amount of: " << amount << std::endl;
@@ -488,15 +911,14 @@ const uint64_t BitcoinInterface::GetAccountBalance(
           hash = libbitcoin::hash_digest(transfer.output.hash());
           tx_point = libbitcoin::chain::point(transfer.output);
 
-          libbitcoin::wallet::payment_address address(
-              libbitcoin::wallet::ec_public(key), payment_address_version_);
+          const auto address = GetEncodedAddress(account_index, key);
 
           std::reverse(hash.begin(), hash.end());
 
           TxInfo tx_info{!is_spend,
                          amount,
                          height,
-                         address.encoded(),
+                         address,
                          hash,
                          tx_point,
                          output_tx_block_info.header,
@@ -508,15 +930,14 @@ const uint64_t BitcoinInterface::GetAccountBalance(
         hash = libbitcoin::hash_digest(transfer.output.hash());
         tx_point = libbitcoin::chain::point(transfer.output);
 
-        libbitcoin::wallet::payment_address address(
-            libbitcoin::wallet::ec_public(key), payment_address_version_);
+        const auto address = GetEncodedAddress(account_index, key);
 
         std::reverse(hash.begin(), hash.end());
 
         TxInfo tx_info{is_spend,
                        amount,
                        height,
-                       address.encoded(),
+                       address,
                        hash,
                        tx_point,
                        tx_block_info.header,
@@ -535,10 +956,8 @@ uint64_t BitcoinInterface::GetUnconfirmedTransactionAmount(
     const libbitcoin::chain::transaction& tx) {
   uint64_t amount = 0;
   for (const auto& output : tx.outputs()) {
-    auto addresses = libbitcoin::wallet::payment_address::extract(
-        output.script(), payment_address_version_);
-    for (auto& cur_address : addresses) {
-      if (external_address_cache_.find(cur_address.encoded()) !=
+    for (const auto& cur_address : GetOutputAddresses(output)) {
+      if (external_address_cache_.find(cur_address) !=
           external_address_cache_.end()) {
         amount += output.value();
       }
@@ -548,8 +967,223 @@ uint64_t BitcoinInterface::GetUnconfirmedTransactionAmount(
   return amount;
 }
 
+bool BitcoinInterface::TrackUnconfirmedTransaction(
+    const libbitcoin::chain::transaction& tx, bool outgoing) {
+  if (mempool_.Contains(tx.hash())) {
+    return false;
+  }
+
+  MempoolEntry entry{tx, {}, {}, outgoing, 0};
+  for (const auto& output : tx.outputs()) {
+    libbitcoin::short_hash key_hash;
+    uint32_t account_index = 0;
+    if (GetOutputKeyHash(output, key_hash) &&
+        GetAccountIndex(key_hash, account_index)) {
+      entry.received[account_index] += output.value();
+    }
+  }
+
+  for (const auto& input : tx.inputs()) {
+    libbitcoin::short_hash key_hash;
+    uint32_t account_index = 0;
+    if (!GetInputKeyHash(input, key_hash) ||
+        !GetAccountIndex(key_hash, account_index)) {
+      continue;
+    }
+
+    uint64_t value = 0;
+    if (!GetSpentOutputValue(input.previous_output(), key_hash, value)) {
+      std::cout << "Cannot find the value of spent output "
+                << libbitcoin::encode_hash(input.previous_output().hash())
+                << ":" << input.previous_output().index() << std::endl;
+      continue;
+    }
+    entry.spent[account_index] += value;
+  }
+
+  if (entry.received.empty() && entry.spent.empty()) {
+    return false;
+  }
+  return mempool_.Add(entry);
+}
+
+PendingBalance BitcoinInterface::GetPendingBalance(uint32_t account_index) {
+  return mempool_.GetPendingBalance(account_index);
+}
+
+std::vector<ConfirmedTransaction>
+BitcoinInterface::PromoteConfirmedTransactions() {
+  const auto tx_hashes = mempool_.GetTransactionHashes();
+  if (tx_hashes.empty()) {
+    return {};
+  }
+
+  // the lookups are all sent before waiting on any of them
+  std::vector<std::future<TxBlockInfoResult>> block_requests;
+  block_requests.reserve(tx_hashes.size());
+  for (const auto& tx_hash : tx_hashes) {
+    block_requests.push_back(GetTransactionInfoAsync(tx_hash, false));
+  }
+
+  std::vector<ConfirmedTransaction> confirmed;
+  std::vector<libbitcoin::hash_digest> unconfirmed;
+  for (size_t i = 0; i < tx_hashes.size(); i++) {
+    const auto result = block_requests[i].get();
+    ConfirmedTransaction transaction{tx_hashes[i],
+                                     result.tx_block_info.height, {}};
+    if (!result.success || !transaction.height) {
+      unconfirmed.push_back(tx_hashes[i]);
+    } else if (mempool_.Remove(tx_hashes[i], transaction.entry)) {
+      ReleasePrevouts(transaction.entry.tx);
+      ReleaseSpentReservations(transaction.entry.tx);
+      confirmed.push_back(std::move(transaction));
+    }
+  }
+
+  // transactions that are neither confirmed nor in the mempool were
+  // evicted, or replaced by a transaction we haven't seen
+  std::vector<std::future<TxBlockInfoResult>> pool_requests;
+  pool_requests.reserve(unconfirmed.size());
+  for (const auto& tx_hash : unconfirmed) {
+    pool_requests.push_back(GetTransactionInfoAsync(tx_hash, true));
+  }
+  for (size_t i = 0; i < unconfirmed.size(); i++) {
+    if (pool_requests[i].get().success) {
+      mempool_.Found(unconfirmed[i]);
+    } else if (mempool_.Missed(unconfirmed[i],
+                               megabit::constants::max_mempool_misses)) {
+      std::cout << "Dropped unconfirmed transaction "
+                << libbitcoin::encode_hash(unconfirmed[i])
+                << " missing from the mempool" << std::endl;
+    }
+  }
+  return confirmed;
+}
+
+bool BitcoinInterface::VerifyWitnessIndexing(
+    const std::vector<ConfirmedTransaction>& confirmed) {
+  if (witness_indexing_verified_) {
+    return true;
+  }
+
+  for (const auto& transaction : confirmed) {
+    const auto& outputs = transaction.entry.tx.outputs();
+    for (uint32_t i = 0; i < outputs.size(); i++) {
+      libbitcoin::short_hash key_hash;
+      uint32_t account_index = 0;
+      if (!megabit::segwit::is_pay_witness_key_hash(outputs[i].script(),
+                                                    key_hash) ||
+          !GetAccountIndex(key_hash, account_index)) {
+        continue;
+      }
+
+      // the cached history predates the confirmation
+      InvalidateHistories({key_hash});
+      AddressHistory history;
+      if (!GetAddressHistory(
+              megabit::segwit::witness_address(key_hash, bech32_prefix_),
+              history)) {
+        return true;
+      }
+
+      const libbitcoin::chain::output_point point{transaction.tx_hash, i};
+      witness_indexing_verified_ = std::any_of(
+          history.transfers.begin(), history.transfers.end(),
+          [&point](const AddressHistory::Internal& transfer) {
+            return (transfer.output == point);
+          });
+      if (!witness_indexing_verified_) {
+        std::cout << "WARNING: the server's history is missing p2wpkh output "
+                  << libbitcoin::encode_hash(point.hash()) << ":"
+                  << point.index() << ", segwit balances may be incomplete"
+                  << std::endl;
+      }
+      return witness_indexing_verified_;
+    }
+  }
+  return true;
+}
+
+bool BitcoinInterface::PromoteConfirmedTransaction(
+    const libbitcoin::hash_digest& tx_hash, size_t height,
+    ConfirmedTransaction& confirmed) {
+  confirmed = {tx_hash, height, {}};
+  if (!mempool_.Remove(tx_hash, confirmed.entry)) {
+    return false;
+  }
+  ReleasePrevouts(confirmed.entry.tx);
+  ReleaseSpentReservations(confirmed.entry.tx);
+  return true;
+}
+
+bool BitcoinInterface::GetOutputKeyHash(
+    const libbitcoin::chain::output& output,
+    libbitcoin::short_hash& key_hash) const {
+  if (megabit::segwit::is_pay_witness_key_hash(output.script(), key_hash)) {
+    return true;
+  }
+  const auto addresses = libbitcoin::wallet::payment_address::extract(
+      output.script(), payment_address_version_);
+  if (addresses.empty()) {
+    return false;
+  }
+  key_hash = addresses.front().hash();
+  return true;
+}
+
+bool BitcoinInterface::GetAccountIndex(const libbitcoin::short_hash& key_hash,
+                                       uint32_t& account_index) const {
+  std::lock_guard<std::mutex> lock(key_hash_lock_);
+  const auto account_iter = key_hash_accounts_.find(key_hash);
+  if (account_iter == key_hash_accounts_.end()) {
+    return false;
+  }
+  account_index = account_iter->second;
+  return true;
+}
+
+bool BitcoinInterface::GetSpentOutputValue(
+    const libbitcoin::chain::output_point& point,
+    const libbitcoin::short_hash& key_hash, uint64_t& value) {
+  if (mempool_.GetOutputValue(point, value)) {
+    return true;
+  }
+
+  libbitcoin::chain::transaction tx;
+  if (GetBroadcastTransaction(point.hash(), tx) &&
+      (point.index() < tx.outputs().size())) {
+    value = tx.outputs()[point.index()].value();
+    return true;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(history_cache_lock_);
+    const auto cache_iter = history_cache_.find(key_hash);
+    if (cache_iter != history_cache_.end()) {
+      for (const auto& row : cache_iter->second.rows) {
+        if (row.output == point) {
+          value = row.value;
+          return true;
+        }
+      }
+    }
+  }
+
+  // only outputs the wallet hasn't loaded need a request
+  TxBlockInfo tx_block_info{};
+  if ((!GetTransactionInfo(point.hash(), tx_block_info, false) &&
+       !GetTransactionInfo(point.hash(), tx_block_info, true)) ||
+      (point.index() >= tx_block_info.tx.outputs().size())) {
+    return false;
+  }
+  value = tx_block_info.tx.outputs()[point.index()].value();
+  return true;
+}
+
 bool BitcoinInterface::GetAddressHistory(const libbitcoin::ec_secret& key,
                                          AddressHistory& history) {
+  // p2pkh and p2wpkh outputs paying this key share the same key hash
+  // history, so the p2pkh form of the address is queried for both
   libbitcoin::wallet::payment_address address(
       libbitcoin::wallet::ec_public(key), payment_address_version_);
 
@@ -558,6 +1192,22 @@ bool BitcoinInterface::GetAddressHistory(const libbitcoin::ec_secret& key,
 
 bool BitcoinInterface::GetAddressHistory(const std::string& address,
                                          AddressHistory& history) {
+  auto result = GetAddressHistoryAsync(address).get();
+  history = std::move(result.history);
+  return result.success;
+}
+
+std::future<AddressHistoryResult> BitcoinInterface::GetAddressHistoryAsync(
+    const std::string& address) {
+  return request_executor_.Submit<AddressHistoryResult>([this, address]() {
+    AddressHistoryResult result{false, {}};
+    result.success = FetchAddressHistory(address, result.history);
+    return result;
+  });
+}
+
+bool BitcoinInterface::FetchAddressHistory(const std::string& address,
+                                           AddressHistory& history) {
   auto ret = true;
   auto on_done =
       [address, &ret,
@@ -598,250 +1248,1739 @@ bool BitcoinInterface::GetAddressHistory(const std::string& address,
     }
   };
 
-  client_.blockchain_fetch_history3(on_error, on_done, address);
-  client_.wait();
+  const auto query_address = GetQueryAddress(address);
+  const auto key_hash = query_address.hash();
+  size_t from_height = 0;
+  if (GetCachedHistory(key_hash, on_done, from_height)) {
+    return true;
+  }
+
+  // a stale cached history is brought up to date with the rows from
+  // a little below the height it was complete at, see
+  // MergeCachedHistory
+  const size_t tip = block_height_;
+  libbitcoin::chain::history::list rows;
+  ret = RequestHistory(query_address, from_height, rows, on_error) && ret;
+  if (ret && !MergeCachedHistory(key_hash, from_height, tip, rows)) {
+    rows.clear();
+    ret = RequestHistory(query_address, 0, rows, on_error) && ret;
+    if (ret) {
+      MergeCachedHistory(key_hash, 0, tip, rows);
+    }
+  }
 
+  if (ret) {
+    on_done(rows);
+  }
   return ret;
 }
 
-bool BitcoinInterface::TransactionIsValid(
-    const libbitcoin::chain::transaction& transaction) {
-  bool ret = false;
-
-  auto on_done = [&ret, &transaction](const libbitcoin::code& error) {
-    std::cout << "Transaction is valid!" << std::endl
-              << megabit::utils::to_string(transaction) << std::endl;
-    ret = (error == libbitcoin::error::success);
-  };
-
-  auto on_error = [&transaction](const libbitcoin::code& error) {
-    std::cout << "Failed to validate transaction: " << error.message()
-              << std::endl;
-    std::cout << "Failed raw transaction:"
-              << libbitcoin::encode_base16(transaction.to_data()) << std::endl;
-    std::cout << "Failed transaction:" << megabit::utils::to_string(transaction)
-              << std::endl;
-  };
-
-  client_.transaction_pool_validate2(on_error, on_done, transaction);
-  client_.wait();
+bool BitcoinInterface::RequestHistory(
+    const libbitcoin::wallet::payment_address& query_address,
+    size_t from_height, libbitcoin::chain::history::list& rows,
+    const ErrorHandler& on_error) {
+  libbitcoin::data_chunk request;
+  libbitcoin::data_sink ostream(request);
+  libbitcoin::ostream_writer sink(ostream);
+  sink.write_short_hash(query_address.hash());
+  sink.write_4_bytes_little_endian(static_cast<uint32_t>(from_height));
+  ostream.flush();
+
+  libbitcoin::data_chunk response;
+  if (request_log_.Replay(RequestType::address_history, request, response)) {
+    return DecodeHistory(response, rows);
+  }
 
+  // the rows are only processed once, from the read that won
+  auto ret = true;
+  const auto started = RequestLog::Clock::now();
+  ret = servers_.PerformRead<libbitcoin::chain::history::list>(
+            [query_address, from_height](
+                LibbitcoinClient& client, const ServerErrorHandler& on_error,
+                libbitcoin::chain::history::list& rows) {
+              client.blockchain_fetch_history3(
+                  on_error,
+                  [&rows](const libbitcoin::chain::history::list& result) {
+                    rows = result;
+                  },
+                  query_address, static_cast<uint32_t>(from_height));
+              client.wait();
+            },
+            rows,
+            [&ret, &on_error](const libbitcoin::code& error) {
+              ret = false;
+              on_error(error);
+            }) &&
+        ret;
+  request_log_.Record(RequestType::address_history, request, started,
+                      [ret, &rows]() { return EncodeHistory(ret, rows); });
   return ret;
 }
 
-bool BitcoinInterface::GetTransactionInfo(
-    const libbitcoin::hash_digest& tx_hash, TxBlockInfo& tx_block_info,
-    bool unconfirmed) {
-  // NOTE: we reverse the hash ONLY for logging/printing
-  auto hash = libbitcoin::hash_digest(tx_hash);
-  std::reverse(hash.begin(), hash.end());
-  std::cout << "-> Getting transaction info for: "
-            << libbitcoin::encode_base16(hash) << std::endl;
-
-  auto ret = false;
+bool BitcoinInterface::GetCachedHistory(
+    const libbitcoin::short_hash& key_hash,
+    const std::function<void(const libbitcoin::chain::history::list&)>&
+        on_cached,
+    size_t& from_height) {
+  std::lock_guard<std::mutex> lock(history_cache_lock_);
+  const auto it = history_cache_.find(key_hash);
+  if (it == history_cache_.end()) {
+    from_height = 0;
+    return false;
+  }
+  if (it->second.stale) {
+    const auto overlap = megabit::constants::history_refresh_overlap;
+    from_height = (it->second.height > overlap) ? it->second.height - overlap
+                                                : 0;
+    return false;
+  }
+  it->second.last_used = ++history_cache_uses_;
+  on_cached(it->second.rows);
+  return true;
+}
 
-  auto on_error = [&ret](const libbitcoin::code& error) {
-    std::cerr << "ERROR: " << error.message() << std::endl;
-    ret = false;
-  };
+bool BitcoinInterface::MergeCachedHistory(
+    const libbitcoin::short_hash& key_hash, size_t from_height, size_t height,
+    libbitcoin::chain::history::list& rows) {
+  std::lock_guard<std::mutex> lock(history_cache_lock_);
+  if (from_height == 0) {
+    auto& cached = history_cache_[key_hash];
+    history_cache_rows_ -= cached.rows.size();
+    history_cache_rows_ += rows.size();
+    cached = {rows, height, false, ++history_cache_uses_};
+    IndexHistoryHeights(key_hash, rows, height);
+    TrimHistoryCache();
+    return true;
+  }
 
-  auto on_done = [&tx_block_info,
-                  &ret](const libbitcoin::chain::transaction& tx) {
-    tx_block_info.tx = tx;
-    ret = true;
-  };
+  const auto it = history_cache_.find(key_hash);
+  if (it == history_cache_.end()) {
+    return false;
+  }
 
-  auto on_fetch_tx_index_done = [&tx_block_info, &ret](size_t height,
-                                                       size_t index) {
-    tx_block_info.height = height;
-    tx_block_info.index = index;
-    ret = true;
-    std::cout << "fetch tx done: height " << height << ", " << index << index
-              << std::endl;
+  // unconfirmed rows (at height 0) and rows at or above from_height
+  // are dropped, since the new rows repeat them if they still hold.
+  // Spends in that range are undone for the same reason.
+  const auto refreshed = [from_height](size_t row_height) {
+    return (row_height == 0) ||
+           ((row_height >= from_height) &&
+            (row_height != megabit::constants::unspent_height));
   };
+  libbitcoin::chain::history::list merged;
+  merged.reserve(it->second.rows.size() + rows.size());
+  for (auto row : it->second.rows) {
+    if (refreshed(row.output_height)) {
+      continue;
+    }
+    if (refreshed(row.spend_height)) {
+      row.spend = {libbitcoin::null_hash, megabit::constants::unspent_index};
+      row.spend_height = megabit::constants::unspent_height;
+    }
+    merged.push_back(row);
+  }
 
-  auto on_fetch_header_done = [&tx_block_info,
-                               &ret](const libbitcoin::chain::header& header) {
-    tx_block_info.header = header;
-    ret = true;
-    std::cout << "fetch header done called" << std::endl;
+  // a spend of an output below from_height comes without its output,
+  // carrying the output point's checksum in place of the value
+  for (const auto& row : rows) {
+    if (row.output.hash() != libbitcoin::null_hash) {
+      const auto existing = std::find_if(
+          merged.begin(), merged.end(),
+          [&row](const libbitcoin::chain::history& other) {
+            return other.output == row.output;
+          });
+      if (existing == merged.end()) {
+        merged.push_back(row);
+      } else {
+        *existing = row;
+      }
+      continue;
+    }
+
+    const auto spent = std::find_if(
+        merged.begin(), merged.end(),
+        [&row](const libbitcoin::chain::history& other) {
+          return other.output.checksum() == row.value;
+        });
+    if (spent == merged.end()) {
+      return false;
+    }
+    spent->spend = row.spend;
+    spent->spend_height = row.spend_height;
+  }
+
+  history_cache_rows_ -= it->second.rows.size();
+  history_cache_rows_ += merged.size();
+  it->second = {merged, height, false, ++history_cache_uses_};
+  IndexHistoryHeights(key_hash, merged, height);
+  rows.swap(merged);
+  TrimHistoryCache();
+  return true;
+}
+
+void BitcoinInterface::TrimHistoryCache() {
+  if (history_cache_rows_ <= megabit::constants::max_cached_history_rows) {
+    return;
+  }
+
+  // trimmed below the limit, so that the sort isn't repeated for
+  // every history merged while the cache is full
+  std::vector<std::pair<uint64_t, libbitcoin::short_hash>> by_use;
+  by_use.reserve(history_cache_.size());
+  for (const auto& entry : history_cache_) {
+    by_use.emplace_back(entry.second.last_used, entry.first);
+  }
+  std::sort(by_use.begin(), by_use.end());
+
+  const auto target = (megabit::constants::max_cached_history_rows / 4) * 3;
+  size_t dropped = 0;
+  for (const auto& use : by_use) {
+    if (history_cache_rows_ <= target) {
+      break;
+    }
+    const auto it = history_cache_.find(use.second);
+    history_cache_rows_ -= it->second.rows.size();
+    history_cache_.erase(it);
+    ++dropped;
+  }
+  std::cout << "Dropped " << dropped << " least recently used histories, "
+            << history_cache_.size() << " cached holding "
+            << history_cache_rows_ << " rows" << std::endl;
+}
+
+void BitcoinInterface::IndexHistoryHeights(
+    const libbitcoin::short_hash& key_hash,
+    const libbitcoin::chain::history::list& rows, size_t height) {
+  const auto floor = (height > megabit::constants::max_reorg_depth)
+                         ? height - megabit::constants::max_reorg_depth
+                         : 0;
+  const auto recent = [floor](size_t row_height) {
+    return (row_height > floor) &&
+           (row_height != megabit::constants::unspent_height);
+  };
+  for (const auto& row : rows) {
+    if (recent(row.output_height)) {
+      history_heights_[row.output_height].insert(key_hash);
+    }
+    if (recent(row.spend_height)) {
+      history_heights_[row.spend_height].insert(key_hash);
+    }
+  }
+}
+
+bool BitcoinInterface::TransactionIsValid(
+    const libbitcoin::chain::transaction& transaction) {
+  bool checked = false;
+  if (!ValidateTransactionLocally(transaction, checked)) {
+    return false;
+  }
+  if (checked && !server_validation_) {
+    return true;
+  }
+  return TransactionIsValidAsync(transaction).get();
+}
+
+bool BitcoinInterface::ValidateTransactionLocally(
+    const libbitcoin::chain::transaction& transaction, bool& checked) {
+  checked = false;
+  const auto& inputs = transaction.inputs();
+  const auto& outputs = transaction.outputs();
+  if (inputs.empty() || outputs.empty()) {
+    std::cout << "Transaction has no inputs or outputs" << std::endl;
+    return false;
+  }
+
+  std::vector<libbitcoin::chain::output> prevouts;
+  std::unordered_set<libbitcoin::chain::point> spent;
+  for (const auto& input : inputs) {
+    if (!spent.insert(input.previous_output()).second) {
+      std::cout << "Transaction spends an output twice" << std::endl;
+      return false;
+    }
+    libbitcoin::chain::output prevout;
+    if (!GetCachedPrevout(input.previous_output(), prevout)) {
+      // can't check amounts or scripts, leave it to the server
+      return true;
+    }
+    prevouts.push_back(std::move(prevout));
+  }
+
+  uint64_t input_value = 0;
+  for (const auto& prevout : prevouts) {
+    input_value += prevout.value();
+  }
+  uint64_t output_value = 0;
+  for (const auto& output : outputs) {
+    output_value += output.value();
+  }
+  if (output_value > input_value) {
+    std::cout << "Transaction spends " << output_value << " but only has "
+              << input_value << std::endl;
+    return false;
+  }
+
+  for (uint32_t i = 0; i < inputs.size(); i++) {
+    const auto ret = libbitcoin::chain::script::verify(
+        transaction, i, libbitcoin::machine::rule_fork::all_rules,
+        prevouts[i].script(), prevouts[i].value());
+    if (ret != libbitcoin::error::success) {
+      std::cout << "Transaction input " << i
+                << " is invalid: " << ret.message() << std::endl;
+      return false;
+    }
+  }
+  checked = true;
+  return true;
+}
+
+void BitcoinInterface::CachePrevout(const libbitcoin::chain::point& point,
+                                    const libbitcoin::chain::output& output) {
+  std::lock_guard<std::mutex> lock(prevout_lock_);
+  prevout_cache_[point] = output;
+}
+
+bool BitcoinInterface::GetCachedPrevout(const libbitcoin::chain::point& point,
+                                        libbitcoin::chain::output& output) {
+  std::lock_guard<std::mutex> lock(prevout_lock_);
+  const auto it = prevout_cache_.find(point);
+  if (it == prevout_cache_.end()) {
+    return false;
+  }
+  output = it->second;
+  return true;
+}
+
+void BitcoinInterface::ReleasePrevouts(
+    const libbitcoin::chain::transaction& transaction) {
+  std::lock_guard<std::mutex> lock(prevout_lock_);
+  for (const auto& input : transaction.inputs()) {
+    prevout_cache_.erase(input.previous_output());
+  }
+}
+
+std::future<bool> BitcoinInterface::TransactionIsValidAsync(
+    const libbitcoin::chain::transaction& transaction) {
+  return request_executor_.Submit<bool>(
+      [this, transaction]() { return ValidateTransaction(transaction); });
+}
+
+bool BitcoinInterface::ValidateTransaction(
+    const libbitcoin::chain::transaction& transaction) {
+  bool ret = false;
+
+  auto on_done = [&ret, &transaction](const libbitcoin::code& error) {
+    ret = (error == libbitcoin::error::success);
+    if (ret) {
+      std::cout << "Transaction is valid: "
+                << libbitcoin::encode_hash(transaction.hash()) << std::endl;
+    } else {
+      std::cout << "Transaction is invalid: " << error.message() << std::endl
+                << megabit::utils::to_string(transaction) << std::endl;
+    }
+  };
+
+  auto on_error = [&transaction](const libbitcoin::code& error) {
+    std::cout << "Failed to validate transaction: " << error.message()
+              << std::endl;
+    std::cout << "Failed raw transaction:"
+              << libbitcoin::encode_base16(transaction.to_data()) << std::endl;
+    std::cout << "Failed transaction:" << megabit::utils::to_string(transaction)
+              << std::endl;
+  };
+
+  const auto request = transaction.to_data(true, true);
+  libbitcoin::data_chunk response;
+  if (request_log_.Replay(RequestType::validate_transaction, request,
+                          response)) {
+    return DecodeStatus(response);
+  }
+
+  const auto started = RequestLog::Clock::now();
+  servers_.Perform(
+      [&on_done, &transaction](LibbitcoinClient& client,
+                               const ServerErrorHandler& on_error) {
+        client.transaction_pool_validate2(on_error, on_done, transaction);
+        client.wait();
+      },
+      on_error);
+  request_log_.Record(RequestType::validate_transaction, request, started,
+                      [ret]() { return EncodeStatus(ret); });
+
+  return ret;
+}
+
+bool BitcoinInterface::GetTransactionInfo(
+    const libbitcoin::hash_digest& tx_hash, TxBlockInfo& tx_block_info,
+    bool unconfirmed) {
+  auto result = GetTransactionInfoAsync(tx_hash, unconfirmed).get();
+  if (result.success) {
+    tx_block_info = result.tx_block_info;
+  }
+  return result.success;
+}
+
+std::future<TxBlockInfoResult> BitcoinInterface::GetTransactionInfoAsync(
+    const libbitcoin::hash_digest& tx_hash, bool unconfirmed) {
+  return request_executor_.Submit<TxBlockInfoResult>(
+      [this, tx_hash, unconfirmed]() {
+        TxBlockInfoResult result{false, {}};
+        result.success =
+            FetchTransactionInfo(tx_hash, result.tx_block_info, unconfirmed);
+        return result;
+      });
+}
+
+bool BitcoinInterface::FetchTransactionInfo(
+    const libbitcoin::hash_digest& tx_hash, TxBlockInfo& tx_block_info,
+    bool unconfirmed) {
+  // NOTE: we reverse the hash ONLY for logging/printing
+  auto hash = libbitcoin::hash_digest(tx_hash);
+  std::reverse(hash.begin(), hash.end());
+  std::cout << "-> Getting transaction info for: "
+            << libbitcoin::encode_base16(hash) << std::endl;
+
+  auto ret = false;
+
+  auto on_error = [&ret](const libbitcoin::code& error) {
+    std::cerr << "ERROR: " << error.message() << std::endl;
+    ret = false;
+  };
+
+  struct TxRead {
+    bool found;
+    TxBlockInfo tx_block_info;
+  };
+
+  // the steps are repeated from the start on another server when the
+  // connection fails part way.  A read may be hedged, so the request
+  // only writes to its own result.
+  const auto block_height = block_height_;
+  auto request = [tx_hash, unconfirmed, block_height](
+                     LibbitcoinClient& client,
+                     const ServerErrorHandler& on_request_error,
+                     TxRead& result) {
+    auto& tx_block_info = result.tx_block_info;
+    auto& found = result.found;
+    found = false;
+
+    auto on_done = [&tx_block_info,
+                    &found](const libbitcoin::chain::transaction& tx) {
+      tx_block_info.tx = tx;
+      found = true;
+    };
+
+    auto on_fetch_tx_index_done = [&tx_block_info, &found](size_t height,
+                                                           size_t index) {
+      tx_block_info.height = height;
+      tx_block_info.index = index;
+      found = true;
+      std::cout << "fetch tx done: height " << height << ", " << index
+                << index << std::endl;
+    };
+
+    auto on_fetch_header_done =
+        [&tx_block_info, &found](const libbitcoin::chain::header& header) {
+          tx_block_info.header = header;
+          found = true;
+          std::cout << "fetch header done called" << std::endl;
+        };
+
+    auto on_error = [&found,
+                     &on_request_error](const libbitcoin::code& error) {
+      found = false;
+      on_request_error(error);
+    };
+
+    if (unconfirmed) {
+      client.transaction_pool_fetch_transaction(on_error, on_done, tx_hash);
+    } else {
+      client.blockchain_fetch_transaction(on_error, on_done, tx_hash);
+    }
+    client.wait();
+
+    if (found && !unconfirmed) {
+      /* MEGABIT_ASSERT(tx_hash == tx_block_info.tx.hash()); */
+
+      found = false;
+      client.blockchain_fetch_transaction_index(
+          on_error, on_fetch_tx_index_done, tx_block_info.tx.hash());
+      client.wait();
+
+      if (found) {
+        std::cout << "about to fetch block header of height: "
+                  << tx_block_info.height << std::endl;
+        found = false;
+        client.blockchain_fetch_block_header(
+            on_error, on_fetch_header_done,
+            ((tx_block_info.height > 0) ? tx_block_info.height
+                                        : block_height));
+        client.wait();
+      }
+    }
+  };
+
+  libbitcoin::data_chunk log_request;
+  libbitcoin::data_sink ostream(log_request);
+  libbitcoin::ostream_writer sink(ostream);
+  sink.write_hash(tx_hash);
+  sink.write_byte(unconfirmed ? 1 : 0);
+  ostream.flush();
+
+  TxRead result{false, tx_block_info};
+  libbitcoin::data_chunk response;
+  if (request_log_.Replay(RequestType::transaction_info, log_request,
+                          response)) {
+    ret = DecodeTxBlockInfo(response, result.tx_block_info);
+  } else {
+    const auto started = RequestLog::Clock::now();
+    ret = servers_.PerformRead<TxRead>(request, result, on_error) &&
+          result.found;
+    request_log_.Record(RequestType::transaction_info, log_request, started,
+                        [ret, &result]() {
+                          return EncodeTxBlockInfo(ret, result.tx_block_info);
+                        });
+  }
+  if (ret) {
+    tx_block_info = result.tx_block_info;
+  }
+  return ret;
+}
+
+void BitcoinInterface::GetBlockHeight(ErrorHandler on_error,
+                                      BlockHeightHandler handler) {
+  const auto result = GetBlockHeightAsync().get();
+  if (result.error) {
+    on_error(result.error);
+  } else {
+    handler(result.height);
+  }
+}
+
+std::future<BlockHeightResult> BitcoinInterface::GetBlockHeightAsync() {
+  return request_executor_.Submit<BlockHeightResult>(
+      [this]() { return FetchBlockHeight(); });
+}
+
+BlockHeightResult BitcoinInterface::FetchBlockHeight() {
+  BlockHeightResult result{libbitcoin::error::success, 0};
+  libbitcoin::data_chunk response;
+  if (request_log_.Replay(RequestType::block_height, {}, response)) {
+    return DecodeBlockHeight(response);
+  }
+
+  const auto started = RequestLog::Clock::now();
+  servers_.Perform(
+      [&result](LibbitcoinClient& client, const ServerErrorHandler& on_error) {
+        client.blockchain_fetch_last_height(
+            on_error, [&result](size_t height) { result.height = height; });
+        client.wait();
+      },
+      [&result](const libbitcoin::code& error) { result.error = error; });
+  request_log_.Record(RequestType::block_height, {}, started,
+                      [&result]() { return EncodeBlockHeight(result); });
+  return result;
+}
+
+void BitcoinInterface::SetBlockHeight(const size_t block_height) {
+  block_height_ = block_height;
+}
+
+bool BitcoinInterface::FetchBlockTransactionHashes(
+    size_t height, libbitcoin::hash_list& tx_hashes) {
+  auto ret = true;
+  auto on_error = [&ret, height](const libbitcoin::code& error) {
+    std::cout << "Failed to retrieve the transactions of block " << height
+              << ": " << error << std::endl;
+    ret = false;
+  };
+
+  const auto request = EncodeHeightRequest(height);
+  libbitcoin::data_chunk response;
+  if (request_log_.Replay(RequestType::block_transaction_hashes, request,
+                          response)) {
+    return DecodeHashList(response, tx_hashes);
+  }
+
+  const auto started = RequestLog::Clock::now();
+  ret = servers_.PerformRead<libbitcoin::hash_list>(
+            [height](LibbitcoinClient& client,
+                     const ServerErrorHandler& on_error,
+                     libbitcoin::hash_list& tx_hashes) {
+              client.blockchain_fetch_block_transaction_hashes(
+                  on_error,
+                  [&tx_hashes](const libbitcoin::hash_list& result) {
+                    tx_hashes = result;
+                  },
+                  static_cast<uint32_t>(height));
+              client.wait();
+            },
+            tx_hashes, on_error) &&
+        ret;
+  request_log_.Record(
+      RequestType::block_transaction_hashes, request, started,
+      [ret, &tx_hashes]() { return EncodeHashList(ret, tx_hashes); });
+  return ret;
+}
+
+bool BitcoinInterface::FetchBlockHash(size_t height,
+                                      libbitcoin::hash_digest& block_hash) {
+  auto ret = true;
+  auto on_error = [&ret, height](const libbitcoin::code& error) {
+    std::cout << "Failed to retrieve the header of block " << height << ": "
+              << error << std::endl;
+    ret = false;
+  };
+
+  const auto request = EncodeHeightRequest(height);
+  libbitcoin::data_chunk response;
+  if (request_log_.Replay(RequestType::block_hash, request, response)) {
+    return DecodeBlockHash(response, block_hash);
+  }
+
+  const auto started = RequestLog::Clock::now();
+  ret = servers_.PerformRead<libbitcoin::hash_digest>(
+            [height](LibbitcoinClient& client,
+                     const ServerErrorHandler& on_error,
+                     libbitcoin::hash_digest& block_hash) {
+              client.blockchain_fetch_block_header(
+                  on_error,
+                  [&block_hash](const libbitcoin::chain::header& header) {
+                    block_hash = header.hash();
+                  },
+                  static_cast<uint32_t>(height));
+              client.wait();
+            },
+            block_hash, on_error) &&
+        ret;
+  request_log_.Record(
+      RequestType::block_hash, request, started,
+      [ret, &block_hash]() { return EncodeBlockHash(ret, block_hash); });
+  return ret;
+}
+
+bool BitcoinInterface::FetchTransaction(const libbitcoin::hash_digest& tx_hash,
+                                        libbitcoin::chain::transaction& tx) {
+  auto ret = true;
+  auto on_error = [&ret](const libbitcoin::code& error) {
+    std::cout << "Failed to retrieve transaction: " << error << std::endl;
+    ret = false;
+  };
+
+  const auto request = libbitcoin::to_chunk(tx_hash);
+  libbitcoin::data_chunk response;
+  if (request_log_.Replay(RequestType::transaction, request, response)) {
+    return DecodeTransaction(response, tx);
+  }
+
+  const auto started = RequestLog::Clock::now();
+  ret = servers_.PerformRead<libbitcoin::chain::transaction>(
+            [tx_hash](LibbitcoinClient& client,
+                      const ServerErrorHandler& on_error,
+                      libbitcoin::chain::transaction& tx) {
+              client.blockchain_fetch_transaction(
+                  on_error,
+                  [&tx](const libbitcoin::chain::transaction& result) {
+                    tx = result;
+                  },
+                  tx_hash);
+              client.wait();
+            },
+            tx, on_error) &&
+        ret;
+  request_log_.Record(RequestType::transaction, request, started,
+                      [ret, &tx]() { return EncodeTransaction(ret, tx); });
+  return ret;
+}
+
+void BitcoinInterface::SyncHistoryCache() {
+  std::lock_guard<std::mutex> sync_lock(history_sync_lock_);
+  const size_t tip = block_height_;
+
+  // the blocks above the fork are scanned again below
+  size_t fork_height = 0;
+  if (FindReorganisation(tip, fork_height)) {
+    RollbackHistoryCache(fork_height);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(history_cache_lock_);
+    if (tip <= history_cache_height_) {
+      return;
+    }
+  }
+
+  // the tip's hash is taken before syncing, so that a reorganisation
+  // while scanning is found on the next sync
+  libbitcoin::hash_digest tip_hash = libbitcoin::null_hash;
+  if (!FetchBlockHash(tip, tip_hash)) {
+    tip_hash = libbitcoin::null_hash;
+  }
+
+  size_t cursor = 0;
+  std::vector<libbitcoin::short_hash> key_hashes;
+  BlockScanner::OutpointMap outpoints;
+  {
+    std::lock_guard<std::mutex> lock(history_cache_lock_);
+    if (tip <= history_cache_height_) {
+      return;
+    }
+    cursor = history_cache_height_;
+
+    if (cursor == 0 || !BlockScanner::ShouldScanBlocks(
+                           tip - cursor, history_cache_.size(),
+                           scan_transactions_per_block_)) {
+      for (auto& entry : history_cache_) {
+        entry.second.stale = true;
+      }
+      history_cache_height_ = tip;
+      RecordBlockHash(tip, tip_hash);
+      return;
+    }
+
+    // spends of our outputs are matched by outpoint, since the inputs
+    // of some output types don't reveal the key hash
+    key_hashes.reserve(history_cache_.size());
+    for (const auto& entry : history_cache_) {
+      key_hashes.push_back(entry.first);
+      for (const auto& row : entry.second.rows) {
+        outpoints[row.output] = entry.first;
+      }
+    }
+  }
+
+  std::cout << "Scanning blocks " << cursor + 1 << " to " << tip << " for "
+            << key_hashes.size() << " addresses" << std::endl;
+  const BlockScanner scanner(
+      key_hashes, std::move(outpoints),
+      megabit::constants::block_scan_false_positive_rate);
+  std::set<libbitcoin::short_hash> touched;
+  const auto scanned = ScanBlocks(cursor + 1, tip, scanner, touched);
+
+  std::lock_guard<std::mutex> lock(history_cache_lock_);
+  for (auto& entry : history_cache_) {
+    if (!scanned || touched.count(entry.first)) {
+      entry.second.stale = true;
+    }
+  }
+  history_cache_height_ = tip;
+  RecordBlockHash(tip, tip_hash);
+}
+
+bool BitcoinInterface::FindReorganisation(size_t tip, size_t& fork_height) {
+  std::map<size_t, libbitcoin::hash_digest> block_hashes;
+  {
+    std::lock_guard<std::mutex> lock(history_cache_lock_);
+    block_hashes = block_hashes_;
+  }
+
+  // without a reorganisation this takes one request, otherwise one
+  // per recorded block above the fork
+  fork_height = 0;
+  for (auto it = block_hashes.rbegin(); it != block_hashes.rend(); ++it) {
+    libbitcoin::hash_digest block_hash = libbitcoin::null_hash;
+    if (it->first <= tip) {
+      if (!FetchBlockHash(it->first, block_hash)) {
+        // checked again on the next sync
+        return false;
+      }
+      if (block_hash == it->second) {
+        fork_height = it->first;
+        break;
+      }
+    }
+    std::cout << "Block " << it->first << " ("
+              << libbitcoin::encode_hash(it->second)
+              << ") is no longer in the chain" << std::endl;
+  }
+  return (!block_hashes.empty() &&
+          (fork_height != block_hashes.rbegin()->first));
+}
+
+void BitcoinInterface::RollbackHistoryCache(size_t fork_height) {
+  std::lock_guard<std::mutex> lock(history_cache_lock_);
+  const auto fork_block = block_hashes_.upper_bound(fork_height);
+  block_hashes_.erase(fork_block, block_hashes_.end());
+  if (block_hashes_.empty()) {
+    std::cout << "Reorganisation deeper than "
+              << megabit::constants::max_reorg_depth
+              << " blocks, dropping the history cache" << std::endl;
+    history_cache_.clear();
+    history_cache_rows_ = 0;
+    history_heights_.clear();
+    history_cache_height_ = 0;
+    return;
+  }
+
+  const auto fork_heights = history_heights_.upper_bound(fork_height);
+  std::set<libbitcoin::short_hash> touched;
+  for (auto it = fork_heights; it != history_heights_.end(); ++it) {
+    touched.insert(it->second.begin(), it->second.end());
+  }
+  history_heights_.erase(fork_heights, history_heights_.end());
+
+  const auto orphaned = [fork_height](size_t row_height) {
+    return (row_height > fork_height) &&
+           (row_height != megabit::constants::unspent_height);
   };
+  for (const auto& key_hash : touched) {
+    const auto it = history_cache_.find(key_hash);
+    if (it == history_cache_.end()) {
+      continue;
+    }
+
+    auto& rows = it->second.rows;
+    const auto num_rows = rows.size();
+    rows.erase(
+        std::remove_if(rows.begin(), rows.end(),
+                       [&orphaned](const libbitcoin::chain::history& row) {
+                         return orphaned(row.output_height);
+                       }),
+        rows.end());
+    history_cache_rows_ -= num_rows - rows.size();
+    for (auto& row : rows) {
+      if (orphaned(row.spend_height)) {
+        row.spend = {libbitcoin::null_hash, megabit::constants::unspent_index};
+        row.spend_height = megabit::constants::unspent_height;
+      }
+    }
+    it->second.stale = true;
+  }
+
+  // no history holds rows above the fork any more, but each was
+  // complete up to the old sync height, and is only complete up to
+  // the fork now
+  for (auto& entry : history_cache_) {
+    entry.second.height = std::min(entry.second.height, fork_height);
+  }
+  history_cache_height_ = std::min(history_cache_height_, fork_height);
+  std::cout << "Rolled back " << touched.size() << " histories to block "
+            << fork_height << std::endl;
+}
+
+void BitcoinInterface::RecordBlockHash(size_t height,
+                                       const libbitcoin::hash_digest& hash) {
+  if (hash == libbitcoin::null_hash) {
+    return;
+  }
+
+  block_hashes_[height] = hash;
+  if (height > megabit::constants::max_reorg_depth) {
+    const auto floor = height - megabit::constants::max_reorg_depth;
+    block_hashes_.erase(block_hashes_.begin(),
+                        block_hashes_.lower_bound(floor));
+    history_heights_.erase(history_heights_.begin(),
+                           history_heights_.lower_bound(floor));
+  }
+}
+
+bool BitcoinInterface::ScanBlocks(size_t from_height, size_t to_height,
+                                  const BlockScanner& scanner,
+                                  std::set<libbitcoin::short_hash>& touched) {
+  using TxResult = std::pair<bool, libbitcoin::chain::transaction>;
+
+  for (auto height = from_height; height <= to_height; height++) {
+    libbitcoin::hash_list tx_hashes;
+    if (!FetchBlockTransactionHashes(height, tx_hashes)) {
+      return false;
+    }
+
+    // the transactions of a block are requested together
+    std::vector<std::future<TxResult>> requests;
+    requests.reserve(tx_hashes.size());
+    for (const auto& tx_hash : tx_hashes) {
+      requests.push_back(
+          request_executor_.Submit<TxResult>([this, tx_hash]() {
+            TxResult result{false, {}};
+            result.first = FetchTransaction(tx_hash, result.second);
+            return result;
+          }));
+    }
+
+    auto ret = true;
+    for (auto& request : requests) {
+      const auto result = request.get();
+      ret = ret && result.first;
+      if (!result.first) {
+        continue;
+      }
+
+      for (const auto& key_hash : GetTransactionKeyHashes(result.second)) {
+        if (scanner.Matches(key_hash)) {
+          touched.insert(key_hash);
+        }
+      }
+      for (const auto& input : result.second.inputs()) {
+        libbitcoin::short_hash key_hash;
+        if (scanner.Matches(input.previous_output(), key_hash)) {
+          touched.insert(key_hash);
+        }
+      }
+    }
+    if (!ret) {
+      return false;
+    }
+
+    scan_transactions_per_block_ = 0.8 * scan_transactions_per_block_ +
+                                   0.2 * static_cast<double>(tx_hashes.size());
+  }
+  return true;
+}
+
+void BitcoinInterface::InvalidateHistories(
+    const std::vector<libbitcoin::short_hash>& key_hashes) {
+  std::lock_guard<std::mutex> lock(history_cache_lock_);
+  for (const auto& key_hash : key_hashes) {
+    const auto it = history_cache_.find(key_hash);
+    if (it != history_cache_.end()) {
+      it->second.stale = true;
+    }
+  }
+}
+
+void BitcoinInterface::InvalidateAddressHistory(const std::string& address) {
+  InvalidateHistories({GetQueryAddress(address).hash()});
+}
+
+libbitcoin::chain::points_value
+BitcoinInterface::GetUnspentOutputsForAccountIndex(
+    const uint32_t account_index, UnspentList& unspent_list,
+    libbitcoin::wallet::payment_address& change_address,
+    std::vector<std::string>* excluded) {
+  std::cout << "GetUnspentOutputsForAccountIndex called" << std::endl;
+  SyncHistoryCache();
+  auto assigned_change_address = false;
+  libbitcoin::chain::points_value unspent{};
+
+  const auto cur_height = block_height_;
+  // internal == 0 indicates a receive address
+  // internal == 1 indicates a change address
+  for (size_t internal = 0; internal < 2; internal++) {
+    for (size_t k = 0; k < gap_limit_; k++) {
+      const auto key = GetKey(account_index, internal, k);
+      const auto address = GetEncodedAddress(account_index, key);
+
+      // if this address has been excluded by user input, do
+      // not consider it for return here
+      if (excluded) {
+        bool addr_excluded = false;
+        for (const auto& addr : *excluded) {
+          if (addr == address) {
+            addr_excluded = true;
+            break;
+          }
+        }
+
+        if (addr_excluded) {
+          std::cout << "Skipping utxos for address " << address
+                    << " in mix depth " << account_index
+                    << " due to user specified exclusion" << std::endl;
+          continue;
+        }
+      }
+
+      AddressHistory history{};
+      if (!GetAddressHistory(key.secret(), history)) {
+        break;
+      }
+
+      // the change of our own unconfirmed transactions is not in the
+      // history (yet)
+      const auto unconfirmed_change =
+          (internal ? GetUnconfirmedChange(key)
+                    : AddressHistory::InternalList{});
+
+      if (history.is_spent() && unconfirmed_change.empty()) {
+        continue;
+      }
+
+      if (internal && !assigned_change_address) {
+        change_address = libbitcoin::wallet::payment_address(
+            libbitcoin::wallet::ec_public(key), payment_address_version_);
+        assigned_change_address = true;
+
+        std::cout << "Sending change to " << address << std::endl;
+      }
+
+      for (const auto& transfer : history.transfers) {
+        const auto confirmed = transfer.confirmed(cur_height);
+        if (confirmed) {
+          ForgetBroadcastTransaction(transfer.output.hash());
+        }
+
+        if ((confirmed || IsSpendableUnconfirmed(transfer.output)) &&
+            !transfer.is_spent() && !IsReserved(transfer.output)) {
+          std::cout << "Adding unspent for account index " << account_index
+                    << " with hash "
+                    << libbitcoin::encode_base16(transfer.output.hash())
+                    << " and value " << transfer.value << std::endl;
+
+          unspent.points.push_back({transfer.output, transfer.value});
+          unspent_list.push_back({key, transfer});
+        }
+      }
+
+      for (const auto& transfer : unconfirmed_change) {
+        const auto in_history = std::any_of(
+            history.transfers.begin(), history.transfers.end(),
+            [&transfer](const AddressHistory::Internal& other) {
+              return (other.output == transfer.output);
+            });
+        if (in_history || !IsSpendableUnconfirmed(transfer.output) ||
+            IsReserved(transfer.output)) {
+          continue;
+        }
+
+        std::cout << "Adding unconfirmed change for account index "
+                  << account_index << " with hash "
+                  << libbitcoin::encode_base16(transfer.output.hash())
+                  << " and value " << transfer.value << std::endl;
+
+        unspent.points.push_back({transfer.output, transfer.value});
+        unspent_list.push_back({key, transfer});
+      }
+    }
+  }
+  return unspent;
+}
+
+std::shared_ptr<PendingTransaction> BitcoinInterface::CreatePendingPayment(
+    const uint32_t account_index, uint64_t& amount,
+    const PaymentDestination destination_address,
+    const uint64_t target_fee_per_kb, bool subtract_fee_from_amount,
+    bool signal_rbf) {
+  RequestExecutor::PriorityScope priority(RequestPriority::interactive_send);
+  uint64_t change_amount = 0;
+  UnspentList selected_unspent_list;
+  libbitcoin::wallet::payment_address change_address{};
+
+  // NOTE: unless we're subtracting the fee from the amount this
+  // retrieves utxos that satisfy the amount + a fee of
+  // 0.5KB.  It may not be a good enough estimate for all cases, and
+  // may be a terrible estimate in others (perhaps causing funds to be
+  // arbitrarily trapped for no reason).  If you find yourself in this
+  // situation, adjust this value accordingly.
+  auto adjusted_amount =
+      (subtract_fee_from_amount ? amount : amount + (target_fee_per_kb / 2));
+
+  std::cout << "Send Payment called with amount " << amount
+            << ", but searching for utxos to satisfy the amount of "
+            << adjusted_amount << " to account for an estimated fee"
+            << std::endl;
+
+  auto ret = RetrieveAndReserveUnspent(selected_unspent_list, change_address,
+                                       change_amount, account_index,
+                                       adjusted_amount);
+
+  std::cout << "retrieve unspent and change address returned: " << ret
+            << " and change address " << change_address.encoded() << std::endl;
+  if (!ret) {
+    return nullptr;
+  }
+
+  try {
+    // FIXME: if the amount was adjusted, is this right in all cases?
+    if (!subtract_fee_from_amount &&
+        (adjusted_amount != amount + (target_fee_per_kb / 2))) {
+      std::cout << "adjusted amount " << adjusted_amount
+                << " != " << (amount + (target_fee_per_kb / 2)) << std::endl;
+      amount = adjusted_amount - (target_fee_per_kb / 2);
+      std::cout << "re adjusted amount to " << amount << std::endl;
+    }
+
+    auto tx = CreateSignedTransaction(
+        selected_unspent_list, amount, destination_address, target_fee_per_kb,
+        change_amount, change_address, subtract_fee_from_amount, signal_rbf);
+
+    return std::make_shared<PendingTransaction>(
+        tx, selected_unspent_list, amount, destination_address,
+        target_fee_per_kb, change_amount, change_address,
+        subtract_fee_from_amount);
+  } catch (const std::runtime_error&) {
+    ReleaseUnspent(selected_unspent_list);
+    throw;
+  }
+}
+
+std::shared_ptr<PendingTransaction>
+BitcoinInterface::CreatePendingBatchPayment(const uint32_t account_index,
+                                            const RecipientList& recipients,
+                                            const uint64_t target_fee_per_kb,
+                                            bool signal_rbf) {
+  RequestExecutor::PriorityScope priority(RequestPriority::interactive_send);
+  if (recipients.empty() ||
+      (recipients.size() > megabit::constants::max_batch_recipients)) {
+    std::cout << "Batch payment requires between 1 and "
+              << megabit::constants::max_batch_recipients
+              << " recipients, got " << recipients.size() << std::endl;
+    return nullptr;
+  }
+
+  const auto start_time = std::chrono::steady_clock::now();
+
+  uint64_t amount = 0;
+  for (const auto& recipient : recipients) {
+    amount += recipient.second;
+  }
+
+  // search for utxos that satisfy the total amount plus a fee for
+  // every recipient output, our change output and 0.5KB worth of
+  // inputs (see the note in CreatePendingPayment)
+  const auto estimated_size =
+      megabit::constants::tx_overhead_size +
+      ((recipients.size() + 1) * megabit::constants::p2pkh_output_size) + 512;
+  const uint64_t estimated_fee =
+      target_fee_per_kb * (static_cast<float>(estimated_size) / 1024);
+  auto adjusted_amount = amount + estimated_fee;
+
+  std::cout << "Batch payment called for " << recipients.size()
+            << " recipients with total amount " << amount
+            << ", but searching for utxos to satisfy the amount of "
+            << adjusted_amount << " to account for an estimated fee"
+            << std::endl;
+
+  uint64_t change_amount = 0;
+  UnspentList selected_unspent_list;
+  libbitcoin::wallet::payment_address change_address{};
+  if (!RetrieveAndReserveUnspent(selected_unspent_list, change_address,
+                                 change_amount, account_index,
+                                 adjusted_amount)) {
+    return nullptr;
+  }
+
+  // the estimated fee is held in the change until the real fee is
+  // known after the transaction has been constructed
+  change_amount += estimated_fee;
+
+  const auto selected_time = std::chrono::steady_clock::now();
+
+  libbitcoin::chain::transaction tx;
+  try {
+    tx = CreateSignedBatchTransaction(selected_unspent_list, recipients,
+                                      target_fee_per_kb, change_amount,
+                                      change_address, signal_rbf);
+  } catch (const std::runtime_error&) {
+    ReleaseUnspent(selected_unspent_list);
+    throw;
+  }
+
+  const auto end_time = std::chrono::steady_clock::now();
+  const auto selection_ms =
+      std::chrono::duration_cast<std::chrono::milliseconds>(selected_time -
+                                                            start_time)
+          .count();
+  const auto build_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                            end_time - selected_time)
+                            .count();
+  const auto total_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                            end_time - start_time)
+                            .count();
+  std::cout << "Batch of " << recipients.size() << " recipients using "
+            << selected_unspent_list.size() << " inputs constructed in "
+            << total_ms << " ms (coin selection " << selection_ms
+            << " ms, build and sign " << build_ms << " ms, "
+            << ((recipients.size() * 1000) / std::max<int64_t>(total_ms, 1))
+            << " recipients/sec)" << std::endl;
+
+  return std::make_shared<PendingTransaction>(
+      tx, selected_unspent_list, recipients, amount, target_fee_per_kb,
+      change_amount, change_address);
+}
+
+std::shared_ptr<PendingTransaction> BitcoinInterface::CreateReplacementPayment(
+    const PendingTransaction& original, const uint64_t target_fee_per_kb) {
+  RequestExecutor::PriorityScope priority(RequestPriority::interactive_send);
+  std::stringstream error_msg;
+  if (!original.signals_rbf()) {
+    throw std::runtime_error(
+        "The transaction cannot be replaced since it does not signal "
+        "replace-by-fee");
+  }
+
+  // the change of the original may have been spent by a later
+  // payment, which the replacement would silently invalidate
+  if (HasOutputsInUse(original.tx)) {
+    throw std::runtime_error(
+        "The transaction cannot be replaced since its change is being "
+        "spent by another payment");
+  }
+
+  // bip125: the replacement must pay more than the original fee, plus
+  // the incremental relay fee for its own size.  It's about the same
+  // size as the original, so the fee rate is raised to at least the
+  // original rate plus the incremental rate
+  const auto original_fee = original.fee();
+  const auto original_size = GetVirtualSize(original.tx);
+  const uint64_t min_fee_per_kb =
+      ((original_fee * 1024) / original_size) +
+      megabit::constants::incremental_relay_fee_per_kb;
+  const auto fee_per_kb = std::max(target_fee_per_kb, min_fee_per_kb);
+
+  std::cout << "Replacing transaction with a fee of " << original_fee
+            << " using a fee rate of " << fee_per_kb << " per KB"
+            << std::endl;
+
+  // everything that isn't paid to the recipients is change before
+  // the new fee is applied
+  const auto input_amount = original.input_amount();
+  std::shared_ptr<PendingTransaction> replacement;
+  if (original.is_batch()) {
+    uint64_t change_amount = input_amount - original.amount;
+    const auto tx = CreateSignedBatchTransaction(
+        original.selected_unspent_list, original.recipients, fee_per_kb,
+        change_amount, original.change_address, true);
+
+    replacement = std::make_shared<PendingTransaction>(
+        tx, original.selected_unspent_list, original.recipients,
+        original.amount, fee_per_kb, change_amount, original.change_address);
+  } else {
+    // when the fee was subtracted from the amount, the amount is
+    // restored before the new fee is subtracted again
+    uint64_t amount =
+        (original.subtract_fee_from_amount
+             ? (input_amount - original.change_amount)
+             : original.amount);
+    const auto change_amount = input_amount - amount;
+    const auto tx = CreateSignedTransaction(
+        original.selected_unspent_list, amount, original.destination_address,
+        fee_per_kb, change_amount, original.change_address,
+        original.subtract_fee_from_amount, true);
+
+    replacement = std::make_shared<PendingTransaction>(
+        tx, original.selected_unspent_list, amount,
+        original.destination_address, fee_per_kb, change_amount,
+        original.change_address, original.subtract_fee_from_amount);
+  }
+
+  const uint64_t min_fee =
+      original_fee + (megabit::constants::incremental_relay_fee_per_kb *
+                      (static_cast<float>(GetVirtualSize(replacement->tx)) /
+                       1024));
+  if (replacement->fee() < min_fee) {
+    error_msg << "The replacement fee of " << replacement->fee()
+              << " is below the minimum replacement fee of " << min_fee
+              << std::endl;
+    throw std::runtime_error(error_msg.str());
+  }
+
+  std::cout << "Replacement transaction pays a fee of " << replacement->fee()
+            << std::endl;
+  return replacement;
+}
+
+std::shared_ptr<PendingTransaction>
+BitcoinInterface::CreateChildPaysForParentPayment(
+    const uint32_t account_index, const PendingTransaction& parent,
+    const uint64_t target_fee_per_kb) {
+  std::stringstream error_msg;
+
+  // find the change output of the parent, and the key it pays to
+  const auto change_script = GetOutputScript(parent.change_address);
+  uint32_t change_index = std::numeric_limits<uint32_t>::max();
+  for (uint32_t i = 0; i < parent.tx.outputs().size(); i++) {
+    if (parent.tx.outputs()[i].script() == change_script) {
+      change_index = i;
+      break;
+    }
+  }
+
+  if (change_index == std::numeric_limits<uint32_t>::max()) {
+    throw std::runtime_error(
+        "The transaction has no change output that can pay for a child");
+  }
+
+  libbitcoin::ec_secret change_key{};
+  auto found_key = false;
+  for (size_t k = 0; k < gap_limit_; k++) {
+    const auto key = GetKey(account_index, 1, k);
+    if (GetKeyHash(key) == parent.change_address.hash()) {
+      change_key = key.secret();
+      found_key = true;
+      break;
+    }
+  }
+
+  if (!found_key) {
+    throw std::runtime_error("Cannot find the key of the change address");
+  }
+
+  const auto change_value = parent.tx.outputs()[change_index].value();
+  const AddressHistory::Internal transfer{
+      {parent.tx.hash(), change_index},
+      megabit::constants::unspent_height,
+      {libbitcoin::null_hash, megabit::constants::unspent_index},
+      megabit::constants::unspent_height,
+      change_value};
+  const UnspentList unspent{{change_key, transfer}};
+
+  if (!ReserveUnspent(unspent)) {
+    throw std::runtime_error("The change output is already being spent");
+  }
+
+  try {
+    // the child is built once at the target fee rate to find its
+    // size, then rebuilt at the rate that makes both transactions
+    // together pay the target fee rate
+    uint64_t amount = change_value;
+    const auto sized_tx = CreateSignedTransaction(
+        unspent, amount, parent.change_address, target_fee_per_kb, 0,
+        parent.change_address, true, true);
+
+    const auto child_size = GetVirtualSize(sized_tx);
+    const auto package_size = GetVirtualSize(parent.tx) + child_size;
+    const uint64_t package_fee =
+        target_fee_per_kb * (static_cast<float>(package_size) / 1024);
+    const auto parent_fee = parent.fee();
+    if (package_fee <= parent_fee) {
+      error_msg << "The transaction already pays a fee of " << parent_fee
+                << ", which is at least the target fee of " << package_fee
+                << std::endl;
+      throw std::runtime_error(error_msg.str());
+    }
+
+    const auto child_fee = package_fee - parent_fee;
+    if (change_value < (child_fee + megabit::constants::dust_threshold)) {
+      error_msg << "The change amount of " << change_value
+                << " cannot pay the child fee of " << child_fee << std::endl;
+      throw std::runtime_error(error_msg.str());
+    }
+
+    const uint64_t child_fee_per_kb = ((child_fee * 1024) / child_size) + 1;
+    amount = change_value;
+    const auto tx = CreateSignedTransaction(
+        unspent, amount, parent.change_address, child_fee_per_kb, 0,
+        parent.change_address, true, true);
+
+    std::cout << "Child transaction pays a fee of " << (change_value - amount)
+              << " for a package of " << package_size << " bytes"
+              << std::endl;
+
+    return std::make_shared<PendingTransaction>(
+        tx, unspent, amount, parent.change_address, child_fee_per_kb, 0,
+        parent.change_address, true);
+  } catch (const std::runtime_error&) {
+    ReleaseUnspent(unspent);
+    throw;
+  }
+}
+
+bool BitcoinInterface::LoadRecipientsFromCsv(const std::string& file_name,
+                                             RecipientList& recipients,
+                                             std::string& error) {
+  std::ifstream csv_file(file_name);
+  if (!csv_file) {
+    error = "Cannot open " + file_name;
+    return false;
+  }
+
+  RecipientList parsed;
+  std::string line;
+  size_t line_number = 0;
+  while (std::getline(csv_file, line)) {
+    ++line_number;
+    boost::algorithm::trim(line);
+    if (line.empty() || (line[0] == '#')) {
+      continue;
+    }
+
+    const auto line_str = "line " + std::to_string(line_number) + ": ";
+    const auto separator = line.find(',');
+    if (separator == std::string::npos) {
+      error = line_str + "expected \"address,amount\"";
+      return false;
+    }
+
+    const auto address_str =
+        boost::algorithm::trim_copy(line.substr(0, separator));
+    const auto amount_str =
+        boost::algorithm::trim_copy(line.substr(separator + 1));
+
+    PaymentDestination destination;
+    if (!GetPaymentDestination(address_str, destination)) {
+      error = line_str + "invalid address " + address_str;
+      return false;
+    }
+
+    uint64_t amount = 0;
+    if (!libbitcoin::decode_base10(amount, amount_str,
+                                   libbitcoin::btc_decimal_places) ||
+        (amount < megabit::constants::dust_threshold)) {
+      error = line_str + "invalid amount " + amount_str;
+      return false;
+    }
+
+    parsed.emplace_back(destination, amount);
+  }
+
+  if (parsed.empty()) {
+    error = "No recipients found in " + file_name;
+    return false;
+  }
+
+  std::cout << "Loaded " << parsed.size() << " recipients from " << file_name
+            << std::endl;
+  recipients.swap(parsed);
+  return true;
+}
+
+bool BitcoinInterface::ValidatePendingTransaction(
+    const PendingTransaction& pending_transaction) {
+  RequestExecutor::PriorityScope priority(RequestPriority::interactive_send);
+  return TransactionIsValid(pending_transaction.tx);
+}
+
+bool BitcoinInterface::BroadcastPendingTransaction(
+    const PendingTransaction& pending_transaction) {
+  RequestExecutor::PriorityScope priority(RequestPriority::interactive_send);
+  // the pending tx is fully signed when it is constructed, so it's
+  // broadcast as is rather than being re-created
+  return SendTransaction(pending_transaction.tx);
+}
 
-  if (unconfirmed) {
-    client_.transaction_pool_fetch_transaction(on_error, on_done, tx_hash);
-  } else {
-    client_.blockchain_fetch_transaction(on_error, on_done, tx_hash);
+bool BitcoinInterface::RetrieveAndReserveUnspent(
+    UnspentList& selected_unspent,
+    libbitcoin::wallet::payment_address& change_address,
+    uint64_t& change_amount, const uint32_t account_index, uint64_t& amount) {
+  // reserved utxos are never selected, but a concurrent payment may
+  // have reserved some of ours between selection and reservation, in
+  // which case the selection is simply repeated
+  for (size_t attempt = 0;
+       attempt < megabit::constants::max_reservation_attempts; attempt++) {
+    auto cur_amount = amount;
+    UnspentList cur_selected_unspent;
+    if (!RetrieveUnspentAndChangeAddress(cur_selected_unspent, change_address,
+                                         change_amount, account_index,
+                                         cur_amount)) {
+      return false;
+    }
+
+    if (ReserveUnspent(cur_selected_unspent)) {
+      amount = cur_amount;
+      selected_unspent.swap(cur_selected_unspent);
+      return true;
+    }
+
+    std::cout << "Selected utxos were reserved by another payment, "
+              << "retrying selection" << std::endl;
   }
-  client_.wait();
+  return false;
+}
 
-  if (ret && !unconfirmed) {
-    /* MEGABIT_ASSERT(tx_hash == tx_block_info.tx.hash()); */
+bool BitcoinInterface::ReserveUnspent(const UnspentList& unspent_list) {
+  std::lock_guard<std::mutex> lock(reservation_lock_);
+  for (const auto& unspent : unspent_list) {
+    if (reserved_unspent_.count(unspent.second.output)) {
+      return false;
+    }
+  }
 
-    client_.blockchain_fetch_transaction_index(on_error, on_fetch_tx_index_done,
-                                               tx_block_info.tx.hash());
-    client_.wait();
+  for (const auto& unspent : unspent_list) {
+    reserved_unspent_.insert(unspent.second.output);
+  }
+  return true;
+}
 
-    if (ret) {
-      std::cout << "about to fetch block header of height: "
-                << tx_block_info.height << std::endl;
-      client_.blockchain_fetch_block_header(
-          on_error, on_fetch_header_done,
-          ((tx_block_info.height > 0) ? tx_block_info.height : block_height_));
-      client_.wait();
+void BitcoinInterface::ReleaseUnspent(const UnspentList& unspent_list) {
+  {
+    std::lock_guard<std::mutex> lock(reservation_lock_);
+    for (const auto& unspent : unspent_list) {
+      reserved_unspent_.erase(unspent.second.output);
     }
   }
-  return ret;
+
+  // the payment spending them was canceled or failed
+  std::lock_guard<std::mutex> lock(prevout_lock_);
+  for (const auto& unspent : unspent_list) {
+    prevout_cache_.erase(unspent.second.output);
+  }
 }
 
-void BitcoinInterface::GetBlockHeight(ErrorHandler on_error,
-                                      BlockHeightHandler handler) {
-  // this is called from a thread, so it uses a completely different
-  // connection to avoid any network corruption
-  block_height_client_.blockchain_fetch_last_height(on_error, handler);
-  block_height_client_.wait();
+void BitcoinInterface::ReleaseSpentReservations(
+    const libbitcoin::chain::transaction& tx) {
+  std::lock_guard<std::mutex> lock(reservation_lock_);
+  for (const auto& input : tx.inputs()) {
+    reserved_unspent_.erase(input.previous_output());
+  }
 }
 
-void BitcoinInterface::SetBlockHeight(const size_t block_height) {
-  block_height_ = block_height;
+bool BitcoinInterface::IsReserved(const libbitcoin::chain::point& point) {
+  std::lock_guard<std::mutex> lock(reservation_lock_);
+  return (reserved_unspent_.count(point) != 0);
 }
 
-libbitcoin::chain::points_value
-BitcoinInterface::GetUnspentOutputsForAccountIndex(
-    const uint32_t account_index, UnspentList& unspent_list,
-    libbitcoin::wallet::payment_address& change_address,
-    std::vector<std::string>* excluded) {
-  std::cout << "GetUnspentOutputsForAccountIndex called" << std::endl;
-  auto assigned_change_address = false;
-  libbitcoin::chain::points_value unspent{};
+void BitcoinInterface::TrackBroadcastTransaction(
+    const libbitcoin::chain::transaction& tx) {
+  std::lock_guard<std::mutex> lock(broadcast_lock_);
+
+  // a transaction spending the same outputs as one we're tracking
+  // (i.e. a replacement) supersedes it
+  for (auto iter = broadcast_transactions_.begin();
+       iter != broadcast_transactions_.end();) {
+    const auto& tracked_inputs = iter->second.tx.inputs();
+    const auto conflicts = std::any_of(
+        tx.inputs().begin(), tx.inputs().end(),
+        [&tracked_inputs](const libbitcoin::chain::input& input) {
+          return std::any_of(
+              tracked_inputs.begin(), tracked_inputs.end(),
+              [&input](const libbitcoin::chain::input& tracked_input) {
+                return (tracked_input.previous_output() ==
+                        input.previous_output());
+              });
+        });
+    iter = (conflicts ? broadcast_transactions_.erase(iter) : std::next(iter));
+  }
 
-  const auto cur_height = block_height_;
-  // internal == 0 indicates a receive address
-  // internal == 1 indicates a change address
-  for (size_t internal = 0; internal < 2; internal++) {
-    for (size_t k = 0; k < gap_limit_; k++) {
-      const auto key = GetKey(account_index, internal, k);
-      const auto address = megabit::utils::bitcoin_address(
-          libbitcoin::wallet::ec_public(key), payment_address_version_);
+  // the chain grows by one past the deepest unconfirmed parent
+  size_t chain_depth = 1;
+  for (const auto& input : tx.inputs()) {
+    const auto parent_iter =
+        broadcast_transactions_.find(input.previous_output().hash());
+    if (parent_iter != broadcast_transactions_.end()) {
+      chain_depth = std::max(chain_depth, parent_iter->second.chain_depth + 1);
+    }
+  }
 
-      // if this address has been excluded by user input, do
-      // not consider it for return here
-      if (excluded) {
-        bool addr_excluded = false;
-        for (const auto& addr : *excluded) {
-          if (addr == address) {
-            addr_excluded = true;
-            break;
-          }
-        }
+  broadcast_transactions_[tx.hash()] = {tx, chain_depth};
+  std::cout << "Tracking broadcast transaction at unconfirmed chain depth "
+            << chain_depth << std::endl;
+}
 
-        if (addr_excluded) {
-          std::cout << "Skipping utxos for address " << address
-                    << " in mix depth " << account_index
-                    << " due to user specified exclusion" << std::endl;
-          continue;
-        }
-      }
+void BitcoinInterface::ForgetBroadcastTransaction(
+    const libbitcoin::hash_digest& tx_hash) {
+  std::lock_guard<std::mutex> lock(broadcast_lock_);
+  broadcast_transactions_.erase(tx_hash);
+}
 
-      AddressHistory history{};
-      if (!GetAddressHistory(key.secret(), history)) {
-        break;
+bool BitcoinInterface::GetBroadcastTransaction(
+    const libbitcoin::hash_digest& tx_hash,
+    libbitcoin::chain::transaction& tx) {
+  std::lock_guard<std::mutex> lock(broadcast_lock_);
+  const auto iter = broadcast_transactions_.find(tx_hash);
+  if (iter == broadcast_transactions_.end()) {
+    return false;
+  }
+  tx = iter->second.tx;
+  return true;
+}
+
+bool BitcoinInterface::IsSpendableUnconfirmed(
+    const libbitcoin::chain::point& point) {
+  std::lock_guard<std::mutex> lock(broadcast_lock_);
+  if (!unconfirmed_spend_policy_.spend_unconfirmed_change) {
+    return false;
+  }
+
+  // spending the output extends its chain by one
+  const auto iter = broadcast_transactions_.find(point.hash());
+  return ((iter != broadcast_transactions_.end()) &&
+          (iter->second.chain_depth <
+           unconfirmed_spend_policy_.max_chain_depth));
+}
+
+bool BitcoinInterface::HasOutputsInUse(
+    const libbitcoin::chain::transaction& tx) {
+  const auto tx_hash = tx.hash();
+  {
+    std::lock_guard<std::mutex> lock(reservation_lock_);
+    for (uint32_t i = 0; i < tx.outputs().size(); i++) {
+      if (reserved_unspent_.count({tx_hash, i})) {
+        return true;
       }
+    }
+  }
 
-      if (history.is_spent()) {
-        continue;
+  std::lock_guard<std::mutex> lock(broadcast_lock_);
+  for (const auto& tracked : broadcast_transactions_) {
+    for (const auto& input : tracked.second.tx.inputs()) {
+      if (input.previous_output().hash() == tx_hash) {
+        return true;
       }
+    }
+  }
+  return false;
+}
 
-      if (internal && !assigned_change_address) {
-        change_address = libbitcoin::wallet::payment_address(
-            libbitcoin::wallet::ec_public(key), payment_address_version_);
-        assigned_change_address = true;
+AddressHistory::InternalList BitcoinInterface::GetUnconfirmedChange(
+    const libbitcoin::wallet::hd_private& key) {
+  const auto change_script = GetOutputScript(
+      libbitcoin::wallet::payment_address(GetKeyHash(key),
+                                          payment_address_version_));
+
+  AddressHistory::InternalList transfers;
+  std::lock_guard<std::mutex> lock(broadcast_lock_);
+  for (const auto& broadcast : broadcast_transactions_) {
+    const auto& outputs = broadcast.second.tx.outputs();
+    for (uint32_t i = 0; i < outputs.size(); i++) {
+      if (outputs[i].script() == change_script) {
+        transfers.emplace_back(
+            libbitcoin::chain::output_point{broadcast.first, i},
+            megabit::constants::unspent_height,
+            libbitcoin::chain::input_point{libbitcoin::null_hash,
+                                           megabit::constants::unspent_index},
+            megabit::constants::unspent_height, outputs[i].value());
+      }
+    }
+  }
+  return transfers;
+}
 
-        std::cout << "Sending change to "
-                  << megabit::utils::bitcoin_address(
-                         libbitcoin::wallet::ec_public(key),
-                         payment_address_version_)
-                  << std::endl;
+libbitcoin::wallet::payment_address BitcoinInterface::GetUnusedChangeAddress(
+    const uint32_t account_index,
+    const std::set<libbitcoin::short_hash>& excluded) {
+  const auto is_witness =
+      (GetAccountType(account_index) == AccountType::bip84);
+  size_t cur_gap_limit = gap_limit_;
+  for (size_t index = 0; index < cur_gap_limit; index++) {
+    const auto key = GetKey(account_index, 1, index);
+    const auto key_hash = GetKeyHash(key);
+    // addresses past the gap limit aren't cached with the account
+    {
+      std::lock_guard<std::mutex> lock(key_hash_lock_);
+      if (is_witness) {
+        witness_key_hashes_.insert(key_hash);
       }
+      key_hash_accounts_[key_hash] = account_index;
+    }
 
-      for (const auto& transfer : history.transfers) {
-        // FIXME: relax confirmed check here?
-        if (transfer.confirmed(cur_height) && !transfer.is_spent()) {
-          std::cout << "Adding unspent for account index " << account_index
-                    << " with hash "
-                    << libbitcoin::encode_base16(transfer.output.hash())
-                    << " and value " << transfer.value << std::endl;
+    AddressHistory history{};
+    if (!GetAddressHistory(key.secret(), history)) {
+      return {};
+    }
 
-          unspent.points.push_back({transfer.output, transfer.value});
-          unspent_list.push_back({key, transfer});
-        }
-      }
+    if (excluded.count(key_hash) || history.total_value ||
+        history.is_spent() || !GetUnconfirmedChange(key).empty()) {
+      ++cur_gap_limit;
+      continue;
     }
+
+    internal_address_cache_.insert(GetEncodedAddress(account_index, key));
+    return libbitcoin::wallet::payment_address(key_hash,
+                                               payment_address_version_);
   }
-  return unspent;
+  return {};
 }
 
-bool BitcoinInterface::InitiateSendPayment(
-    const uint32_t account_index, uint64_t& amount,
-    const libbitcoin::wallet::payment_address destination_address,
-    const uint64_t target_fee_per_kb, bool subtract_fee_from_amount) {
+bool BitcoinInterface::ConsolidateUnspent(const uint32_t account_index,
+                                          const uint64_t target_fee_per_kb,
+                                          const ConsolidationPolicy& policy,
+                                          size_t& num_transactions) {
+  num_transactions = 0;
+  if (target_fee_per_kb > policy.max_fee_per_kb) {
+    std::cout << "Skipping consolidation of account index " << account_index
+              << ": fee of " << target_fee_per_kb << " per KB is above the "
+              << policy.max_fee_per_kb << " per KB threshold" << std::endl;
+    return true;
+  }
+
+  // an amount of 0 retrieves every available utxo in the account
+  uint64_t amount = 0;
   uint64_t change_amount = 0;
-  UnspentList selected_unspent_list;
+  UnspentList unspent_list;
   libbitcoin::wallet::payment_address change_address{};
+  if (!RetrieveUnspentAndChangeAddress(unspent_list, change_address,
+                                       change_amount, account_index, amount)) {
+    std::cout << "No utxos to consolidate in account index " << account_index
+              << std::endl;
+    return true;
+  }
 
-  // NOTE: unless we're subtracting the fee from the amount this
-  // retrieves utxos that satisfy the amount + a fee of
-  // 0.5KB.  It may not be a good enough estimate for all cases, and
-  // may be a terrible estimate in others (perhaps causing funds to be
-  // arbitrarily trapped for no reason).  If you find yourself in this
-  // situation, adjust this value accordingly.
-  auto adjusted_amount =
-      (subtract_fee_from_amount ? amount : amount + (target_fee_per_kb / 2));
+  // the fee required to spend a single p2pkh input at this rate
+  const uint64_t input_fee =
+      target_fee_per_kb *
+      (static_cast<float>(megabit::constants::p2pkh_input_size) / 1024);
 
-  std::cout << "Send Payment called with amount " << amount
-            << ", but searching for utxos to satisfy the amount of "
-            << adjusted_amount << " to account for an estimated fee"
-            << std::endl;
+  UnspentList candidates;
+  for (const auto& unspent : unspent_list) {
+    const auto value = unspent.second.value;
+    if (value > policy.max_utxo_value) {
+      continue;
+    }
+    if (value <= input_fee) {
+      std::cout << "Skipping uneconomical utxo of " << value
+                << " (costs " << input_fee << " to spend)" << std::endl;
+      continue;
+    }
+    candidates.push_back(unspent);
+  }
 
-  auto ret = RetrieveUnspentAndChangeAddress(selected_unspent_list,
-                                             change_address, change_amount,
-                                             account_index, adjusted_amount);
+  std::cout << "Consolidating " << candidates.size() << " of "
+            << unspent_list.size() << " utxos in account index "
+            << account_index << std::endl;
 
-  std::cout << "retrieve unspent and change address returned: " << ret
-            << " and change address " << change_address.encoded() << std::endl;
-  if (ret) {
-    // FIXME: if the amount was adjusted, is this right in all cases?
-    if (!subtract_fee_from_amount &&
-        (adjusted_amount != amount + (target_fee_per_kb / 2))) {
-      std::cout << "adjusted amount " << adjusted_amount
-                << " != " << (amount + (target_fee_per_kb / 2)) << std::endl;
-      amount = adjusted_amount - (target_fee_per_kb / 2);
-      std::cout << "re adjusted amount to " << amount << std::endl;
+  // each batch is paid to its own change address, so that the
+  // merged outputs can't be linked to each other
+  std::set<libbitcoin::short_hash> used_change;
+  const auto max_inputs = std::max<size_t>(policy.max_inputs_per_tx, 2);
+  for (size_t start = 0; start < candidates.size(); start += max_inputs) {
+    const auto end = std::min(start + max_inputs, candidates.size());
+
+    // merging a single utxo only costs a fee
+    if ((end - start) < 2) {
+      break;
     }
 
-    auto tx = CreateSignedTransaction(
-        selected_unspent_list, amount, destination_address, target_fee_per_kb,
-        change_amount, change_address, subtract_fee_from_amount);
+    const UnspentList selected(candidates.begin() + start,
+                               candidates.begin() + end);
+    uint64_t selected_amount = 0;
+    for (const auto& unspent : selected) {
+      selected_amount += unspent.second.value;
+    }
 
-    pending_transaction_ = std::make_shared<PendingTransaction>(
-        tx, selected_unspent_list, amount, destination_address,
-        target_fee_per_kb, change_amount, change_address,
-        subtract_fee_from_amount);
-  }
-  return ret;
-}
+    // these utxos may have been reserved by a payment since they
+    // were retrieved, in which case they're left for the next run
+    if (!ReserveUnspent(selected)) {
+      std::cout << "Skipping consolidation of reserved utxos" << std::endl;
+      continue;
+    }
+
+    const auto batch_address =
+        GetUnusedChangeAddress(account_index, used_change);
+    if (!batch_address) {
+      std::cout << "No unused change address available for consolidating "
+                << "account index " << account_index << std::endl;
+      ReleaseUnspent(selected);
+      return false;
+    }
+
+    const PaymentDestination destination{
+        batch_address.hash(), IsWitnessKeyHash(batch_address.hash())};
+    try {
+      auto tx = CreateSignedTransaction(selected, selected_amount, destination,
+                                        target_fee_per_kb, 0, batch_address,
+                                        true);
+
+      // the merged output couldn't be relayed
+      if (selected_amount < megabit::constants::dust_threshold) {
+        std::cout << "Skipping consolidation of " << selected.size()
+                  << " utxos worth " << selected_amount
+                  << " after the fee (below the dust threshold)"
+                  << std::endl;
+        ReleaseUnspent(selected);
+        continue;
+      }
+
+      if (!TransactionIsValid(tx) || !SendTransaction(tx)) {
+        ReleaseUnspent(selected);
+        return false;
+      }
+    } catch (const std::runtime_error&) {
+      ReleaseUnspent(selected);
+      throw;
+    }
 
-bool BitcoinInterface::SendPendingTransaction() {
-  return CreateAndBroadcastTransaction(
-      pending_transaction_->selected_unspent_list, pending_transaction_->amount,
-      pending_transaction_->destination_address,
-      pending_transaction_->target_fee_per_kb,
-      pending_transaction_->change_amount, pending_transaction_->change_address,
-      pending_transaction_->subtract_fee_from_amount);
+    used_change.insert(batch_address.hash());
+    std::cout << "Consolidated " << selected.size() << " utxos into "
+              << selected_amount << " at "
+              << GetDestinationString(destination) << std::endl;
+    ++num_transactions;
+  }
+  return true;
 }
 
 void BitcoinInterface::SignTransactionInputs(
     UnspentList unspent_list, libbitcoin::chain::transaction& output_tx) {
   std::cout << "SignTransactionInputs called" << std::endl;
+
+  // the bip143 midstate is shared by every witness input of the tx
+  const megabit::segwit::SighashCache sighash_cache(output_tx);
   for (auto& cur_unspent : unspent_list) {
     const auto& key = cur_unspent.first;
     const auto& transfer = cur_unspent.second;
@@ -850,13 +2989,23 @@ void BitcoinInterface::SignTransactionInputs(
       throw std::runtime_error("Error: our own utxo has been spent already");
     }
 
-    TxBlockInfo tx_block_info{};
-    GetTransactionInfo(transfer.output.hash(), tx_block_info);
-    const auto& previous_output_script =
-        tx_block_info.tx.outputs()[transfer.output.index()].script();
-
-    const auto address = megabit::utils::bitcoin_address(
-        previous_output_script, payment_address_version_);
+    // the output being spent may be unconfirmed (e.g. the change of
+    // one of our own broadcast transactions).  It's cached until the
+    // transaction confirms, so re-signing (e.g. a replacement) doesn't
+    // fetch it again.
+    libbitcoin::chain::output previous_output;
+    if (!GetCachedPrevout(transfer.output, previous_output)) {
+      TxBlockInfo tx_block_info{};
+      if (!GetBroadcastTransaction(transfer.output.hash(), tx_block_info.tx) &&
+          !GetTransactionInfo(transfer.output.hash(), tx_block_info) &&
+          !GetTransactionInfo(transfer.output.hash(), tx_block_info, true)) {
+        // FIXME: Handle without throwing
+        throw std::runtime_error("Cannot find the transaction of our own utxo");
+      }
+      previous_output = tx_block_info.tx.outputs()[transfer.output.index()];
+      CachePrevout(transfer.output, previous_output);
+    }
+    const auto& previous_output_script = previous_output.script();
 
     // set our signed script on the input, but first find the
     // input's index in the tx we're building
@@ -874,6 +3023,36 @@ void BitcoinInterface::SignTransactionInputs(
           "Cannot find our own input to sign in the transaction!");
     }
 
+    const auto pub_key_data = megabit::utils::public_from_private(key);
+
+    libbitcoin::short_hash key_hash;
+    if (megabit::segwit::is_pay_witness_key_hash(previous_output_script,
+                                                 key_hash)) {
+      // p2wpkh inputs commit to the spent value and carry the
+      // signature and public key in the witness (BIP143)
+      libbitcoin::endorsement tx_endorse;
+      if (!megabit::segwit::create_witness_endorsement(
+              tx_endorse, key, sighash_cache, input_index, key_hash,
+              transfer.value, sighash_type)) {
+        // FIXME: Handle without throwing
+        throw std::runtime_error("Failed to create witness tx endorsement");
+      }
+
+      auto& input = output_tx.inputs()[input_index];
+      input.set_script(libbitcoin::chain::script{});
+      input.set_witness(libbitcoin::chain::witness{
+          libbitcoin::data_stack{tx_endorse, pub_key_data}});
+
+      const auto ret = libbitcoin::chain::script::verify(
+          output_tx, input_index, libbitcoin::machine::rule_fork::all_rules,
+          previous_output_script, transfer.value);
+      if (ret != libbitcoin::error::success) {
+        // FIXME: Handle without throwing
+        throw std::runtime_error("Witness signature is invalid");
+      }
+      continue;
+    }
+
     // create endorsement for the input index we're about to
     // assign (all inputs must already be added to the tx for
     // this to work)
@@ -886,8 +3065,6 @@ void BitcoinInterface::SignTransactionInputs(
     }
 
     // create endorsement script
-    const auto pub_key_data = megabit::utils::public_from_private(key);
-
     std::stringstream script_ss;
     script_ss << "[" << libbitcoin::encode_base16(tx_endorse) << "] [";
     script_ss << libbitcoin::encode_base16(pub_key_data) << "]";
@@ -914,16 +3091,73 @@ void BitcoinInterface::SignTransactionInputs(
 uint64_t BitcoinInterface::GetCalculatedFee(
     const libbitcoin::chain::transaction& tx,
     const uint64_t target_fee_per_kb) {
-  const auto tx_size = static_cast<float>(tx.serialized_size());
+  // witness data is discounted, so the fee is based on the virtual
+  // size (which equals the serialized size for legacy transactions)
+  const auto tx_size = static_cast<float>(GetVirtualSize(tx));
   return target_fee_per_kb * static_cast<float>(tx_size / 1024);
 }
 
+size_t BitcoinInterface::GetVirtualSize(
+    const libbitcoin::chain::transaction& tx) const {
+  // rounded up, as relay policy does
+  const auto weight =
+      3 * tx.serialized_size(true, false) + tx.serialized_size(true, true);
+  return ((weight + 3) / 4);
+}
+
+size_t BitcoinInterface::GetSignedVirtualSize(
+    const libbitcoin::chain::transaction& tx,
+    const UnspentList& unspent) const {
+  size_t base_size = tx.serialized_size(true, false);
+  size_t witness_size = 0;
+  size_t p2pkh_inputs = 0;
+  for (const auto& cur_unspent : unspent) {
+    if (IsWitnessKeyHash(GetKeyHash(cur_unspent.first))) {
+      witness_size += megabit::constants::p2wpkh_witness_size;
+    } else {
+      base_size += megabit::constants::p2pkh_input_script_size;
+      ++p2pkh_inputs;
+    }
+  }
+
+  // every input of a witness transaction has a witness, which is a
+  // single (empty item count) byte for p2pkh inputs
+  if (witness_size) {
+    witness_size += megabit::constants::witness_marker_size + p2pkh_inputs;
+  }
+  return (((4 * base_size) + witness_size + 3) / 4);
+}
+
+std::vector<libbitcoin::short_hash> BitcoinInterface::GetTransactionKeyHashes(
+    const libbitcoin::chain::transaction& tx) const {
+  std::set<libbitcoin::short_hash> key_hashes;
+  for (const auto& output : tx.outputs()) {
+    libbitcoin::short_hash key_hash;
+    if (megabit::segwit::is_pay_witness_key_hash(output.script(), key_hash)) {
+      key_hashes.insert(key_hash);
+      continue;
+    }
+    for (const auto& address : libbitcoin::wallet::payment_address::extract(
+             output.script(), payment_address_version_)) {
+      key_hashes.insert(address.hash());
+    }
+  }
+
+  for (const auto& input : tx.inputs()) {
+    libbitcoin::short_hash key_hash;
+    if (GetInputKeyHash(input, key_hash)) {
+      key_hashes.insert(key_hash);
+    }
+  }
+  return {key_hashes.begin(), key_hashes.end()};
+}
+
 libbitcoin::chain::transaction BitcoinInterface::CreateSignedTransaction(
     const UnspentList& unspent, uint64_t& amount,
-    const libbitcoin::wallet::payment_address destination_address,
+    const PaymentDestination destination_address,
     const uint64_t target_fee_per_kb, const uint64_t change_amount,
     const libbitcoin::wallet::payment_address change_address,
-    bool subtract_fee_from_amount) {
+    bool subtract_fee_from_amount, bool signal_rbf) {
   std::stringstream error_msg;
 
   libbitcoin::chain::transaction tx;
@@ -934,12 +3168,9 @@ libbitcoin::chain::transaction BitcoinInterface::CreateSignedTransaction(
   libbitcoin::chain::output::list outputs;
 
   // add the destination output and change outputs (if any)
-  libbitcoin::machine::operation::list amount_payment_ops =
-      libbitcoin::chain::script::to_pay_key_hash_pattern(
-          destination_address.hash());
+  const auto amount_payment_script = GetOutputScript(destination_address);
 
-  const libbitcoin::chain::output output{
-      amount, libbitcoin::chain::script{amount_payment_ops}};
+  const libbitcoin::chain::output output{amount, amount_payment_script};
 
   outputs.push_back(output);
 
@@ -948,12 +3179,8 @@ libbitcoin::chain::transaction BitcoinInterface::CreateSignedTransaction(
     std::cout << "Using change amount of " << change_amount
               << " back to our self" << std::endl;
 
-    libbitcoin::machine::operation::list change_payment_ops =
-        libbitcoin::chain::script::to_pay_key_hash_pattern(
-            change_address.hash());
-
     const libbitcoin::chain::output change_output{
-        change_amount, libbitcoin::chain::script{change_payment_ops}};
+        change_amount, GetOutputScript(change_address)};
 
     outputs.push_back(change_output);
   }
@@ -964,7 +3191,8 @@ libbitcoin::chain::transaction BitcoinInterface::CreateSignedTransaction(
     MEGABIT_ASSERT(!transfer.is_spent());
 
     libbitcoin::chain::input input;
-    input.set_sequence(libbitcoin::max_input_sequence);
+    input.set_sequence(signal_rbf ? megabit::constants::rbf_input_sequence
+                                  : libbitcoin::max_input_sequence);
     input.set_previous_output(
         {transfer.output.hash(), transfer.output.index()});
 
@@ -985,13 +3213,9 @@ libbitcoin::chain::transaction BitcoinInterface::CreateSignedTransaction(
 
   // if we are expecting change back, pull the fee from there
   if (change_amount && (change_amount > estimated_fee)) {
-    libbitcoin::machine::operation::list change_payment_ops =
-        libbitcoin::chain::script::to_pay_key_hash_pattern(
-            change_address.hash());
-
     const uint64_t adjusted_amount = change_amount - estimated_fee;
     const libbitcoin::chain::output change_output{
-        adjusted_amount, libbitcoin::chain::script{change_payment_ops}};
+        adjusted_amount, GetOutputScript(change_address)};
 
     std::cout << "Using adjusted change amount of " << adjusted_amount
               << " back to our self";
@@ -1010,8 +3234,7 @@ libbitcoin::chain::transaction BitcoinInterface::CreateSignedTransaction(
     std::cout << "Subtracting fee from amount. "
               << "Using adjusted destination amount of" << amount << std::endl;
 
-    const libbitcoin::chain::output output{
-        amount, libbitcoin::chain::script{amount_payment_ops}};
+    const libbitcoin::chain::output output{amount, amount_payment_script};
 
     // adjust the amount that was previously already set
     tx.outputs()[0] = output;
@@ -1033,9 +3256,84 @@ libbitcoin::chain::transaction BitcoinInterface::CreateSignedTransaction(
   return tx;
 }
 
+libbitcoin::chain::transaction BitcoinInterface::CreateSignedBatchTransaction(
+    const UnspentList& unspent, const RecipientList& recipients,
+    const uint64_t target_fee_per_kb, uint64_t& change_amount,
+    const libbitcoin::wallet::payment_address change_address,
+    bool signal_rbf) {
+  std::stringstream error_msg;
+
+  libbitcoin::chain::transaction tx;
+  tx.set_locktime(locktime);
+  tx.set_version(transaction_version);
+
+  libbitcoin::chain::input::list inputs;
+  libbitcoin::chain::output::list outputs;
+  inputs.reserve(unspent.size());
+  outputs.reserve(recipients.size() + 1);
+
+  for (const auto& recipient : recipients) {
+    outputs.emplace_back(recipient.second, GetOutputScript(recipient.first));
+  }
+
+  // the change output is always added (and possibly removed below)
+  // so that the fee estimate accounts for it
+  const auto change_script = GetOutputScript(change_address);
+  outputs.emplace_back(change_amount, change_script);
+
+  for (const auto& cur_unspent : unspent) {
+    const auto& transfer = cur_unspent.second;
+    MEGABIT_ASSERT(!transfer.is_spent());
+
+    libbitcoin::chain::input input;
+    input.set_sequence(signal_rbf ? megabit::constants::rbf_input_sequence
+                                  : libbitcoin::max_input_sequence);
+    input.set_previous_output(
+        {transfer.output.hash(), transfer.output.index()});
+
+    inputs.push_back(input);
+  }
+
+  tx.set_inputs(inputs);
+  tx.set_outputs(outputs);
+
+  // estimate the signed size from the unsigned tx so that the inputs
+  // only need to be signed once, after the fee has been applied
+  const auto estimated_size = GetSignedVirtualSize(tx, unspent);
+  const uint64_t estimated_fee =
+      target_fee_per_kb * (static_cast<float>(estimated_size) / 1024);
+  std::cout << "Estimated fee for batch tx of " << estimated_size
+            << " virtual bytes is " << estimated_fee << std::endl;
+
+  if (change_amount <= estimated_fee) {
+    error_msg << "Not enough funds in this account for the batch amount "
+                 "in addition to the estimated fee of "
+              << estimated_fee << std::endl;
+    throw std::runtime_error(error_msg.str());
+  }
+
+  change_amount -= estimated_fee;
+  if (change_amount < megabit::constants::dust_threshold) {
+    // change that can't be relayed is left to the miner instead
+    std::cout << "Dropping dust change amount of " << change_amount
+              << std::endl;
+    change_amount = 0;
+    tx.outputs().pop_back();
+  } else {
+    std::cout << "Using adjusted change amount of " << change_amount
+              << " back to our self" << std::endl;
+    tx.outputs().back() =
+        libbitcoin::chain::output{change_amount, change_script};
+  }
+
+  SignTransactionInputs(unspent, tx);
+
+  return tx;
+}
+
 bool BitcoinInterface::CreateAndBroadcastTransaction(
     const UnspentList& unspent, uint64_t& amount,
-    const libbitcoin::wallet::payment_address destination_address,
+    const PaymentDestination destination_address,
     const uint64_t target_fee_per_kb, const uint64_t change_amount,
     const libbitcoin::wallet::payment_address change_address,
     bool subtract_fee_from_amount) {
@@ -1228,6 +3526,17 @@ bool BitcoinInterface::RetrieveUnspentAndChangeAddress(
 
 bool BitcoinInterface::SendTransaction(
     const libbitcoin::chain::transaction& transaction) {
+  return SendTransactionAsync(transaction).get();
+}
+
+std::future<bool> BitcoinInterface::SendTransactionAsync(
+    const libbitcoin::chain::transaction& transaction) {
+  return request_executor_.Submit<bool>(
+      [this, transaction]() { return PublishTransaction(transaction); });
+}
+
+bool BitcoinInterface::PublishTransaction(
+    const libbitcoin::chain::transaction& transaction) {
   bool ret = false;
 
   auto on_done = [&ret](const libbitcoin::code& error) {
@@ -1242,8 +3551,30 @@ bool BitcoinInterface::SendTransaction(
               << std::endl;
   };
 
-  client_.transaction_pool_broadcast(on_error, on_done, transaction);
-  client_.wait();
+  // rebroadcasting to another server after a connection failure is
+  // harmless, the transaction is the same
+  const auto request = transaction.to_data(true, true);
+  libbitcoin::data_chunk response;
+  if (request_log_.Replay(RequestType::broadcast_transaction, request,
+                          response)) {
+    ret = DecodeStatus(response);
+  } else {
+    const auto started = RequestLog::Clock::now();
+    servers_.Perform(
+        [&on_done, &transaction](LibbitcoinClient& client,
+                                 const ServerErrorHandler& on_error) {
+          client.transaction_pool_broadcast(on_error, on_done, transaction);
+          client.wait();
+        },
+        on_error);
+    request_log_.Record(RequestType::broadcast_transaction, request, started,
+                        [ret]() { return EncodeStatus(ret); });
+  }
 
+  if (ret) {
+    TrackBroadcastTransaction(transaction);
+    TrackUnconfirmedTransaction(transaction, true);
+    InvalidateHistories(GetTransactionKeyHashes(transaction));
+  }
   return ret;
 }
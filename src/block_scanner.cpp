@@ -0,0 +1,110 @@
+/*
+ * This file is part of Megabit, a BIP44 HD wallet built on
+ * libbitcoin.
+ *
+ * Copyright (C) 2017 Neill Miller (neillm@thecodefactory.org)
+ *
+ * Megabit is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Megabit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Megabit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../include/megabit/block_scanner.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// splitmix64 finaliser, spreading the filter hashes over all bits
+static uint64_t Mix(uint64_t value) {
+  value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+  return value ^ (value >> 31);
+}
+
+BlockScanner::BloomFilter::BloomFilter(size_t num_elements,
+                                       double false_positive_rate) {
+  // the optimal filter size is -n ln(p) / ln(2)^2 bits, probed with
+  // (size / n) ln(2) hashes
+  const auto ln2 = std::log(2.0);
+  const auto elements = static_cast<double>(std::max<size_t>(1, num_elements));
+  const auto num_bits = static_cast<size_t>(
+      std::ceil(-elements * std::log(false_positive_rate) / (ln2 * ln2)));
+  bits_.resize(std::max<size_t>(64, num_bits));
+  num_hashes_ = std::max<size_t>(
+      1, static_cast<size_t>(std::round(bits_.size() / elements * ln2)));
+}
+
+void BlockScanner::BloomFilter::Insert(uint64_t hash) {
+  // double hashing, h1 + i * h2, over the two halves of the mix
+  const auto mixed = Mix(hash);
+  const auto h1 = mixed & 0xffffffff;
+  const auto h2 = (mixed >> 32) | 1;
+  for (size_t i = 0; i < num_hashes_; i++) {
+    bits_[(h1 + i * h2) % bits_.size()] = true;
+  }
+}
+
+bool BlockScanner::BloomFilter::MayContain(uint64_t hash) const {
+  const auto mixed = Mix(hash);
+  const auto h1 = mixed & 0xffffffff;
+  const auto h2 = (mixed >> 32) | 1;
+  for (size_t i = 0; i < num_hashes_; i++) {
+    if (!bits_[(h1 + i * h2) % bits_.size()]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+BlockScanner::BlockScanner(
+    const std::vector<libbitcoin::short_hash>& key_hashes,
+    OutpointMap outpoints, double false_positive_rate)
+    : key_hash_filter_(key_hashes.size(), false_positive_rate),
+      outpoint_filter_(outpoints.size(), false_positive_rate),
+      key_hashes_(key_hashes.begin(), key_hashes.end()),
+      outpoints_(std::move(outpoints)) {
+  for (const auto& key_hash : key_hashes_) {
+    key_hash_filter_.Insert(Hash(key_hash));
+  }
+  for (const auto& outpoint : outpoints_) {
+    outpoint_filter_.Insert(outpoint.first.checksum());
+  }
+}
+
+bool BlockScanner::Matches(const libbitcoin::short_hash& key_hash) const {
+  return key_hash_filter_.MayContain(Hash(key_hash)) &&
+         key_hashes_.count(key_hash);
+}
+
+bool BlockScanner::Matches(const libbitcoin::chain::point& outpoint,
+                           libbitcoin::short_hash& key_hash) const {
+  if (!outpoint_filter_.MayContain(outpoint.checksum())) {
+    return false;
+  }
+  const auto it = outpoints_.find(outpoint);
+  if (it == outpoints_.end()) {
+    return false;
+  }
+  key_hash = it->second;
+  return true;
+}
+
+bool BlockScanner::ShouldScanBlocks(size_t num_blocks, size_t num_addresses,
+                                    double transactions_per_block) {
+  return (static_cast<double>(num_blocks) * (1.0 + transactions_per_block)) <
+         static_cast<double>(num_addresses);
+}
+
+uint64_t BlockScanner::Hash(const libbitcoin::short_hash& key_hash) {
+  // key hashes are already uniformly distributed
+  return libbitcoin::from_little_endian_unsafe<uint64_t>(key_hash.begin());
+}
@@ -0,0 +1,232 @@
+/*
+ * This file is part of Megabit, a BIP44 HD wallet built on
+ * libbitcoin.
+ *
+ * Copyright (C) 2017 Neill Miller (neillm@thecodefactory.org)
+ *
+ * Megabit is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Megabit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Megabit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../include/megabit/chain_tip_listener.hpp"
+
+#include <algorithm>
+
+void ChainTipListener::SetServerInfo(
+    const std::string& libbitcoin_server_address,
+    const std::string& libbitcoin_server_public_key) {
+  std::lock_guard<std::mutex> lock(server_lock_);
+  libbitcoin_server_address_ = libbitcoin_server_address;
+  libbitcoin_server_public_key_ = libbitcoin_server_public_key;
+  server_changed_ = true;
+}
+
+void ChainTipListener::Stop() { running_ = false; }
+
+void ChainTipListener::Run() {
+  std::cout << "Chain tip listener running" << std::endl;
+
+  libbitcoin::protocol::zmq::context context;
+  std::unique_ptr<Socket> block_socket;
+  std::unique_ptr<Socket> heartbeat_socket;
+  std::unique_ptr<libbitcoin::protocol::zmq::poller> poller;
+
+  auto poll_interval =
+      std::chrono::milliseconds(megabit::constants::chain_tip_min_poll_ms);
+  auto next_poll = Clock::now();
+  auto next_connect = Clock::now();
+  auto last_heartbeat = Clock::time_point{};
+
+  while (running_) {
+    auto now = Clock::now();
+    if (now >= next_connect) {
+      bool server_changed = false;
+      {
+        std::lock_guard<std::mutex> lock(server_lock_);
+        std::swap(server_changed, server_changed_);
+      }
+      if (server_changed || !block_socket) {
+        // the poller can't remove sockets, so it's replaced along
+        // with them
+        poller.reset(new libbitcoin::protocol::zmq::poller());
+        if (ConnectServices(context, block_socket, heartbeat_socket)) {
+          poller->add(*block_socket);
+          poller->add(*heartbeat_socket);
+        } else {
+          next_connect =
+              now + std::chrono::milliseconds(
+                        megabit::constants::subscription_retry_ms);
+        }
+      }
+    }
+
+    const auto pushes_arriving =
+        (now - last_heartbeat) <
+        std::chrono::milliseconds(megabit::constants::heartbeat_timeout_ms);
+
+    const auto timeout = std::max<int64_t>(
+        0, std::min<int64_t>(
+               megabit::constants::chain_tip_monitor_period_ms,
+               std::chrono::duration_cast<std::chrono::milliseconds>(
+                   next_poll - now)
+                   .count()));
+
+    if (block_socket) {
+      const auto ready = poller->wait(static_cast<int32_t>(timeout));
+      if (ready.contains(heartbeat_socket->id())) {
+        libbitcoin::protocol::zmq::message message;
+        if (!heartbeat_socket->receive(message)) {
+          last_heartbeat = Clock::now();
+        }
+      }
+      if (ready.contains(block_socket->id())) {
+        libbitcoin::protocol::zmq::message message;
+        if (!block_socket->receive(message)) {
+          last_heartbeat = Clock::now();
+          OnBlockMessage(message);
+        }
+      }
+    } else {
+      QThread::msleep(static_cast<unsigned long>(timeout));
+    }
+
+    now = Clock::now();
+    if (now < next_poll) {
+      continue;
+    }
+
+    // polls back off while the tip is unchanged, and start over
+    // quickly after a change since blocks are sometimes found in
+    // quick succession
+    if (PollHeight()) {
+      poll_interval =
+          std::chrono::milliseconds(megabit::constants::chain_tip_min_poll_ms);
+    } else {
+      poll_interval = std::min(
+          poll_interval * 2,
+          std::chrono::milliseconds(megabit::constants::chain_tip_max_poll_ms));
+    }
+
+    // while the services are pushing, polling only covers missed
+    // block messages
+    next_poll = now + (pushes_arriving
+                           ? std::chrono::milliseconds(
+                                 megabit::constants::chain_tip_push_poll_ms)
+                           : poll_interval);
+  }
+
+  std::cout << "Chain tip listener stopped" << std::endl;
+  emit finished();
+}
+
+bool ChainTipListener::ConnectServices(
+    libbitcoin::protocol::zmq::context& context,
+    std::unique_ptr<Socket>& block_socket,
+    std::unique_ptr<Socket>& heartbeat_socket) {
+  std::string libbitcoin_server_address;
+  std::string libbitcoin_server_public_key;
+  {
+    std::lock_guard<std::mutex> lock(server_lock_);
+    libbitcoin_server_address = libbitcoin_server_address_;
+    libbitcoin_server_public_key = libbitcoin_server_public_key_;
+  }
+
+  block_socket = ConnectService(
+      context, megabit::constants::block_service_port_offset,
+      libbitcoin_server_address, libbitcoin_server_public_key);
+  heartbeat_socket = ConnectService(
+      context, megabit::constants::heartbeat_service_port_offset,
+      libbitcoin_server_address, libbitcoin_server_public_key);
+  if (!block_socket || !heartbeat_socket) {
+    block_socket.reset();
+    heartbeat_socket.reset();
+    emit ChainTipError(
+        tr("Cannot connect to the server's block service, polling for new "
+           "blocks instead"));
+    return false;
+  }
+  return true;
+}
+
+std::unique_ptr<ChainTipListener::Socket> ChainTipListener::ConnectService(
+    libbitcoin::protocol::zmq::context& context, uint16_t port_offset,
+    const std::string& libbitcoin_server_address,
+    const std::string& libbitcoin_server_public_key) {
+  libbitcoin::config::endpoint query_endpoint;
+  try {
+    query_endpoint = libbitcoin::config::endpoint(libbitcoin_server_address);
+  } catch (const std::exception&) {
+    return nullptr;
+  }
+
+  const libbitcoin::config::endpoint endpoint{
+      query_endpoint.scheme(), query_endpoint.host(),
+      static_cast<uint16_t>(query_endpoint.port() + port_offset)};
+
+  std::unique_ptr<Socket> socket(
+      new Socket(context, Socket::role::subscriber));
+  if (!libbitcoin_server_public_key.empty() &&
+      (!socket->set_curve_client(
+           libbitcoin::config::sodium(libbitcoin_server_public_key)) ||
+       !socket->set_certificate({}))) {
+    return nullptr;
+  }
+
+  if (socket->connect(endpoint)) {
+    std::cout << "Failed to connect to " << endpoint << std::endl;
+    return nullptr;
+  }
+  std::cout << "Listening for blocks on " << endpoint << std::endl;
+  return socket;
+}
+
+bool ChainTipListener::OnBlockMessage(
+    libbitcoin::protocol::zmq::message& message) {
+  // [ sequence:2 ] [ height:4 ] [ block:... ]
+  uint16_t sequence = 0;
+  uint32_t height = 0;
+  if (message.dequeue<uint16_t>(sequence) &&
+      message.dequeue<uint32_t>(height)) {
+    return SetHeight(height);
+  }
+
+  return PollHeight();
+}
+
+bool ChainTipListener::PollHeight() {
+  size_t height = 0;
+  bool error = false;
+  auto on_error = [this, &error](const libbitcoin::code& code) {
+    error = true;
+    std::stringstream error_ss;
+    error_ss << "Failed to retrieve block height: " << code;
+    std::cout << error_ss.str() << std::endl;
+    emit ChainTipError(QString::fromUtf8(error_ss.str().c_str()));
+  };
+  auto handler = [&height](size_t last_height) { height = last_height; };
+
+  bitcoin_interface_.GetBlockHeight(on_error, handler);
+  return !error && SetHeight(height);
+}
+
+bool ChainTipListener::SetHeight(size_t height) {
+  // a reorganization to a shorter chain is reported as a new tip too
+  if (!height || (height == height_)) {
+    return false;
+  }
+
+  height_ = height;
+  std::cout << "New chain tip at height " << height_ << std::endl;
+  emit NewTip(static_cast<quint32>(height_));
+  return true;
+}
@@ -0,0 +1,95 @@
+/*
+ * This file is part of Megabit, a BIP44 HD wallet built on
+ * libbitcoin.
+ *
+ * Copyright (C) 2017 Neill Miller (neillm@thecodefactory.org)
+ *
+ * Megabit is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Megabit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Megabit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../include/megabit/concurrency_limiter.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+#include "../include/megabit/utils.hpp"
+
+void ConcurrencyLimiter::Permit::Release(RequestOutcome outcome) {
+  if (limiter_) {
+    limiter_->Release(outcome);
+    limiter_ = nullptr;
+  }
+}
+
+ConcurrencyLimiter::ConcurrencyLimiter(size_t max_limit)
+    : max_limit_(static_cast<double>(max_limit)), metrics_{} {
+  MEGABIT_ASSERT(max_limit > 0);
+  metrics_.limit = std::min(
+      max_limit_, static_cast<double>(
+                      megabit::constants::initial_concurrency_limit));
+}
+
+ConcurrencyLimiter::Permit ConcurrencyLimiter::Acquire(
+    std::chrono::milliseconds timeout) {
+  std::unique_lock<std::mutex> lock(lock_);
+  // a fractional limit rounds down, but a slot is always available
+  // when nothing is in flight
+  const auto has_slot = [this]() {
+    return (static_cast<double>(metrics_.in_flight + 1) <= metrics_.limit) ||
+           (metrics_.in_flight == 0);
+  };
+  if (!has_slot()) {
+    ++metrics_.waits;
+    if (!available_.wait_for(lock, timeout, has_slot)) {
+      std::cout << "Timed out waiting for a request slot: " << metrics_
+                << std::endl;
+      return {};
+    }
+  }
+
+  ++metrics_.in_flight;
+  metrics_.peak_in_flight =
+      std::max(metrics_.peak_in_flight, metrics_.in_flight);
+  return Permit(this);
+}
+
+ConcurrencyMetrics ConcurrencyLimiter::GetMetrics() {
+  std::lock_guard<std::mutex> lock(lock_);
+  return metrics_;
+}
+
+void ConcurrencyLimiter::Release(RequestOutcome outcome) {
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    --metrics_.in_flight;
+
+    const auto now = std::chrono::steady_clock::now();
+    if (outcome == RequestOutcome::success) {
+      metrics_.limit =
+          std::min(max_limit_, metrics_.limit + 1.0 / metrics_.limit);
+    } else if ((outcome == RequestOutcome::congested) &&
+               (now >= last_decrease_ +
+                           std::chrono::milliseconds(
+                               megabit::constants::
+                                   concurrency_decrease_interval_ms))) {
+      metrics_.limit =
+          std::max(1.0, metrics_.limit *
+                            megabit::constants::concurrency_decrease_factor);
+      ++metrics_.decreases;
+      last_decrease_ = now;
+      std::cout << "Server congested, " << metrics_ << std::endl;
+    }
+  }
+  available_.notify_all();
+}
@@ -0,0 +1,69 @@
+/*
+ * This file is part of Megabit, a BIP44 HD wallet built on
+ * libbitcoin.
+ *
+ * Copyright (C) 2017 Neill Miller (neillm@thecodefactory.org)
+ *
+ * Megabit is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Megabit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Megabit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../include/megabit/confirmation_tracker.hpp"
+
+#include <algorithm>
+
+size_t ConfirmationTracker::Track(const QPersistentModelIndex& row,
+                                  size_t height) {
+  const auto unconfirmed = rows_.equal_range(0);
+  for (auto row_iter = unconfirmed.first; row_iter != unconfirmed.second;) {
+    row_iter = ((row_iter->second == row) ? rows_.erase(row_iter)
+                                          : std::next(row_iter));
+  }
+
+  // every row is kept until the tip is known
+  const auto confirmations = GetConfirmations(height);
+  if (!tip_height_ || (confirmations < max_confirmations_)) {
+    rows_.emplace(height, row);
+  }
+  return confirmations;
+}
+
+std::vector<ConfirmationChange> ConfirmationTracker::SetTipHeight(
+    size_t tip_height) {
+  std::vector<ConfirmationChange> changes;
+  if (tip_height == tip_height_) {
+    return changes;
+  }
+  tip_height_ = tip_height;
+
+  // unconfirmed rows don't change with the tip
+  for (auto row_iter = rows_.upper_bound(0); row_iter != rows_.end();) {
+    if (!row_iter->second.isValid()) {
+      row_iter = rows_.erase(row_iter);
+      continue;
+    }
+
+    const auto confirmations = GetConfirmations(row_iter->first);
+    changes.push_back({row_iter->second, confirmations});
+    row_iter = ((confirmations >= max_confirmations_) ? rows_.erase(row_iter)
+                                                      : std::next(row_iter));
+  }
+  return changes;
+}
+
+size_t ConfirmationTracker::GetConfirmations(size_t height) const {
+  if (!height || (height > tip_height_)) {
+    return 0;
+  }
+  return std::min(max_confirmations_, tip_height_ - height + 1);
+}
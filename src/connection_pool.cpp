@@ -0,0 +1,188 @@
+/*
+ * This file is part of Megabit, a BIP44 HD wallet built on
+ * libbitcoin.
+ *
+ * Copyright (C) 2017 Neill Miller (neillm@thecodefactory.org)
+ *
+ * Megabit is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Megabit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Megabit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../include/megabit/connection_pool.hpp"
+
+#include <algorithm>
+
+#include "../include/megabit/utils.hpp"
+
+ConnectionPool::Lease& ConnectionPool::Lease::operator=(Lease&& other) {
+  if (this != &other) {
+    Release(false);
+    pool_ = other.pool_;
+    client_ = std::move(other.client_);
+  }
+  return *this;
+}
+
+void ConnectionPool::Lease::Release(bool discard) {
+  if (client_) {
+    pool_->Release(std::move(client_), discard);
+  }
+}
+
+ConnectionPool::ConnectionPool(size_t max_connections)
+    : max_connections_(max_connections), metrics_{} {
+  MEGABIT_ASSERT(max_connections_ > 0);
+}
+
+void ConnectionPool::SetServerInfo(
+    const std::string& libbitcoin_server_address,
+    const std::string& libbitcoin_server_public_key) {
+  std::vector<std::unique_ptr<LibbitcoinClient>> closed;
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    if ((libbitcoin_server_address == libbitcoin_server_address_) &&
+        (libbitcoin_server_public_key == libbitcoin_server_public_key_)) {
+      return;
+    }
+
+    libbitcoin_server_address_ = libbitcoin_server_address;
+    libbitcoin_server_public_key_ = libbitcoin_server_public_key;
+
+    metrics_.connections -= idle_.size();
+    closed.swap(idle_);
+    stale_ = leased_;
+  }
+  available_.notify_all();
+  // the closed connections are destroyed outside of the lock
+}
+
+ConnectionPool::Lease ConnectionPool::Acquire(
+    std::chrono::milliseconds timeout) {
+  const auto start_time = std::chrono::steady_clock::now();
+  std::string libbitcoin_server_address;
+  std::string libbitcoin_server_public_key;
+  {
+    std::unique_lock<std::mutex> lock(lock_);
+    const auto have_connection = available_.wait_for(lock, timeout, [this]() {
+      return (!idle_.empty() || (metrics_.connections < max_connections_));
+    });
+
+    const auto wait_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                             std::chrono::steady_clock::now() - start_time)
+                             .count();
+    metrics_.total_acquire_wait_us += wait_us;
+    metrics_.max_acquire_wait_us =
+        std::max<uint64_t>(metrics_.max_acquire_wait_us, wait_us);
+
+    if (!have_connection) {
+      ++metrics_.acquire_timeouts;
+      std::cout << "Timed out waiting for a connection: " << metrics_
+                << std::endl;
+      return {};
+    }
+
+    ++metrics_.acquisitions;
+    ++metrics_.in_use;
+    metrics_.peak_in_use = std::max(metrics_.peak_in_use, metrics_.in_use);
+
+    if (!idle_.empty()) {
+      auto client = std::move(idle_.back());
+      idle_.pop_back();
+      leased_.push_back(client.get());
+      return Lease(this, std::move(client));
+    }
+
+    // the slot is counted now, and connected outside of the lock
+    ++metrics_.connections;
+    libbitcoin_server_address = libbitcoin_server_address_;
+    libbitcoin_server_public_key = libbitcoin_server_public_key_;
+  }
+
+  auto client =
+      Connect(libbitcoin_server_address, libbitcoin_server_public_key);
+  if (!client) {
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      --metrics_.connections;
+      --metrics_.in_use;
+    }
+    available_.notify_one();
+    return {};
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    ++metrics_.connects;
+    leased_.push_back(client.get());
+    if ((libbitcoin_server_address != libbitcoin_server_address_) ||
+        (libbitcoin_server_public_key != libbitcoin_server_public_key_)) {
+      stale_.push_back(client.get());
+    }
+  }
+  return Lease(this, std::move(client));
+}
+
+ConnectionPoolMetrics ConnectionPool::GetMetrics() {
+  std::lock_guard<std::mutex> lock(lock_);
+  return metrics_;
+}
+
+std::unique_ptr<LibbitcoinClient> ConnectionPool::Connect(
+    const std::string& libbitcoin_server_address,
+    const std::string& libbitcoin_server_public_key) {
+  std::cout << "Connecting to " << libbitcoin_server_address
+            << " using public key " << libbitcoin_server_public_key
+            << std::endl;
+
+  auto client = std::unique_ptr<LibbitcoinClient>(new LibbitcoinClient(
+      megabit::constants::timeout_seconds, megabit::constants::num_retries));
+
+  bool ret = false;
+  if (libbitcoin_server_public_key.empty()) {
+    ret = client->connect(libbitcoin_server_address);
+  } else {
+    ret = client->connect(
+        libbitcoin_server_address, {},
+        libbitcoin::config::sodium(libbitcoin_server_public_key), {});
+  }
+
+  if (!ret) {
+    std::cout << "Failed to connect to " << libbitcoin_server_address
+              << std::endl;
+    return nullptr;
+  }
+  return client;
+}
+
+void ConnectionPool::Release(std::unique_ptr<LibbitcoinClient> client,
+                             bool discard) {
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    --metrics_.in_use;
+    leased_.erase(std::find(leased_.begin(), leased_.end(), client.get()));
+
+    auto stale_iter = std::find(stale_.begin(), stale_.end(), client.get());
+    if (stale_iter != stale_.end()) {
+      stale_.erase(stale_iter);
+      discard = true;
+    }
+
+    if (discard) {
+      --metrics_.connections;
+    } else {
+      idle_.push_back(std::move(client));
+    }
+  }
+  available_.notify_one();
+  // a discarded client is closed here, outside of the lock
+}
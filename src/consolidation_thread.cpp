@@ -0,0 +1,54 @@
+/*
+ * This file is part of Megabit, a BIP44 HD wallet built on
+ * libbitcoin.
+ *
+ * Copyright (C) 2017 Neill Miller (neillm@thecodefactory.org)
+ *
+ * Megabit is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Megabit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Megabit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../include/megabit/consolidation_thread.hpp"
+
+#include "../include/megabit/bitcoin_interface.hpp"
+
+void ConsolidationThread::Consolidate() {
+  std::cout << "[THREAD] Consolidate called" << std::endl;
+
+  // NOTE: this is a blocking call, which is why it's in a
+  // separate thread
+  size_t total_transactions = 0;
+  for (size_t account_index = 0; account_index < num_accounts_;
+       account_index++) {
+    size_t num_transactions = 0;
+    try {
+      if (!bitcoin_interface_.ConsolidateUnspent(
+              account_index, target_fee_per_kb_, policy_, num_transactions)) {
+        emit ConsolidationError(
+            tr("Failed to consolidate account ") +
+            QString::number(account_index + 1) +
+            tr(".  Please check the logs for more details"));
+        emit finished();
+        return;
+      }
+    } catch (const std::runtime_error& e) {
+      emit ConsolidationError(QString::fromUtf8(e.what()));
+      emit finished();
+      return;
+    }
+    total_transactions += num_transactions;
+  }
+
+  emit ConsolidationComplete(total_transactions);
+  emit finished();
+}
@@ -22,6 +22,7 @@
 
 #include <QByteArray>
 #include <QClipboard>
+#include <QFileDialog>
 #include <QFont>
 #include <QInputDialog>
 #include <QLabel>
@@ -51,7 +52,8 @@ Megabit::Megabit(QWidget* parent)
       fee_reply_(nullptr),
       currency_reply_(nullptr),
       wallet_loader_dialog_(nullptr),
-      bitcoin_interface_() {
+      bitcoin_interface_(),
+      payment_queue_(bitcoin_interface_) {
   ui->setupUi(this);
 
   receive_combo_ = nullptr;
@@ -63,13 +65,66 @@ Megabit::Megabit(QWidget* parent)
   receive_address_edit_ = nullptr;
   copy_receive_address_ = nullptr;
 
-  address_monitor_map_lock_.unlock();
-
   refresh_block_height_ = 0;
 
+  subscription_thread_ = new QThread();
+  subscription_dispatcher_ = new SubscriptionDispatcher(bitcoin_interface_);
+  MEGABIT_ASSERT(subscription_thread_);
+  MEGABIT_ASSERT(subscription_dispatcher_);
+
+  // notifications for transactions the server hasn't indexed yet
+  // can't be routed to an address, so everything is refreshed
+  subscription_dispatcher_->SetUnroutedHandler(
+      [this](size_t /* height */, const libbitcoin::hash_digest& /* hash */) {
+        QMetaObject::invokeMethod(this, "RefreshTransactions",
+                                  Qt::QueuedConnection);
+      });
+  subscription_dispatcher_->moveToThread(subscription_thread_);
+
+  connect(subscription_thread_, SIGNAL(started()), subscription_dispatcher_,
+          SLOT(Run()));
+  connect(subscription_dispatcher_, SIGNAL(SubscriptionError(QString)), this,
+          SLOT(OnAddressSubscriptionError(QString)));
+  connect(subscription_dispatcher_, SIGNAL(finished()), subscription_thread_,
+          SLOT(quit()));
+
+  chain_tip_thread_ = new QThread();
+  chain_tip_listener_ = new ChainTipListener(bitcoin_interface_);
+  MEGABIT_ASSERT(chain_tip_thread_);
+  MEGABIT_ASSERT(chain_tip_listener_);
+  chain_tip_listener_->moveToThread(chain_tip_thread_);
+
+  connect(chain_tip_thread_, SIGNAL(started()), chain_tip_listener_,
+          SLOT(Run()));
+  connect(chain_tip_listener_, SIGNAL(NewTip(quint32)), this,
+          SLOT(OnNewTip(quint32)));
+  connect(chain_tip_listener_, SIGNAL(ChainTipError(QString)), this,
+          SLOT(OnChainTipError(QString)));
+  connect(chain_tip_listener_, SIGNAL(finished()), chain_tip_thread_,
+          SLOT(quit()));
+
+  qRegisterMetaType<ConfirmedTransactionList>("ConfirmedTransactionList");
+  promotion_generation_ = 0;
+  promotion_thread_ = new QThread();
+  transaction_promoter_ = new TransactionPromoter(bitcoin_interface_);
+  MEGABIT_ASSERT(promotion_thread_);
+  MEGABIT_ASSERT(transaction_promoter_);
+  transaction_promoter_->moveToThread(promotion_thread_);
+
+  connect(transaction_promoter_,
+          SIGNAL(TransactionsPromoted(quint32, ConfirmedTransactionList)),
+          this,
+          SLOT(OnTransactionsPromoted(quint32, ConfirmedTransactionList)));
+  witness_history_warned_ = false;
+  connect(transaction_promoter_, SIGNAL(WitnessHistoryMissing()), this,
+          SLOT(OnWitnessHistoryMissing()));
+  promotion_thread_->start();
+
   // start timers for external service related events
   QTimer::singleShot(10, this, SLOT(GetFeeData()));
   QTimer::singleShot(20, this, SLOT(GetCurrencyData()));
+  QTimer::singleShot(megabit::constants::metrics_log_interval_ms, this,
+                     SLOT(LogServerMetrics()));
 
   connect(ui->refreshButton, SIGNAL(released()), this,
           SLOT(RefreshTransactions()));
@@ -81,6 +136,22 @@ Megabit::Megabit(QWidget* parent)
 
   connect(ui->send_transaction, SIGNAL(clicked()), this, SLOT(SendPayment()));
 
+  connect(ui->batch_payment, SIGNAL(clicked()), this,
+          SLOT(SendBatchPayment()));
+
+  connect(&payment_queue_, SIGNAL(PaymentReady(quint32)), this,
+          SLOT(OnPaymentReady(quint32)));
+  connect(&payment_queue_, SIGNAL(PaymentSent(quint32)), this,
+          SLOT(OnPaymentSent()));
+  connect(&payment_queue_, SIGNAL(PaymentFailed(quint32, QString)), this,
+          SLOT(OnPaymentFailed(quint32, QString)));
+  connect(&payment_queue_, SIGNAL(PaymentStateChanged(quint32, int)), this,
+          SLOT(OnPaymentStateChanged(quint32, int)));
+  connect(&payment_queue_, SIGNAL(PaymentFeeBumped(quint32)), this,
+          SLOT(OnPaymentFeeBumped(quint32)));
+  connect(&payment_queue_, SIGNAL(FeeBumpFailed(quint32, QString)), this,
+          SLOT(OnFeeBumpFailed(quint32, QString)));
+
   connect(this, SIGNAL(ProgressUpdated(uint32_t, uint32_t, const TxInfo)), this,
           SLOT(OnProgressUpdated(uint32_t, uint32_t, const TxInfo)));
 
@@ -92,18 +163,32 @@ Megabit::Megabit(QWidget* parent)
   connect(ui->actionAbout_Megabit, SIGNAL(triggered()), this,
           SLOT(ShowAbout()));
 
+  connect(ui->actionConsolidate, SIGNAL(triggered()), this,
+          SLOT(ConsolidateOutputs()));
+  connect(ui->actionBumpFees, SIGNAL(triggered()), this,
+          SLOT(BumpPaymentFees()));
+
   ShowSplashScreen();
   LoadConfiguration(config_);
 }
 
 Megabit::~Megabit() {
-  {
-    std::lock_guard<boost::detail::spinlock> lock(address_monitor_map_lock_);
-    for (const auto& monitor_iter : address_monitor_map_) {
-      std::cout << "canceling monitor for " << monitor_iter.first << std::endl;
-      monitor_iter.second->address_monitor_worker->CancelMonitor();
-    }
-  }
+  chain_tip_listener_->Stop();
+  chain_tip_thread_->quit();
+  chain_tip_thread_->wait();
+  delete chain_tip_listener_;
+  delete chain_tip_thread_;
+
+  subscription_dispatcher_->Stop();
+  subscription_thread_->quit();
+  subscription_thread_->wait();
+  delete subscription_dispatcher_;
+  delete subscription_thread_;
+
+  promotion_thread_->quit();
+  promotion_thread_->wait();
+  delete transaction_promoter_;
+  delete promotion_thread_;
 
   safe_delete(wizard_);
   safe_delete(wallet_loader_dialog_);
@@ -156,6 +241,48 @@ void Megabit::LoadConfiguration(Configuration& config) {
                    QString::fromStdString(
                        megabit::constants::libbitcoin_server_public_key))
             .toString();
+    config.hedge_requests = settings.value("servers/hedge_requests", 0).toInt();
+    config.capture_mode = settings.value("capture/mode", "").toString();
+    config.capture_file = settings.value("capture/file", "").toString();
+    config.capture_flat_out = settings.value("capture/flat_out", 0).toInt();
+    const auto num_servers = settings.value("servers/numServers", 0).toInt();
+    for (int i = 0; i < num_servers; i++) {
+      const auto str_index = QString::number(i);
+      config.fallback_servers.push_back(
+          {settings.value("servers/" + str_index + "/address")
+               .toString()
+               .toStdString(),
+           settings.value("servers/" + str_index + "/public_key")
+               .toString()
+               .toStdString()});
+    }
+    config.consolidation_policy.max_fee_per_kb =
+        settings
+            .value("consolidation/max_fee_per_kb",
+                   QString::number(
+                       megabit::constants::consolidation_max_fee_per_kb))
+            .toULongLong();
+    config.consolidation_policy.max_utxo_value =
+        settings
+            .value("consolidation/max_utxo_value",
+                   QString::number(
+                       megabit::constants::consolidation_max_utxo_value))
+            .toULongLong();
+    config.consolidation_policy.max_inputs_per_tx =
+        settings
+            .value("consolidation/max_inputs_per_tx",
+                   QString::number(megabit::constants::consolidation_max_inputs))
+            .toULongLong();
+    config.unconfirmed_spend_policy.spend_unconfirmed_change =
+        settings.value("payments/spend_unconfirmed_change", 1).toInt();
+    config.unconfirmed_spend_policy.max_chain_depth =
+        settings
+            .value("payments/max_unconfirmed_chain_depth",
+                   QString::number(
+                       megabit::constants::max_unconfirmed_chain_depth))
+            .toULongLong();
+    config.server_validation =
+        settings.value("payments/server_validation", 0).toInt();
     config.num_accounts = settings.value("accounts/numAccounts", 1).toInt();
     for (size_t i = 0; i < config.num_accounts; i++) {
       const auto str_index = QString::number(i);
@@ -165,6 +292,13 @@ void Megabit::LoadConfiguration(Configuration& config) {
                                            "Account " + account_index)
                                     .toString();
       config.account_names << account_name;
+
+      const auto account_type =
+          settings.value("accounts/" + str_index + "/type", "bip44")
+              .toString();
+      config.account_types.push_back((account_type == "bip84")
+                                         ? AccountType::bip84
+                                         : AccountType::bip44);
     }
 
     config.current_account_index =
@@ -179,6 +313,7 @@ void Megabit::LoadConfiguration(Configuration& config) {
     config.checksum = settings.value("global/checksum").toString();
     config.encrypted_seed = settings.value("global/encrypted_seed").toString();
     config.network = settings.value("global/network", "mainnet").toString();
+    config.signal_rbf = settings.value("global/signal_rbf", 1).toInt();
 
     auto entered = false;
     QString passphrase_str =
@@ -215,12 +350,36 @@ void Megabit::LoadConfiguration(Configuration& config) {
       }
 
       bitcoin_interface_.SetNumAccounts(config.num_accounts);
+      bitcoin_interface_.SetAccountTypes(config.account_types);
+      bitcoin_interface_.SetUnconfirmedSpendPolicy(
+          config.unconfirmed_spend_policy);
       bitcoin_interface_.SetNetwork(config.network.toStdString());
-      bitcoin_interface_.SetServerInfo(config.server_address.toStdString(),
-                                       config.server_public_key.toStdString());
+      std::vector<ServerInfo> servers{{config.server_address.toStdString(),
+                                       config.server_public_key.toStdString()}};
+      servers.insert(servers.end(), config.fallback_servers.begin(),
+                     config.fallback_servers.end());
+      bitcoin_interface_.SetServers(servers);
+      bitcoin_interface_.SetHedging(config.hedge_requests);
+      bitcoin_interface_.SetServerValidation(config.server_validation);
+      if (!config.capture_mode.isEmpty() &&
+          !bitcoin_interface_.SetRequestLog(
+              (config.capture_mode == "replay") ? RequestLogMode::replay
+                                                : RequestLogMode::record,
+              config.capture_file.toStdString(), config.capture_flat_out)) {
+        ui->statusBar->showMessage(
+            tr("Cannot open the request capture file ") + config.capture_file);
+      }
+      chain_tip_listener_->SetServerInfo(
+          config.server_address.toStdString(),
+          config.server_public_key.toStdString());
 
       bitcoin_interface_.InitializeFromSeed(seed);
 
+      for (const auto& address : bitcoin_interface_.GetWalletAddresses()) {
+        MonitorAddress(address);
+      }
+      subscription_thread_->start();
+
       megabit::utils::mem_unlock_region(checksum);
       megabit::utils::mem_unlock_region(passphrase_hash);
       megabit::utils::mem_unlock_region(seed);
@@ -259,14 +418,50 @@ void Megabit::SaveConfiguration(const Configuration& config) {
     const auto str_index = QString::number(i);
     settings.setValue("accounts/" + str_index + "/name",
                       config.account_names.at(i));
+    settings.setValue(
+        "accounts/" + str_index + "/type",
+        (config.account_types.at(i) == AccountType::bip84) ? "bip84" : "bip44");
   }
 
   settings.setValue("global/default_account_index",
                     QString::number(config.current_account_index));
   settings.setValue("global/currency", config.currency);
+  settings.setValue("global/signal_rbf", config.signal_rbf ? 1 : 0);
   settings.setValue("global/libbitcoin_server_address", config.server_address);
   settings.setValue("global/libbitcoin_server_public_key",
                     config.server_public_key);
+  settings.setValue("servers/hedge_requests", config.hedge_requests ? 1 : 0);
+  settings.setValue("capture/mode", config.capture_mode);
+  settings.setValue("capture/file", config.capture_file);
+  settings.setValue("capture/flat_out", config.capture_flat_out ? 1 : 0);
+  settings.setValue("servers/numServers",
+                    QString::number(config.fallback_servers.size()));
+  for (size_t i = 0; i < config.fallback_servers.size(); i++) {
+    const auto str_index = QString::number(i);
+    settings.setValue(
+        "servers/" + str_index + "/address",
+        QString::fromStdString(config.fallback_servers.at(i).address));
+    settings.setValue(
+        "servers/" + str_index + "/public_key",
+        QString::fromStdString(config.fallback_servers.at(i).public_key));
+  }
+  settings.setValue(
+      "consolidation/max_fee_per_kb",
+      QString::number(config.consolidation_policy.max_fee_per_kb));
+  settings.setValue(
+      "consolidation/max_utxo_value",
+      QString::number(config.consolidation_policy.max_utxo_value));
+  settings.setValue(
+      "consolidation/max_inputs_per_tx",
+      QString::number(config.consolidation_policy.max_inputs_per_tx));
+  settings.setValue(
+      "payments/spend_unconfirmed_change",
+      config.unconfirmed_spend_policy.spend_unconfirmed_change ? 1 : 0);
+  settings.setValue(
+      "payments/max_unconfirmed_chain_depth",
+      QString::number(config.unconfirmed_spend_policy.max_chain_depth));
+  settings.setValue("payments/server_validation",
+                    config.server_validation ? 1 : 0);
 }
 
 bool Megabit::LoadAccountsTab(Configuration& config_) {
@@ -352,6 +547,7 @@ bool Megabit::LoadAccountsTab(Configuration& config_) {
     ui->accountsTable->setItem(i, 1, account_balance_btc);
     ui->accountsTable->setItem(i, 2, account_balance_converted);
   }
+  UpdateAccountBalances();
 
   ui->tab_main->setCurrentIndex(config_.current_tab_index);
   return true;
@@ -477,8 +673,9 @@ void Megabit::OnFeeAdjusted(int value) {
 }
 
 void Megabit::OnRecipientAddressEdited(const QString& address) {
-  auto addr = bitcoin_interface_.GetPaymentAddress(address.toStdString());
-  auto is_valid_address = addr.encoded() == address.toStdString();
+  PaymentDestination destination;
+  auto is_valid_address = bitcoin_interface_.GetPaymentDestination(
+      address.toStdString(), destination);
   ui->send_transaction->setEnabled(is_valid_address);
 }
 
@@ -548,8 +745,8 @@ void Megabit::LoadReceiveTab(Configuration& config, uint32_t account_index,
         tr("Megabit: Cannot contact Bitcoin network"),
         tr("Error: The connection to the bitcoin network was unable to "
            "retrieve necessary information about this wallet.\n\n"
-           "Please check that the configured server is reachable "
-           "and try again."));
+           "Please check that one of the configured servers is "
+           "reachable and try again."));
 
     exit(1);
   }
@@ -706,33 +903,8 @@ void Megabit::OnFeeDataRead() {
   QTimer::singleShot(300000, this, SLOT(GetFeeData()));
 }
 
-void Megabit::GetBlockHeight() {
-  auto block_height_thread = new QThread();
-  auto block_height_worker =
-      new BlockHeightThread(bitcoin_interface_, block_height_);
-
-  MEGABIT_ASSERT(block_height_thread);
-  MEGABIT_ASSERT(block_height_worker);
-
-  block_height_worker->moveToThread(block_height_thread);
-
-  connect(block_height_worker, SIGNAL(BlockHeightError(QString)), this,
-          SLOT(OnBlockHeightError(QString)));
-  connect(block_height_thread, SIGNAL(started()), block_height_worker,
-          SLOT(GetBlockHeight()));
-  connect(block_height_worker, SIGNAL(finished()), block_height_thread,
-          SLOT(quit()));
-  connect(block_height_worker, SIGNAL(finished()), this,
-          SLOT(OnGetBlockHeight()));
-  connect(block_height_worker, SIGNAL(finished()), block_height_worker,
-          SLOT(deleteLater()));
-  connect(block_height_thread, SIGNAL(finished()), block_height_thread,
-          SLOT(deleteLater()));
-
-  block_height_thread->start();
-}
-
-void Megabit::OnGetBlockHeight() {
+void Megabit::OnNewTip(quint32 height) {
+  block_height_ = height;
   bitcoin_interface_.SetBlockHeight(block_height_);
 
   // disable/enable the refresh button
@@ -744,31 +916,29 @@ void Megabit::OnGetBlockHeight() {
             << ", block height = " << block_height_ << std::endl;
   ui->refreshButton->setEnabled(refresh_block_height_ != block_height_);
 
-  // update transaction table's confirmation numbers each time we
-  // receive a block update
-  for (auto i = 0; i < ui->transactionTable->rowCount(); i++) {
-    auto block = ui->transactionTable->item(i, 0)
-                     ->data(Qt::UserRole)
-                     .toString()
-                     .toLong();
-    auto num_confirmations = block ? QString::number(block_height_ - block) : 0;
-    auto confirmation_str =
-        (num_confirmations.toLong()
-             ? QString("Confirmed (") + num_confirmations +
-                   QString(" confirmations)")
-             : QString("This transaction is not confirmed"));
-
-    // FIXME: GRAY OUT IF UNCONFIRMED??
-
-    // sets all tx tooltips to contain the number of confirmations
-    for (auto j = 0; j < ui->transactionTable->columnCount(); j++) {
-      auto item = ui->transactionTable->item(i, j);
-      item->setData(Qt::ToolTipRole, confirmation_str);
-    }
+  // update the confirmation numbers of the transactions in the most
+  // recent blocks, the only ones that change
+  for (const auto& change : confirmation_tracker_.SetTipHeight(block_height_)) {
+    SetConfirmationTooltips(change.row, change.confirmations);
   }
 
-  // start new timer to update block height once per minute
-  QTimer::singleShot(60000, this, SLOT(GetBlockHeight()));
+  // the confirmations are looked up on the server, so the promotion
+  // is queued to its own thread
+  QMetaObject::invokeMethod(transaction_promoter_, "Promote",
+                            Qt::QueuedConnection,
+                            Q_ARG(quint32, promotion_generation_));
+}
+
+void Megabit::OnTransactionsPromoted(quint32 generation,
+                                     ConfirmedTransactionList confirmed) {
+  ForgetConfirmedPayments(confirmed);
+
+  // a refresh since the promotion was requested reloaded the balances
+  // with these transactions confirmed already
+  if (generation != promotion_generation_) {
+    return;
+  }
+  PromoteTransactions(confirmed);
 }
 
 void Megabit::ClearPaymentFields() {
@@ -787,8 +957,9 @@ void Megabit::SendPayment() {
   uint64_t amount = ui->amountBTCLineEdit->text().toDouble() *
                     megabit::constants::satoshi_per_btc;
   QString dest_addr_str = ui->recipientBitcoinAddressLineEdit->text();
-  auto destination_address =
-      bitcoin_interface_.GetPaymentAddress(dest_addr_str.toStdString());
+  PaymentDestination destination_address;
+  const auto is_valid_address = bitcoin_interface_.GetPaymentDestination(
+      dest_addr_str.toStdString(), destination_address);
 
   uint32_t target_fee_per_kb = current_fee_;
   bool subtract_fee_from_amount = ui->subtract_fee->isChecked();
@@ -802,11 +973,12 @@ void Megabit::SendPayment() {
   std::cout << "send payment subtract_fee_from_amount = "
             << subtract_fee_from_amount << std::endl;
 
-  if ((amount == 0) || dest_addr_str.isEmpty()) {
+  if ((amount == 0) || !is_valid_address) {
     QMessageBox::information(const_cast<decltype(this)>(this),
                              tr("Send Warning"),
-                             tr("Both an amount to send and a destination "
-                                "address are required in order to send."));
+                             tr("Both an amount to send and a valid "
+                                "destination address are required in order "
+                                "to send."));
     return;
   } else if ((amount > account_balance_map_[account_index]) ||
              ((amount == account_balance_map_[account_index]) &&
@@ -818,38 +990,62 @@ void Megabit::SendPayment() {
     return;
   }
 
-  auto send_payment_thread = new QThread();
-  auto send_payment_worker = new SendPaymentThread(
-      bitcoin_interface_, account_index, amount, destination_address,
-      target_fee_per_kb, subtract_fee_from_amount);
+  payment_queue_.Enqueue(account_index, {{destination_address, amount}},
+                         target_fee_per_kb, subtract_fee_from_amount, true,
+                         config_.signal_rbf);
+}
 
-  MEGABIT_ASSERT(send_payment_thread);
-  MEGABIT_ASSERT(send_payment_worker);
+void Megabit::SendBatchPayment() {
+  uint32_t account_index = config_.current_account_index;
+  uint32_t target_fee_per_kb = current_fee_;
 
-  send_payment_worker->moveToThread(send_payment_thread);
+  const auto file_name = QFileDialog::getOpenFileName(
+      this, tr("Load Batch Payment"), QString(),
+      tr("CSV files (*.csv);;All files (*)"));
+  if (file_name.isEmpty()) {
+    return;
+  }
 
-  connect(send_payment_thread, SIGNAL(started()), send_payment_worker,
-          SLOT(SendPayment()));
-  connect(send_payment_worker, SIGNAL(finished()), send_payment_thread,
-          SLOT(quit()));
-  connect(send_payment_worker, SIGNAL(GetUserSendPaymentConfirmation()), this,
-          SLOT(OnGetUserSendPaymentConfirmation()));
-  connect(send_payment_worker, SIGNAL(SendPaymentError(QString)), this,
-          SLOT(OnSendPaymentError(QString)));
-  connect(this, SIGNAL(SendUserConfirmedPayment()), send_payment_worker,
-          SLOT(OnSendUserConfirmedPayment()));
-  connect(send_payment_worker, SIGNAL(finished()), this, SLOT(OnPaymentSent()));
-  connect(send_payment_worker, SIGNAL(finished()), send_payment_worker,
-          SLOT(deleteLater()));
-  connect(send_payment_thread, SIGNAL(finished()), send_payment_thread,
-          SLOT(deleteLater()));
+  RecipientList recipients;
+  std::string error;
+  if (!bitcoin_interface_.LoadRecipientsFromCsv(file_name.toStdString(),
+                                                recipients, error)) {
+    QMessageBox::information(const_cast<decltype(this)>(this),
+                             tr("Batch Send Warning"),
+                             tr("Error: ") + QString::fromStdString(error));
+    return;
+  }
 
-  send_payment_thread->start();
+  uint64_t amount = 0;
+  for (const auto& recipient : recipients) {
+    amount += recipient.second;
+  }
+
+  std::cout << "send batch payment account_index = " << account_index
+            << std::endl;
+  std::cout << "send batch payment recipients = " << recipients.size()
+            << std::endl;
+  std::cout << "send batch payment amount = " << amount << std::endl;
+  std::cout << "send batch payment target_fee_per_kb = " << target_fee_per_kb
+            << std::endl;
+
+  if (amount >= account_balance_map_[account_index]) {
+    QMessageBox::information(
+        const_cast<decltype(this)>(this), tr("Batch Send Warning"),
+        tr("The total batch amount cannot be satisfied by "
+           "the current account."));
+    return;
+  }
+
+  payment_queue_.Enqueue(account_index, recipients, target_fee_per_kb, false,
+                         true, config_.signal_rbf);
 }
 
-void Megabit::OnGetUserSendPaymentConfirmation() {
-  std::cout << "on get user send payment confirmation called" << std::endl;
-  auto pending_tx = bitcoin_interface_.GetPendingTransaction();
+void Megabit::OnPaymentReady(quint32 payment_id) {
+  std::cout << "on payment ready called for payment " << payment_id
+            << std::endl;
+  auto pending_tx = payment_queue_.GetPendingTransaction(payment_id);
+  MEGABIT_ASSERT(pending_tx);
 
   uint64_t total_amount = 0;
   for (const auto& selected : pending_tx->selected_unspent_list) {
@@ -857,6 +1053,11 @@ void Megabit::OnGetUserSendPaymentConfirmation() {
   }
 
   uint64_t fee = total_amount - pending_tx->amount - pending_tx->change_amount;
+  if (pending_tx->is_batch()) {
+    OnGetUserSendBatchPaymentConfirmation(payment_id, pending_tx, fee);
+    return;
+  }
+
   if (pending_tx->subtract_fee_from_amount && (fee == 0)) {
     fee = bitcoin_interface_.GetCalculatedFee(pending_tx->tx,
                                               pending_tx->target_fee_per_kb);
@@ -900,13 +1101,51 @@ void Megabit::OnGetUserSendPaymentConfirmation() {
       this, "Send Payment",
       "Are you sure that you want to send " + amount_str + " BTC (" +
           currency_amount_str + ") to " +
-          QString::fromStdString(pending_tx->destination_address.encoded()) +
+          QString::fromStdString(bitcoin_interface_.GetDestinationString(
+              pending_tx->destination_address)) +
           " with an estimated fee of " + fee_str + " BTC (" + currency_fee_str +
           ")?",
       QMessageBox::Yes | QMessageBox::No);
   if (ret == QMessageBox::Yes) {
-    std::cout << "emitting send user confirmed payment" << std::endl;
-    emit SendUserConfirmedPayment();
+    std::cout << "confirming payment " << payment_id << std::endl;
+    payment_queue_.Confirm(payment_id);
+  } else {
+    payment_queue_.Cancel(payment_id);
+  }
+}
+
+void Megabit::OnGetUserSendBatchPaymentConfirmation(
+    quint32 payment_id, std::shared_ptr<PendingTransaction> pending_tx,
+    uint64_t fee) {
+  QString amount_str;
+  amount_str.setNum(bitcoin_interface_.SatoshiToBtc(pending_tx->amount), 'f',
+                    8);
+
+  QString fee_str;
+  fee_str.setNum(bitcoin_interface_.SatoshiToBtc(fee), 'f', 8);
+
+  const auto conversion_factor =
+      GetConvertedCurrencyAmount(config_, 1, config_.currency.toStdString());
+  QString currency_amount_str;
+  currency_amount_str.setNum(
+      bitcoin_interface_.SatoshiToBtc(pending_tx->amount) * conversion_factor,
+      'f', 2);
+  currency_amount_str += " " + config_.currency;
+
+  auto ret = QMessageBox::question(
+      this, "Send Batch Payment",
+      "Are you sure that you want to send a total of " + amount_str +
+          " BTC (" + currency_amount_str + ") to " +
+          QString::number(pending_tx->recipients.size()) +
+          " recipients in a single transaction of " +
+          QString::number(pending_tx->tx.serialized_size()) +
+          " bytes with a fee of " + fee_str + " BTC?",
+      QMessageBox::Yes | QMessageBox::No);
+  if (ret == QMessageBox::Yes) {
+    std::cout << "confirming batch payment " << payment_id << std::endl;
+    payment_queue_.Confirm(payment_id);
+  } else {
+    payment_queue_.Cancel(payment_id);
   }
 }
 
@@ -915,6 +1154,8 @@ void Megabit::OnPaymentSent() {
   // FIXME: how to indicate what is/isn't confirmed?!
   std::cout << "payment sent properly" << std::endl;
   ClearPaymentFields();
+  // the payment is tracked as pending once broadcast
+  UpdateAccountBalances();
   // RefreshTransactions();
   QMessageBox::information(
       const_cast<decltype(this)>(this), tr("Send Success"),
@@ -924,99 +1165,238 @@ void Megabit::OnPaymentSent() {
 
 void Megabit::AddAccount() {
   std::cout << "AddAccount clicked" << std::endl;
+  const QStringList account_types{tr("Legacy (P2PKH)"),
+                                  tr("Native SegWit (P2WPKH)")};
+  auto entered = false;
+  const auto account_type_str =
+      QInputDialog::getItem(this, tr("Add Account"),
+                            tr("Select the address type of the new account:"),
+                            account_types, 1, false, &entered);
+  if (!entered) {
+    return;
+  }
+
+  const auto account_type = ((account_type_str == account_types.at(1))
+                                 ? AccountType::bip84
+                                 : AccountType::bip44);
+  bitcoin_interface_.AddAccount(account_type);
+  config_.account_types.push_back(account_type);
+
   auto account_index = QString::number(++config_.num_accounts);
   config_.account_names.append(tr("Account ") + account_index);
   RefreshTransactions(false);
 }
 
+void Megabit::ConsolidateOutputs() {
+  // consolidation isn't urgent, so it always uses the low fee rate
+  const auto target_fee_per_kb = config_.low_fee_per_kb;
+  if (target_fee_per_kb > config_.consolidation_policy.max_fee_per_kb) {
+    QMessageBox::information(
+        const_cast<decltype(this)>(this), tr("Consolidation Skipped"),
+        tr("Current fees are too high to consolidate small outputs.  "
+           "Please try again when fees are lower."));
+    return;
+  }
+
+  auto ret = QMessageBox::question(
+      this, "Consolidate Small Outputs",
+      "Merge the small unspent outputs of every account into fewer outputs "
+      "at a fee of " +
+          QString::number(target_fee_per_kb) + " satoshi per KB?",
+      QMessageBox::Yes | QMessageBox::No);
+  if (ret != QMessageBox::Yes) {
+    return;
+  }
+
+  auto consolidation_thread = new QThread();
+  auto consolidation_worker = new ConsolidationThread(
+      bitcoin_interface_, config_.num_accounts, target_fee_per_kb,
+      config_.consolidation_policy);
+
+  MEGABIT_ASSERT(consolidation_thread);
+  MEGABIT_ASSERT(consolidation_worker);
+
+  consolidation_worker->moveToThread(consolidation_thread);
+
+  connect(consolidation_thread, SIGNAL(started()), consolidation_worker,
+          SLOT(Consolidate()));
+  connect(consolidation_worker, SIGNAL(ConsolidationComplete(quint32)), this,
+          SLOT(OnConsolidationComplete(quint32)));
+  connect(consolidation_worker, SIGNAL(ConsolidationError(QString)), this,
+          SLOT(OnConsolidationError(QString)));
+  connect(consolidation_worker, SIGNAL(finished()), consolidation_thread,
+          SLOT(quit()));
+  connect(consolidation_worker, SIGNAL(finished()), consolidation_worker,
+          SLOT(deleteLater()));
+  connect(consolidation_thread, SIGNAL(finished()), consolidation_thread,
+          SLOT(deleteLater()));
+
+  consolidation_thread->start();
+}
+
+void Megabit::OnConsolidationComplete(quint32 num_transactions) {
+  QMessageBox::information(
+      const_cast<decltype(this)>(this), tr("Consolidation Complete"),
+      QString::number(num_transactions) +
+          tr(" consolidation transaction(s) have been broadcasted."));
+}
+
+void Megabit::OnConsolidationError(QString error) {
+  QMessageBox::information(const_cast<decltype(this)>(this),
+                           tr("Consolidation did not complete"),
+                           tr("Error: ") + error);
+}
+
 void Megabit::MonitorAddress(std::string address) {
-  std::cout << "*** monitor address called with " << address << std::endl;
-
-  {
-    std::lock_guard<boost::detail::spinlock> lock(address_monitor_map_lock_);
-    // first check if we already have a monitor running for this
-    // address.  If so, and it's still running, do nothing.
-    auto monitor_iter = address_monitor_map_.find(address);
-    if (monitor_iter != address_monitor_map_.end()) {
-      if (monitor_iter->second->address_monitor_thread->isRunning()) {
-        std::cout << "Doing nothing because a monitor for " << address
-                  << " is already running" << std::endl;
-        return;
-      }
+  // the handler runs on the dispatcher thread, so the notification is
+  // queued to the ui thread
+  subscription_dispatcher_->Subscribe(
+      address, [this](const std::string& address,
+                      const libbitcoin::code& /* code */,
+                      uint16_t /* sequence */, size_t height,
+                      const libbitcoin::hash_digest& tx_hash) {
+        QMetaObject::invokeMethod(
+            this, "OnAddressActivity", Qt::QueuedConnection,
+            Q_ARG(QString, QString::fromStdString(address)),
+            Q_ARG(quint32, static_cast<quint32>(height)),
+            Q_ARG(QString,
+                  QString::fromStdString(libbitcoin::encode_hash(tx_hash))));
+      });
+}
+
+void Megabit::OnAddressActivity(QString address, quint32 height,
+                                QString tx_hash) {
+  std::cout << "Activity on " << address.toStdString() << " in "
+            << tx_hash.toStdString() << " at height " << height << std::endl;
+  bitcoin_interface_.InvalidateAddressHistory(address.toStdString());
+  RequestExecutor::PriorityScope priority(RequestPriority::subscription);
 
-      // if it was found and it's no longer running, let's remove this
-      // from the map and initialize as if it was a new registration
-      std::cout << "Cleaning up stale monitor for " << address << std::endl;
-      monitor_iter->second->address_monitor_worker->CancelMonitor();
+  libbitcoin::hash_digest hash;
+  if (!libbitcoin::decode_hash(hash, tx_hash.toStdString())) {
+    RefreshTransactions(false);
+    return;
+  }
 
-      address_monitor_map_.erase(monitor_iter);
+  // transactions tracked while unconfirmed are promoted in place (a
+  // transaction paying several addresses is reported for each), any
+  // other confirmed transaction changes balances and history, so
+  // everything is reloaded
+  if (height) {
+    ConfirmedTransaction confirmed;
+    if (promoted_transactions_.count(tx_hash.toStdString())) {
+      return;
+    }
+    if (bitcoin_interface_.PromoteConfirmedTransaction(hash, height,
+                                                       confirmed)) {
+      ForgetConfirmedPayments({confirmed});
+      PromoteTransactions({confirmed});
+      return;
     }
+    RefreshTransactions(false);
+    return;
   }
 
-  auto monitor = std::make_shared<AddressMonitorObj>();
-  monitor->address_monitor_info = std::make_shared<AddressMonitorInfo>();
-  monitor->address_monitor_thread = new QThread();
-  monitor->address_monitor_worker = new AddressMonitorThread(
-      address, config_.server_address.toStdString(),
-      config_.server_public_key.toStdString(), monitor->address_monitor_info);
+  TxBlockInfo tx_block_info{};
+  if (!bitcoin_interface_.GetTransactionInfo(hash, tx_block_info, true)) {
+    RefreshTransactions(false);
+    return;
+  }
 
-  std::cout << "*** Allocated new monitor " << monitor
-            << " and listener thread " << monitor->address_monitor_thread
-            << " for new worker " << monitor->address_monitor_worker
-            << std::endl;
+  if (bitcoin_interface_.TrackUnconfirmedTransaction(tx_block_info.tx)) {
+    UpdateAccountBalances();
+  }
 
-  MEGABIT_ASSERT(monitor->address_monitor_thread);
-  MEGABIT_ASSERT(monitor->address_monitor_worker);
+  // a transaction paying several wallet addresses is reported once
+  // per address, but only inserted once
+  if (!notified_transactions_.insert(tx_hash.toStdString()).second) {
+    return;
+  }
 
-  std::cout << "worker has parent: "
-            << monitor->address_monitor_worker->parent() << std::endl;
-  std::cout << "[before] worker in thread: "
-            << monitor->address_monitor_worker->thread() << std::endl;
-  monitor->address_monitor_worker->moveToThread(
-      monitor->address_monitor_thread);
-  std::cout << "[after] worker in thread: "
-            << monitor->address_monitor_worker->thread() << std::endl;
+  if (bitcoin_interface_.GetUnconfirmedTransactionAmount(tx_block_info.tx)) {
+    // directly insert the transaction and alert the user
+    AddUnconfirmedTransaction(address.toStdString(), tx_block_info.tx);
+  } else {
+    RefreshTransactions(false);
+  }
+}
 
-  connect(monitor->address_monitor_worker,
-          SIGNAL(AddressSubscriptionError(QString)), this,
-          SLOT(OnAddressSubscriptionError(QString)));
-  connect(monitor->address_monitor_thread, SIGNAL(started()),
-          monitor->address_monitor_worker, SLOT(ListenForAddressChanges()));
-  connect(monitor->address_monitor_worker, SIGNAL(finished()), this,
-          SLOT(OnMonitorAddressComplete()));
-  connect(monitor->address_monitor_worker, SIGNAL(finished()),
-          monitor->address_monitor_thread, SLOT(quit()));
-  connect(monitor->address_monitor_worker, SIGNAL(finished()),
-          monitor->address_monitor_worker, SLOT(deleteLater()));
-  connect(monitor->address_monitor_thread, SIGNAL(finished()),
-          monitor->address_monitor_thread, SLOT(deleteLater()));
-
-  {
-    std::lock_guard<boost::detail::spinlock> lock(address_monitor_map_lock_);
-    address_monitor_map_[address] = monitor;
+void Megabit::OnChainTipError(QString error) {
+  // the listener keeps polling after failures, so this is
+  // informational only
+  ui->statusBar->showMessage(tr("Error: ") + error, 10000);
+}
+
+void Megabit::OnWitnessHistoryMissing() {
+  if (witness_history_warned_) {
+    return;
   }
+  witness_history_warned_ = true;
+  QMessageBox::warning(
+      const_cast<decltype(this)>(this), tr("SegWit Balances Incomplete"),
+      tr("The server does not report native SegWit outputs in address "
+         "histories, so the balances of SegWit accounts may be missing "
+         "funds.  Please use a server that indexes P2WPKH outputs."));
+}
 
-  monitor->address_monitor_thread->start();
+void Megabit::OnAddressSubscriptionError(QString error) {
+  // the dispatcher reconnects and resubscribes by itself, so this
+  // is informational only
+  ui->statusBar->showMessage(tr("Error: ") + error, 10000);
 }
 
-void Megabit::OnBlockHeightError(QString error) {
-  // retry in 10 seconds after failure
-  //
-  // keep a counter and if it errors N number of times in a
-  // row, show a message box and exit??
-  QMessageBox::information(const_cast<decltype(this)>(this),
-                           tr("Could not retrieve Block Height"),
-                           tr("Error: ") + error);
-  QTimer::singleShot(10000, this, SLOT(GetBlockHeight()));
+void Megabit::OnPaymentFailed(quint32 /* payment_id */, QString error) {
+  OnSendPaymentError(error);
 }
 
-void Megabit::OnAddressSubscriptionError(QString address) {
-  // keep a counter and if it errors N number of times in a
-  // row, show a message box and exit??
-  QMessageBox::information(
-      const_cast<decltype(this)>(this), tr("Address Subscription Error"),
-      tr("Error: Cannot listen for transactions on ") + address);
-  QTimer::singleShot(10000, this, SLOT(MonitorAddress(address.toStdString())));
+void Megabit::OnPaymentStateChanged(quint32 payment_id, int state) {
+  // indexed by PaymentState
+  static const std::vector<QString> state_names = {
+      tr("queued"),          tr("being constructed"),
+      tr("awaiting confirmation"),
+      tr("being validated"), tr("being broadcast"),
+      tr("sent"),            tr("failed"),
+      tr("canceled"),        tr("having its fee bumped")};
+  MEGABIT_ASSERT(state < static_cast<int>(state_names.size()));
+  ui->statusBar->showMessage(tr("Payment ") + QString::number(payment_id) +
+                             tr(" is ") + state_names[state]);
+}
+
+void Megabit::BumpPaymentFees() {
+  const auto payment_ids = payment_queue_.GetPaymentIds(PaymentState::sent);
+  if (payment_ids.empty()) {
+    QMessageBox::information(const_cast<decltype(this)>(this),
+                             tr("Bump Fees"),
+                             tr("There are no sent Payments to bump."));
+    return;
+  }
+
+  // stuck payments are bumped to the highest configured fee rate
+  const auto target_fee_per_kb = config_.high_fee_per_kb;
+  auto ret = QMessageBox::question(
+      this, "Bump Fees",
+      "Raise the fee of " + QString::number(payment_ids.size()) +
+          " unconfirmed Payment(s) to " + QString::number(target_fee_per_kb) +
+          " satoshi per KB?",
+      QMessageBox::Yes | QMessageBox::No);
+  if (ret != QMessageBox::Yes) {
+    return;
+  }
+
+  for (const auto payment_id : payment_ids) {
+    payment_queue_.BumpFee(payment_id, target_fee_per_kb);
+  }
+}
+
+void Megabit::OnPaymentFeeBumped(quint32 payment_id) {
+  ui->statusBar->showMessage(tr("The fee of Payment ") +
+                             QString::number(payment_id) + tr(" was bumped"));
+  RefreshTransactions(false);
+}
+
+void Megabit::OnFeeBumpFailed(quint32 payment_id, QString error) {
+  ui->statusBar->showMessage(tr("The fee of Payment ") +
+                             QString::number(payment_id) +
+                             tr(" was not bumped: ") + error);
 }
 
 void Megabit::OnSendPaymentError(QString error) {
@@ -1036,6 +1416,13 @@ void Megabit::RefreshTransactions(bool skip_refresh) {
     return;
   }
   refresh_block_height_ = block_height_;
+  notified_transactions_.clear();
+  promoted_transactions_.clear();
+  confirmation_tracker_.Clear();
+  promotion_generation_++;
+  // the reloaded balances include any transaction confirmed since the
+  // last tip, so it must no longer count as pending
+  ForgetConfirmedPayments(bitcoin_interface_.PromoteConfirmedTransactions());
 
   // clear accounts tab
   ui->accountsTable->setRowCount(0);
@@ -1048,53 +1435,18 @@ void Megabit::RefreshTransactions(bool skip_refresh) {
   emit WalletLoaded();
 }
 
-void Megabit::OnMonitorAddressComplete() {
-  address_monitor_map_lock_.lock();
-
-  std::shared_ptr<AddressMonitorInfo> ret = nullptr;
-  for (auto monitor_entry : address_monitor_map_) {
-    ret = monitor_entry.second->address_monitor_info;
-    if (ret->finished) {
-      break;
-    }
+void Megabit::LogServerMetrics() {
+  std::cout << bitcoin_interface_.GetConnectionPoolMetrics() << " "
+            << bitcoin_interface_.GetFailoverMetrics() << " "
+            << bitcoin_interface_.GetLatencyMetrics() << " "
+            << bitcoin_interface_.GetSchedulerMetrics() << std::endl;
+  for (const auto& stats : bitcoin_interface_.GetServerStats()) {
+    std::cout << "Server " << stats.address << ": " << stats.concurrency
+              << std::endl;
   }
 
-  MEGABIT_ASSERT(ret && ret->finished);
-  auto address = ret->address;
-
-  std::cout << "OnMonitorAddressComplete searching for " << address
-            << std::endl;
-  auto monitor_iter = address_monitor_map_.find(address);
-  MEGABIT_ASSERT(monitor_iter != address_monitor_map_.end());
-
-  std::cout << "OnMonitorAddressComplete called for " << address << std::endl;
-  std::cout << "OnMonitorAddressComplete got return code " << ret->code
-            << std::endl;
-  std::cout << "Monitored information for " << ret->address << ", sequence "
-            << (uint32_t)ret->sequence << ", height " << ret->height
-            << ", tx_hash " << libbitcoin::encode_base16(ret->tx_hash)
-            << std::endl;
-
-  address_monitor_map_.erase(monitor_iter);
-  address_monitor_map_lock_.unlock();
-
-  // if we got a notification without details, or the subscription has
-  // timed out (default server side config is 10 minutes),
-  // re-subscribe and continue waiting
-  if (ret->code == libbitcoin::error::channel_timeout) {
-    QTimer::singleShot(100, this, SLOT(RefreshTransactions()));
-    return;
-  } else if (ret->code == libbitcoin::error::success) {
-    TxBlockInfo tx_block_info{};
-    if (bitcoin_interface_.GetTransactionInfo(ret->tx_hash, tx_block_info,
-                                              true)) {
-      // directly insert the transaction and alert the user
-      AddUnconfirmedTransaction(address, tx_block_info.tx);
-    } else {
-      QTimer::singleShot(100, this,
-                         [this, address]() { MonitorAddress(address); });
-    }
-  }
+  QTimer::singleShot(megabit::constants::metrics_log_interval_ms, this,
+                     SLOT(LogServerMetrics()));
 }
 
 void Megabit::GetCurrencyData() {
@@ -1186,7 +1538,11 @@ void Megabit::OnWalletLoaded() {
     delete wallet_loader_dialog_;
     wallet_loader_dialog_ = nullptr;
   }
-  QTimer::singleShot(10, this, SLOT(GetBlockHeight()));
+  // the wallet is also reloaded on refreshes, but there's only one
+  // listener
+  if (!chain_tip_thread_->isRunning()) {
+    chain_tip_thread_->start();
+  }
 }
 
 void Megabit::OnAccountNameEdited(int row, int column) {
@@ -1257,6 +1613,7 @@ void Megabit::OnProgressUpdated(uint32_t account_index, uint32_t row,
   ui->transactionTable->setItem(row, 2, label_item);
   ui->transactionTable->setItem(row, 3, amount_item);
   ui->transactionTable->setItem(row, 4, converted_amount_item);
+  TrackConfirmations(row, tx_info.height);
 
   ui->transactionTable->verticalHeader()->setVisible(false);
 
@@ -1274,6 +1631,9 @@ void Megabit::AddUnconfirmedTransaction(
 
   type_item->setTextAlignment(Qt::AlignVCenter);
   type_item->setFlags(type_item->flags() & ~Qt::ItemIsEditable);
+  // so that the row can be found when the transaction confirms
+  type_item->setData(
+      Qt::UserRole, QString::fromStdString(libbitcoin::encode_hash(tx.hash())));
 
   QTableWidgetItem* date_item = new QTableWidgetItem(tr("Pending ..."));
   date_item->setTextAlignment(Qt::AlignVCenter);
@@ -1310,6 +1670,7 @@ void Megabit::AddUnconfirmedTransaction(
   ui->transactionTable->setItem(row, 2, label_item);
   ui->transactionTable->setItem(row, 3, amount_item);
   ui->transactionTable->setItem(row, 4, converted_amount_item);
+  TrackConfirmations(row, 0);
 
   ui->transactionTable->verticalHeader()->setVisible(false);
 
@@ -1333,6 +1694,119 @@ void Megabit::AddUnconfirmedTransaction(
           tr("history permanently after it is fully confirmed."));
 }
 
+void Megabit::PromoteTransactions(
+    const std::vector<ConfirmedTransaction>& confirmed) {
+  for (const auto& transaction : confirmed) {
+    const auto tx_hash =
+        QString::fromStdString(libbitcoin::encode_hash(transaction.tx_hash));
+    promoted_transactions_.insert(tx_hash.toStdString());
+    std::cout << "Transaction " << tx_hash.toStdString()
+              << " confirmed at height " << transaction.height << std::endl;
+
+    for (const auto& received : transaction.entry.received) {
+      account_balance_map_[received.first] += received.second;
+    }
+    for (const auto& spent : transaction.entry.spent) {
+      auto& balance = account_balance_map_[spent.first];
+      balance -= std::min(balance, spent.second);
+    }
+
+    for (auto i = 0; i < ui->transactionTable->rowCount(); i++) {
+      auto type_item = ui->transactionTable->item(i, 1);
+      auto date_item = ui->transactionTable->item(i, 0);
+      if (!type_item || !date_item ||
+          (type_item->data(Qt::UserRole).toString() != tx_hash)) {
+        continue;
+      }
+
+      if (!transaction.entry.received.empty()) {
+        const auto account_index = transaction.entry.received.begin()->first;
+        type_item->setText(tr("Received with \"") +
+                           config_.account_names.at(account_index) +
+                           tr("\""));
+      }
+      date_item->setText(tr("Confirmed"));
+      date_item->setData(Qt::UserRole, QString::number(transaction.height));
+      TrackConfirmations(i, transaction.height);
+    }
+  }
+
+  if (!confirmed.empty()) {
+    UpdateAccountBalances();
+  }
+}
+
+void Megabit::ForgetConfirmedPayments(
+    const std::vector<ConfirmedTransaction>& confirmed) {
+  for (const auto& transaction : confirmed) {
+    payment_queue_.ForgetConfirmedPayment(transaction.tx_hash);
+  }
+}
+
+void Megabit::TrackConfirmations(int row, size_t height) {
+  const QPersistentModelIndex index(
+      ui->transactionTable->model()->index(row, 0));
+  SetConfirmationTooltips(index, confirmation_tracker_.Track(index, height));
+}
+
+void Megabit::SetConfirmationTooltips(const QPersistentModelIndex& row,
+                                      size_t confirmations) {
+  if (!row.isValid()) {
+    return;
+  }
+
+  // FIXME: GRAY OUT IF UNCONFIRMED??
+  const auto confirmation_str =
+      (!confirmations
+           ? tr("This transaction is not confirmed")
+           : (confirmations < confirmation_tracker_.GetMaxConfirmations())
+                 ? tr("Confirmed (") + QString::number(confirmations) +
+                       tr(" confirmations)")
+                 : tr("Confirmed (") + QString::number(confirmations) +
+                       tr("+ confirmations)"));
+
+  // sets all tx tooltips to contain the number of confirmations
+  for (auto j = 0; j < ui->transactionTable->columnCount(); j++) {
+    auto item = ui->transactionTable->item(row.row(), j);
+    if (item) {
+      item->setData(Qt::ToolTipRole, confirmation_str);
+    }
+  }
+}
+
+void Megabit::UpdateAccountBalances() {
+  for (size_t i = 0; i < config_.num_accounts; i++) {
+    auto balance_item = ui->accountsTable->item(i, 1);
+    auto converted_item = ui->accountsTable->item(i, 2);
+    if (!balance_item || !converted_item) {
+      continue;
+    }
+
+    const auto balance = account_balance_map_[i];
+    const auto pending = bitcoin_interface_.GetPendingBalance(i);
+    QString balance_str;
+    balance_str.setNum(bitcoin_interface_.SatoshiToBtc(balance), 'f', 8);
+    if (pending.incoming || pending.outgoing) {
+      QString incoming_str;
+      QString outgoing_str;
+      incoming_str.setNum(bitcoin_interface_.SatoshiToBtc(pending.incoming),
+                          'f', 8);
+      outgoing_str.setNum(bitcoin_interface_.SatoshiToBtc(pending.outgoing),
+                          'f', 8);
+      balance_str += tr(" (pending +") + incoming_str + " -" + outgoing_str +
+                     ")";
+    }
+    balance_item->setText(balance_str);
+
+    QString converted_balance_str;
+    converted_balance_str.setNum(
+        bitcoin_interface_.SatoshiToBtc(GetConvertedCurrencyAmount(
+            config_, balance, config_.currency.toStdString())),
+        'f', 2);
+    converted_item->setText(converted_balance_str);
+  }
+}
+
 double Megabit::GetConvertedCurrencyAmount(const Configuration& config,
                                            uint64_t btc_amount,
                                            std::string currency) {
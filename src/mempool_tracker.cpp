@@ -0,0 +1,140 @@
+/*
+ * This file is part of Megabit, a BIP44 HD wallet built on
+ * libbitcoin.
+ *
+ * Copyright (C) 2017 Neill Miller (neillm@thecodefactory.org)
+ *
+ * Megabit is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Megabit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Megabit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../include/megabit/mempool_tracker.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+bool MempoolTracker::Add(const MempoolEntry& entry) {
+  const auto tx_hash = entry.tx.hash();
+  std::lock_guard<std::mutex> lock(lock_);
+  if (entries_.count(tx_hash)) {
+    return false;
+  }
+
+  for (auto entry_iter = entries_.begin(); entry_iter != entries_.end();) {
+    const auto& tracked_inputs = entry_iter->second.tx.inputs();
+    const auto conflicts = std::any_of(
+        entry.tx.inputs().begin(), entry.tx.inputs().end(),
+        [&tracked_inputs](const libbitcoin::chain::input& input) {
+          return std::any_of(
+              tracked_inputs.begin(), tracked_inputs.end(),
+              [&input](const libbitcoin::chain::input& tracked_input) {
+                return (tracked_input.previous_output() ==
+                        input.previous_output());
+              });
+        });
+    if (conflicts) {
+      std::cout << "Dropping replaced unconfirmed transaction "
+                << libbitcoin::encode_hash(entry_iter->first) << std::endl;
+      Erase(entry_iter++);
+    } else {
+      ++entry_iter;
+    }
+  }
+
+  for (const auto& received : entry.received) {
+    balances_[received.first].incoming += received.second;
+  }
+  for (const auto& spent : entry.spent) {
+    balances_[spent.first].outgoing += spent.second;
+  }
+  entries_[tx_hash] = entry;
+  return true;
+}
+
+bool MempoolTracker::Remove(const libbitcoin::hash_digest& tx_hash,
+                            MempoolEntry& entry) {
+  std::lock_guard<std::mutex> lock(lock_);
+  const auto entry_iter = entries_.find(tx_hash);
+  if (entry_iter == entries_.end()) {
+    return false;
+  }
+  entry = entry_iter->second;
+  Erase(entry_iter);
+  return true;
+}
+
+bool MempoolTracker::Contains(const libbitcoin::hash_digest& tx_hash) {
+  std::lock_guard<std::mutex> lock(lock_);
+  return (entries_.count(tx_hash) != 0);
+}
+
+bool MempoolTracker::Missed(const libbitcoin::hash_digest& tx_hash,
+                            uint32_t max_misses) {
+  std::lock_guard<std::mutex> lock(lock_);
+  const auto entry_iter = entries_.find(tx_hash);
+  if ((entry_iter == entries_.end()) ||
+      (++entry_iter->second.misses < max_misses)) {
+    return false;
+  }
+  Erase(entry_iter);
+  return true;
+}
+
+void MempoolTracker::Found(const libbitcoin::hash_digest& tx_hash) {
+  std::lock_guard<std::mutex> lock(lock_);
+  const auto entry_iter = entries_.find(tx_hash);
+  if (entry_iter != entries_.end()) {
+    entry_iter->second.misses = 0;
+  }
+}
+
+std::vector<libbitcoin::hash_digest> MempoolTracker::GetTransactionHashes() {
+  std::lock_guard<std::mutex> lock(lock_);
+  std::vector<libbitcoin::hash_digest> tx_hashes;
+  tx_hashes.reserve(entries_.size());
+  for (const auto& entry : entries_) {
+    tx_hashes.push_back(entry.first);
+  }
+  return tx_hashes;
+}
+
+PendingBalance MempoolTracker::GetPendingBalance(uint32_t account_index) {
+  std::lock_guard<std::mutex> lock(lock_);
+  const auto balance_iter = balances_.find(account_index);
+  return ((balance_iter != balances_.end()) ? balance_iter->second
+                                            : PendingBalance{});
+}
+
+bool MempoolTracker::GetOutputValue(
+    const libbitcoin::chain::output_point& point, uint64_t& value) {
+  std::lock_guard<std::mutex> lock(lock_);
+  const auto entry_iter = entries_.find(point.hash());
+  if ((entry_iter == entries_.end()) ||
+      (point.index() >= entry_iter->second.tx.outputs().size())) {
+    return false;
+  }
+  value = entry_iter->second.tx.outputs()[point.index()].value();
+  return true;
+}
+
+void MempoolTracker::Erase(
+    std::unordered_map<libbitcoin::hash_digest, MempoolEntry>::iterator
+        entry_iter) {
+  for (const auto& received : entry_iter->second.received) {
+    balances_[received.first].incoming -= received.second;
+  }
+  for (const auto& spent : entry_iter->second.spent) {
+    balances_[spent.first].outgoing -= spent.second;
+  }
+  entries_.erase(entry_iter);
+}
@@ -0,0 +1,351 @@
+/*
+ * This file is part of Megabit, a BIP44 HD wallet built on
+ * libbitcoin.
+ *
+ * Copyright (C) 2017 Neill Miller (neillm@thecodefactory.org)
+ *
+ * Megabit is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Megabit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Megabit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../include/megabit/payment_queue.hpp"
+
+#include <QRunnable>
+
+namespace {
+
+class PaymentTask : public QRunnable {
+ public:
+  explicit PaymentTask(std::function<void()> task) : task_(task) {}
+
+  void run() { task_(); }
+
+ private:
+  std::function<void()> task_;
+};
+
+}  // namespace
+
+PaymentQueue::PaymentQueue(BitcoinInterface& bitcoin_interface,
+                           int max_concurrent_payments)
+    : bitcoin_interface_(bitcoin_interface), next_payment_id_(1) {
+  thread_pool_.setMaxThreadCount(max_concurrent_payments);
+}
+
+PaymentQueue::~PaymentQueue() { thread_pool_.waitForDone(); }
+
+uint32_t PaymentQueue::Enqueue(const uint32_t account_index,
+                               const RecipientList& recipients,
+                               const uint64_t target_fee_per_kb,
+                               bool subtract_fee_from_amount,
+                               bool require_confirmation, bool signal_rbf) {
+  MEGABIT_ASSERT(!recipients.empty());
+
+  uint32_t payment_id = 0;
+  {
+    std::lock_guard<std::mutex> lock(payments_lock_);
+    payment_id = next_payment_id_++;
+    payments_[payment_id] = {account_index,
+                             recipients,
+                             target_fee_per_kb,
+                             subtract_fee_from_amount,
+                             require_confirmation,
+                             signal_rbf,
+                             PaymentState::queued,
+                             nullptr,
+                             nullptr};
+  }
+
+  std::cout << "Queued payment " << payment_id << " to " << recipients.size()
+            << " recipient(s) from account index " << account_index
+            << std::endl;
+
+  emit PaymentStateChanged(payment_id, static_cast<int>(PaymentState::queued));
+  Run([this, payment_id]() { Build(payment_id); });
+  return payment_id;
+}
+
+void PaymentQueue::Confirm(uint32_t payment_id) {
+  if (!TransitionState(payment_id, PaymentState::awaiting_confirmation,
+                       PaymentState::validating)) {
+    return;
+  }
+  Run([this, payment_id]() { Broadcast(payment_id); });
+}
+
+void PaymentQueue::Cancel(uint32_t payment_id) {
+  if (!TransitionState(payment_id, PaymentState::awaiting_confirmation,
+                       PaymentState::canceled)) {
+    return;
+  }
+
+  // the payment can't be confirmed any more, so its utxos are free
+  const auto pending_transaction = GetPendingTransaction(payment_id);
+  bitcoin_interface_.ReleaseUnspent(pending_transaction->selected_unspent_list);
+  Forget(payment_id);
+}
+
+void PaymentQueue::BumpFee(uint32_t payment_id,
+                           const uint64_t target_fee_per_kb) {
+  if (!TransitionState(payment_id, PaymentState::sent,
+                       PaymentState::bumping_fee)) {
+    return;
+  }
+  Run([this, payment_id, target_fee_per_kb]() {
+    Bump(payment_id, target_fee_per_kb);
+  });
+}
+
+void PaymentQueue::ForgetConfirmedPayment(
+    const libbitcoin::hash_digest& tx_hash) {
+  std::lock_guard<std::mutex> lock(payments_lock_);
+  for (auto payment_iter = payments_.begin(); payment_iter != payments_.end();
+       ++payment_iter) {
+    // a payment having its fee bumped is forgotten by the bump
+    const auto& payment = payment_iter->second;
+    if ((payment.state == PaymentState::sent) &&
+        ((payment.pending_transaction &&
+          (payment.pending_transaction->tx.hash() == tx_hash)) ||
+         (payment.child_transaction &&
+          (payment.child_transaction->tx.hash() == tx_hash)))) {
+      std::cout << "Payment " << payment_iter->first << " has confirmed"
+                << std::endl;
+      payments_.erase(payment_iter);
+      return;
+    }
+  }
+}
+
+std::vector<uint32_t> PaymentQueue::GetPaymentIds(PaymentState state) {
+  std::vector<uint32_t> payment_ids;
+  std::lock_guard<std::mutex> lock(payments_lock_);
+  for (const auto& payment : payments_) {
+    if (payment.second.state == state) {
+      payment_ids.push_back(payment.first);
+    }
+  }
+  return payment_ids;
+}
+
+PaymentState PaymentQueue::GetState(uint32_t payment_id) {
+  std::lock_guard<std::mutex> lock(payments_lock_);
+  auto payment_iter = payments_.find(payment_id);
+  return ((payment_iter != payments_.end()) ? payment_iter->second.state
+                                            : PaymentState::failed);
+}
+
+std::shared_ptr<PendingTransaction> PaymentQueue::GetPendingTransaction(
+    uint32_t payment_id) {
+  std::lock_guard<std::mutex> lock(payments_lock_);
+  auto payment_iter = payments_.find(payment_id);
+  return ((payment_iter != payments_.end())
+              ? payment_iter->second.pending_transaction
+              : nullptr);
+}
+
+void PaymentQueue::Build(uint32_t payment_id) {
+  QueuedPayment payment{};
+  {
+    std::lock_guard<std::mutex> lock(payments_lock_);
+    payment = payments_[payment_id];
+  }
+
+  SetState(payment_id, PaymentState::building);
+
+  std::shared_ptr<PendingTransaction> pending_transaction;
+  try {
+    if (payment.recipients.size() == 1) {
+      auto amount = payment.recipients.front().second;
+      pending_transaction = bitcoin_interface_.CreatePendingPayment(
+          payment.account_index, amount, payment.recipients.front().first,
+          payment.target_fee_per_kb, payment.subtract_fee_from_amount,
+          payment.signal_rbf);
+    } else {
+      pending_transaction = bitcoin_interface_.CreatePendingBatchPayment(
+          payment.account_index, payment.recipients, payment.target_fee_per_kb,
+          payment.signal_rbf);
+    }
+  } catch (const std::runtime_error& e) {
+    Fail(payment_id, QString::fromUtf8(e.what()));
+    return;
+  }
+
+  if (!pending_transaction) {
+    Fail(payment_id,
+         tr("Failed to Contruct this Payment transaction.  "
+            "Please check the logs for more details"));
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(payments_lock_);
+    payments_[payment_id].pending_transaction = pending_transaction;
+  }
+
+  if (payment.require_confirmation) {
+    SetState(payment_id, PaymentState::awaiting_confirmation);
+    emit PaymentReady(payment_id);
+    return;
+  }
+
+  Broadcast(payment_id);
+}
+
+void PaymentQueue::Broadcast(uint32_t payment_id) {
+  auto pending_transaction = GetPendingTransaction(payment_id);
+  MEGABIT_ASSERT(pending_transaction);
+
+  SetState(payment_id, PaymentState::validating);
+  if (!bitcoin_interface_.ValidatePendingTransaction(*pending_transaction)) {
+    bitcoin_interface_.ReleaseUnspent(
+        pending_transaction->selected_unspent_list);
+    Fail(payment_id,
+         tr("The Payment transaction was rejected.  "
+            "Please check the logs for more details"));
+    return;
+  }
+
+  SetState(payment_id, PaymentState::broadcasting);
+  if (!bitcoin_interface_.BroadcastPendingTransaction(*pending_transaction)) {
+    bitcoin_interface_.ReleaseUnspent(
+        pending_transaction->selected_unspent_list);
+    Fail(payment_id,
+         tr("Failed to Send Payment.  Please check the logs for more details"));
+    return;
+  }
+
+  SetState(payment_id, PaymentState::sent);
+  emit PaymentSent(payment_id);
+}
+
+void PaymentQueue::Bump(uint32_t payment_id,
+                        const uint64_t target_fee_per_kb) {
+  QueuedPayment payment{};
+  {
+    std::lock_guard<std::mutex> lock(payments_lock_);
+    payment = payments_[payment_id];
+  }
+  MEGABIT_ASSERT(payment.pending_transaction);
+
+  // the payment stays sent whether or not its fee could be bumped
+  auto bump_failed = [this, payment_id](const QString& error) {
+    SetState(payment_id, PaymentState::sent);
+    emit FeeBumpFailed(payment_id, error);
+  };
+
+  TxBlockInfo tx_block_info{};
+  if (bitcoin_interface_.GetTransactionInfo(
+          payment.pending_transaction->tx.hash(), tx_block_info)) {
+    bump_failed(tr("The Payment has already been confirmed"));
+    Forget(payment_id);
+    return;
+  }
+
+  // a payment with a child can't be replaced without invalidating
+  // the child, and a second child would only add to the package
+  if (payment.child_transaction) {
+    bump_failed(tr("The Payment fee has already been bumped"));
+    return;
+  }
+
+  const auto replace = payment.pending_transaction->signals_rbf();
+  std::shared_ptr<PendingTransaction> bump_transaction;
+  try {
+    bump_transaction =
+        (replace ? bitcoin_interface_.CreateReplacementPayment(
+                       *payment.pending_transaction, target_fee_per_kb)
+                 : bitcoin_interface_.CreateChildPaysForParentPayment(
+                       payment.account_index, *payment.pending_transaction,
+                       target_fee_per_kb));
+  } catch (const std::runtime_error& e) {
+    bump_failed(QString::fromUtf8(e.what()));
+    return;
+  }
+
+  // the inputs of a replacement are those of the original payment,
+  // so they stay reserved either way
+  if (!bitcoin_interface_.ValidatePendingTransaction(*bump_transaction) ||
+      !bitcoin_interface_.BroadcastPendingTransaction(*bump_transaction)) {
+    if (!replace) {
+      bitcoin_interface_.ReleaseUnspent(
+          bump_transaction->selected_unspent_list);
+    }
+    bump_failed(
+        tr("Failed to Bump the Payment fee.  "
+           "Please check the logs for more details"));
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(payments_lock_);
+    auto& bumped_payment = payments_[payment_id];
+    bumped_payment.target_fee_per_kb = target_fee_per_kb;
+    if (replace) {
+      bumped_payment.pending_transaction = bump_transaction;
+    } else {
+      bumped_payment.child_transaction = bump_transaction;
+    }
+  }
+
+  SetState(payment_id, PaymentState::sent);
+  emit PaymentFeeBumped(payment_id);
+}
+
+void PaymentQueue::SetState(uint32_t payment_id, PaymentState state) {
+  {
+    std::lock_guard<std::mutex> lock(payments_lock_);
+    payments_[payment_id].state = state;
+  }
+
+  std::cout << "Payment " << payment_id << " is now in state "
+            << static_cast<int>(state) << std::endl;
+  emit PaymentStateChanged(payment_id, static_cast<int>(state));
+}
+
+bool PaymentQueue::TransitionState(uint32_t payment_id, PaymentState from,
+                                   PaymentState to) {
+  {
+    std::lock_guard<std::mutex> lock(payments_lock_);
+    auto payment_iter = payments_.find(payment_id);
+    if ((payment_iter == payments_.end()) ||
+        (payment_iter->second.state != from)) {
+      return false;
+    }
+    payment_iter->second.state = to;
+  }
+
+  std::cout << "Payment " << payment_id << " is now in state "
+            << static_cast<int>(to) << std::endl;
+  emit PaymentStateChanged(payment_id, static_cast<int>(to));
+  return true;
+}
+
+void PaymentQueue::Fail(uint32_t payment_id, const QString& error) {
+  SetState(payment_id, PaymentState::failed);
+  emit PaymentFailed(payment_id, error);
+  Forget(payment_id);
+}
+
+void PaymentQueue::Forget(uint32_t payment_id) {
+  std::lock_guard<std::mutex> lock(payments_lock_);
+  payments_.erase(payment_id);
+}
+
+void PaymentQueue::Run(std::function<void()> task) {
+  // payments are always made at the user's request, so their server
+  // requests go ahead of background refreshes
+  thread_pool_.start(new PaymentTask([task]() {
+    RequestExecutor::PriorityScope priority(RequestPriority::interactive_send);
+    task();
+  }));
+}
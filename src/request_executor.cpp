@@ -0,0 +1,144 @@
+/*
+ * This file is part of Megabit, a BIP44 HD wallet built on
+ * libbitcoin.
+ *
+ * Copyright (C) 2017 Neill Miller (neillm@thecodefactory.org)
+ *
+ * Megabit is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Megabit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Megabit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../include/megabit/request_executor.hpp"
+
+#include <algorithm>
+
+#include "../include/megabit/utils.hpp"
+
+namespace {
+
+thread_local RequestPriority current_priority = RequestPriority::background;
+
+}  // namespace
+
+RequestExecutor::PriorityScope::PriorityScope(RequestPriority priority)
+    : previous_(current_priority) {
+  current_priority = priority;
+}
+
+RequestExecutor::PriorityScope::~PriorityScope() {
+  current_priority = previous_;
+}
+
+RequestExecutor::RequestExecutor(size_t num_threads) : stopping_(false) {
+  MEGABIT_ASSERT(num_threads > 0);
+  for (size_t i = 0; i < num_threads; i++) {
+    threads_.emplace_back([this]() { Run(); });
+  }
+}
+
+RequestExecutor::~RequestExecutor() {
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    stopping_ = true;
+  }
+  available_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+bool RequestExecutor::InIoThread() const {
+  const auto id = std::this_thread::get_id();
+  return std::any_of(
+      threads_.begin(), threads_.end(),
+      [&id](const std::thread& thread) { return thread.get_id() == id; });
+}
+
+RequestPriority RequestExecutor::GetPriority() { return current_priority; }
+
+RequestSchedulerMetrics RequestExecutor::GetMetrics() {
+  RequestSchedulerMetrics metrics{};
+  std::lock_guard<std::mutex> lock(metrics_lock_);
+  for (size_t i = 0; i < num_request_priorities; i++) {
+    const auto& samples = samples_[i];
+    metrics.classes[i] = {
+        samples.requests,
+        megabit::utils::percentile(samples.wait_us, 0.5),
+        megabit::utils::percentile(samples.wait_us, 0.99),
+        megabit::utils::percentile(samples.latency_us, 0.5),
+        megabit::utils::percentile(samples.latency_us, 0.99)};
+  }
+  return metrics;
+}
+
+void RequestExecutor::Post(std::function<void()> task) {
+  const auto priority = current_priority;
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    tasks_[static_cast<size_t>(priority)].push_back(
+        {std::move(task), priority, Clock::now()});
+  }
+  available_.notify_one();
+}
+
+void RequestExecutor::Run() {
+  const auto next_queue = [this]() {
+    return std::find_if(
+        tasks_.begin(), tasks_.end(),
+        [](const std::deque<Task>& queue) { return !queue.empty(); });
+  };
+
+  while (true) {
+    Task task;
+    {
+      std::unique_lock<std::mutex> lock(lock_);
+      available_.wait(lock, [this, &next_queue]() {
+        return stopping_ || (next_queue() != tasks_.end());
+      });
+      const auto queue = next_queue();
+      if (queue == tasks_.end()) {
+        return;
+      }
+      task = std::move(queue->front());
+      queue->pop_front();
+    }
+
+    const auto started = Clock::now();
+    {
+      PriorityScope scope(task.priority);
+      task.run();
+    }
+    Record(task.priority, started - task.queued, Clock::now() - task.queued);
+  }
+}
+
+void RequestExecutor::Record(RequestPriority priority, Clock::duration wait,
+                             Clock::duration latency) {
+  const auto to_us = [](Clock::duration duration) {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(duration)
+            .count());
+  };
+
+  std::lock_guard<std::mutex> lock(metrics_lock_);
+  auto& samples = samples_[static_cast<size_t>(priority)];
+  samples.requests++;
+  if (samples.wait_us.size() < megabit::constants::max_latency_samples) {
+    samples.wait_us.push_back(to_us(wait));
+    samples.latency_us.push_back(to_us(latency));
+  } else {
+    samples.wait_us[samples.next] = to_us(wait);
+    samples.latency_us[samples.next] = to_us(latency);
+    samples.next = (samples.next + 1) % samples.wait_us.size();
+  }
+}
@@ -0,0 +1,164 @@
+/*
+ * This file is part of Megabit, a BIP44 HD wallet built on
+ * libbitcoin.
+ *
+ * Copyright (C) 2017 Neill Miller (neillm@thecodefactory.org)
+ *
+ * Megabit is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Megabit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Megabit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../include/megabit/request_log.hpp"
+
+#include <iostream>
+#include <thread>
+
+namespace {
+
+const std::string request_log_magic = "MBRL";
+const uint8_t request_log_version = 2;
+
+}  // namespace
+
+RequestLog::RequestLog() : mode_(RequestLogMode::off), flat_out_(false) {}
+
+bool RequestLog::Open(RequestLogMode mode, const std::string& file_name,
+                      bool flat_out) {
+  std::lock_guard<std::mutex> lock(lock_);
+  mode_ = RequestLogMode::off;
+  flat_out_ = flat_out;
+  responses_.clear();
+  if (output_.is_open()) {
+    output_.close();
+  }
+
+  if (mode == RequestLogMode::record) {
+    output_.open(file_name, std::ios::binary | std::ios::trunc);
+    if (!output_) {
+      std::cout << "Cannot record requests to " << file_name << std::endl;
+      return false;
+    }
+    libbitcoin::ostream_writer sink(output_);
+    sink.write_string(request_log_magic, request_log_magic.size());
+    sink.write_byte(request_log_version);
+    output_.flush();
+    std::cout << "Recording requests to " << file_name << std::endl;
+  } else if (mode == RequestLogMode::replay) {
+    std::ifstream input(file_name, std::ios::binary);
+    if (!input || !Load(input)) {
+      std::cout << "Cannot replay requests from " << file_name << std::endl;
+      return false;
+    }
+    std::cout << "Replaying " << responses_.size() << " distinct requests from "
+              << file_name << (flat_out_ ? " flat out" : " at recorded speed")
+              << std::endl;
+  }
+
+  mode_ = mode;
+  opened_ = Clock::now();
+  return true;
+}
+
+RequestLogMode RequestLog::GetMode() const { return mode_; }
+
+bool RequestLog::Replay(RequestType type, const libbitcoin::data_chunk& request,
+                        libbitcoin::data_chunk& response) {
+  if (mode_ != RequestLogMode::replay) {
+    return false;
+  }
+
+  std::chrono::microseconds elapsed{0};
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    const auto it = responses_.find({static_cast<uint8_t>(type), request});
+    if (it == responses_.end()) {
+      std::cout << "No recorded response for a request of type "
+                << static_cast<int>(type) << std::endl;
+      response.clear();
+      return true;
+    }
+
+    auto& responses = it->second;
+    const auto& recorded = responses.list[responses.next];
+    if (responses.next + 1 < responses.list.size()) {
+      responses.next++;
+    }
+    elapsed = recorded.elapsed;
+    response = recorded.data;
+  }
+
+  // requests run on the i/o threads, so waiting here keeps the
+  // recorded concurrency
+  if (!flat_out_) {
+    std::this_thread::sleep_for(elapsed);
+  }
+  return true;
+}
+
+void RequestLog::Record(RequestType type,
+                        const libbitcoin::data_chunk& request,
+                        Clock::time_point started,
+                        const Encoder& encode_response) {
+  if (mode_ != RequestLogMode::record) {
+    return;
+  }
+
+  const auto now = Clock::now();
+  const auto response = encode_response();
+  const auto start_us = std::chrono::duration_cast<std::chrono::microseconds>(
+      started - opened_);
+  const auto elapsed_us =
+      std::chrono::duration_cast<std::chrono::microseconds>(now - started);
+
+  std::lock_guard<std::mutex> lock(lock_);
+  libbitcoin::ostream_writer sink(output_);
+  sink.write_byte(static_cast<uint8_t>(type));
+  sink.write_variable_little_endian(
+      static_cast<uint64_t>(std::max<int64_t>(0, start_us.count())));
+  sink.write_variable_little_endian(
+      static_cast<uint64_t>(std::max<int64_t>(0, elapsed_us.count())));
+  sink.write_variable_little_endian(request.size());
+  sink.write_bytes(request);
+  sink.write_variable_little_endian(response.size());
+  sink.write_bytes(response);
+  // flushed per record so a session that ends abruptly still leaves a
+  // usable log
+  output_.flush();
+}
+
+bool RequestLog::Load(std::ifstream& input) {
+  libbitcoin::istream_reader source(input);
+  if ((source.read_string(request_log_magic.size()) != request_log_magic) ||
+      (source.read_byte() != request_log_version) || !source) {
+    return false;
+  }
+
+  while (input.peek() != std::char_traits<char>::eof()) {
+    const auto type = source.read_byte();
+    // the start time is only of interest when analysing a log
+    source.read_variable_little_endian();
+    const std::chrono::microseconds elapsed(
+        source.read_variable_little_endian());
+    auto request = source.read_bytes(
+        static_cast<size_t>(source.read_variable_little_endian()));
+    auto data = source.read_bytes(
+        static_cast<size_t>(source.read_variable_little_endian()));
+    if (!source) {
+      return false;
+    }
+
+    auto& responses = responses_[{type, std::move(request)}];
+    responses.list.push_back({elapsed, std::move(data)});
+  }
+  return true;
+}
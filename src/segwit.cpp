@@ -0,0 +1,281 @@
+/*
+ * This file is part of Megabit, a BIP44 HD wallet built on
+ * libbitcoin.
+ *
+ * Copyright (C) 2017 Neill Miller (neillm@thecodefactory.org)
+ *
+ * Megabit is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Megabit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Megabit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../include/megabit/segwit.hpp"
+
+#include "../include/megabit/utils.hpp"
+
+namespace megabit {
+namespace segwit {
+
+namespace {
+
+const std::string bech32_charset = "qpzry9x8gf2tvdw0s3jn54khce6mua7l";
+constexpr size_t bech32_checksum_length = 6;
+constexpr uint8_t witness_version_zero = 0;
+
+uint32_t bech32_polymod(const libbitcoin::data_chunk& values) {
+  static constexpr uint32_t generator[] = {0x3b6a57b2, 0x26508e6d, 0x1ea119fa,
+                                           0x3d4233dd, 0x2a1462b3};
+  uint32_t checksum = 1;
+  for (const auto value : values) {
+    const uint8_t top = checksum >> 25;
+    checksum = ((checksum & 0x1ffffff) << 5) ^ value;
+    for (size_t i = 0; i < 5; i++) {
+      if ((top >> i) & 1) {
+        checksum ^= generator[i];
+      }
+    }
+  }
+  return checksum;
+}
+
+libbitcoin::data_chunk bech32_expand_hrp(const std::string& hrp) {
+  libbitcoin::data_chunk expanded;
+  expanded.reserve((hrp.size() * 2) + 1);
+  for (const auto c : hrp) {
+    expanded.push_back(static_cast<uint8_t>(c) >> 5);
+  }
+  expanded.push_back(0);
+  for (const auto c : hrp) {
+    expanded.push_back(static_cast<uint8_t>(c) & 0x1f);
+  }
+  return expanded;
+}
+
+// regroups the bits of in from from_bits to to_bits sized values
+bool convert_bits(libbitcoin::data_chunk& out, const libbitcoin::data_chunk& in,
+                  size_t from_bits, size_t to_bits, bool pad) {
+  uint32_t accumulator = 0;
+  size_t bits = 0;
+  const uint32_t max_value = (1 << to_bits) - 1;
+  for (const auto value : in) {
+    if ((value >> from_bits) != 0) {
+      return false;
+    }
+    accumulator = (accumulator << from_bits) | value;
+    bits += from_bits;
+    while (bits >= to_bits) {
+      bits -= to_bits;
+      out.push_back((accumulator >> bits) & max_value);
+    }
+  }
+
+  if (pad) {
+    if (bits) {
+      out.push_back((accumulator << (to_bits - bits)) & max_value);
+    }
+  } else if ((bits >= from_bits) ||
+             ((accumulator << (to_bits - bits)) & max_value)) {
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+std::string bech32_encode(const std::string& hrp,
+                          const libbitcoin::data_chunk& values) {
+  auto checksum_input = bech32_expand_hrp(hrp);
+  libbitcoin::extend_data(checksum_input, values);
+  checksum_input.resize(checksum_input.size() + bech32_checksum_length, 0);
+  const auto checksum = bech32_polymod(checksum_input) ^ 1;
+
+  std::string encoded = hrp + "1";
+  encoded.reserve(encoded.size() + values.size() + bech32_checksum_length);
+  for (const auto value : values) {
+    encoded += bech32_charset[value];
+  }
+  for (size_t i = 0; i < bech32_checksum_length; i++) {
+    encoded += bech32_charset[(checksum >> (5 * (5 - i))) & 0x1f];
+  }
+  return encoded;
+}
+
+bool bech32_decode(std::string& hrp, libbitcoin::data_chunk& values,
+                   const std::string& encoded) {
+  auto lower = encoded;
+  std::transform(encoded.begin(), encoded.end(), lower.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+
+  // mixed case is not allowed
+  auto upper = encoded;
+  std::transform(encoded.begin(), encoded.end(), upper.begin(),
+                 [](unsigned char c) { return std::toupper(c); });
+  if ((encoded != lower) && (encoded != upper)) {
+    return false;
+  }
+
+  const auto separator = lower.rfind('1');
+  if ((separator == std::string::npos) || (separator == 0) ||
+      ((separator + bech32_checksum_length + 1) > lower.size()) ||
+      (lower.size() > 90)) {
+    return false;
+  }
+
+  libbitcoin::data_chunk decoded;
+  decoded.reserve(lower.size() - separator - 1);
+  for (size_t i = separator + 1; i < lower.size(); i++) {
+    const auto position = bech32_charset.find(lower[i]);
+    if (position == std::string::npos) {
+      return false;
+    }
+    decoded.push_back(static_cast<uint8_t>(position));
+  }
+
+  const auto cur_hrp = lower.substr(0, separator);
+  auto checksum_input = bech32_expand_hrp(cur_hrp);
+  libbitcoin::extend_data(checksum_input, decoded);
+  if (bech32_polymod(checksum_input) != 1) {
+    return false;
+  }
+
+  hrp = cur_hrp;
+  decoded.resize(decoded.size() - bech32_checksum_length);
+  values.swap(decoded);
+  return true;
+}
+
+std::string witness_address(const libbitcoin::short_hash& key_hash,
+                            const std::string& hrp) {
+  libbitcoin::data_chunk values{witness_version_zero};
+  convert_bits(values, libbitcoin::to_chunk(key_hash), 8, 5, true);
+  return bech32_encode(hrp, values);
+}
+
+bool decode_witness_address(libbitcoin::short_hash& key_hash,
+                            const std::string& address,
+                            const std::string& hrp) {
+  std::string cur_hrp;
+  libbitcoin::data_chunk values;
+  if (!bech32_decode(cur_hrp, values, address) || (cur_hrp != hrp) ||
+      values.empty() || (values[0] != witness_version_zero)) {
+    return false;
+  }
+
+  libbitcoin::data_chunk program;
+  const libbitcoin::data_chunk data(values.begin() + 1, values.end());
+  if (!convert_bits(program, data, 5, 8, false) ||
+      (program.size() != key_hash.size())) {
+    return false;
+  }
+
+  std::copy(program.begin(), program.end(), key_hash.begin());
+  return true;
+}
+
+libbitcoin::chain::script to_pay_witness_key_hash_script(
+    const libbitcoin::short_hash& key_hash) {
+  return libbitcoin::chain::script{libbitcoin::machine::operation::list{
+      {libbitcoin::machine::opcode::push_size_0},
+      {libbitcoin::to_chunk(key_hash)}}};
+}
+
+bool is_pay_witness_key_hash(const libbitcoin::chain::script& script,
+                             libbitcoin::short_hash& key_hash) {
+  const auto& ops = script.operations();
+  if ((ops.size() != 2) ||
+      (ops[0].code() != libbitcoin::machine::opcode::push_size_0) ||
+      (ops[1].data().size() != key_hash.size())) {
+    return false;
+  }
+
+  std::copy(ops[1].data().begin(), ops[1].data().end(), key_hash.begin());
+  return true;
+}
+
+SighashCache::SighashCache(const libbitcoin::chain::transaction& tx)
+    : tx_(tx) {
+  libbitcoin::data_chunk prevouts;
+  libbitcoin::data_chunk sequences;
+  prevouts.reserve(tx.inputs().size() *
+                   libbitcoin::chain::point::satoshi_fixed_size());
+  sequences.reserve(tx.inputs().size() * sizeof(uint32_t));
+  for (const auto& input : tx.inputs()) {
+    libbitcoin::extend_data(prevouts, input.previous_output().to_data());
+    libbitcoin::extend_data(sequences,
+                            libbitcoin::to_little_endian(input.sequence()));
+  }
+
+  libbitcoin::data_chunk outputs;
+  for (const auto& output : tx.outputs()) {
+    libbitcoin::extend_data(outputs, output.to_data());
+  }
+
+  hash_prevouts_ = libbitcoin::bitcoin_hash(prevouts);
+  hash_sequence_ = libbitcoin::bitcoin_hash(sequences);
+  hash_outputs_ = libbitcoin::bitcoin_hash(outputs);
+}
+
+libbitcoin::hash_digest SighashCache::signature_hash(
+    uint32_t input_index, const libbitcoin::short_hash& key_hash,
+    uint64_t value, uint8_t sighash_type) const {
+  MEGABIT_ASSERT(input_index < tx_.inputs().size());
+  MEGABIT_ASSERT(sighash_type == libbitcoin::machine::sighash_algorithm::all);
+
+  const auto& input = tx_.inputs()[input_index];
+
+  // the script code of a p2wpkh input is the p2pkh script of its
+  // key hash
+  const libbitcoin::chain::script script_code{
+      libbitcoin::chain::script::to_pay_key_hash_pattern(key_hash)};
+
+  libbitcoin::data_chunk preimage;
+  libbitcoin::extend_data(preimage,
+                          libbitcoin::to_little_endian(tx_.version()));
+  libbitcoin::extend_data(preimage, hash_prevouts_);
+  libbitcoin::extend_data(preimage, hash_sequence_);
+  libbitcoin::extend_data(preimage, input.previous_output().to_data());
+  libbitcoin::extend_data(preimage, script_code.to_data(true));
+  libbitcoin::extend_data(preimage, libbitcoin::to_little_endian(value));
+  libbitcoin::extend_data(preimage,
+                          libbitcoin::to_little_endian(input.sequence()));
+  libbitcoin::extend_data(preimage, hash_outputs_);
+  libbitcoin::extend_data(preimage,
+                          libbitcoin::to_little_endian(tx_.locktime()));
+  libbitcoin::extend_data(preimage, libbitcoin::to_little_endian(
+                                        static_cast<uint32_t>(sighash_type)));
+
+  return libbitcoin::bitcoin_hash(preimage);
+}
+
+bool create_witness_endorsement(libbitcoin::endorsement& out,
+                                const libbitcoin::ec_secret& secret,
+                                const SighashCache& sighash_cache,
+                                uint32_t input_index,
+                                const libbitcoin::short_hash& key_hash,
+                                uint64_t value, uint8_t sighash_type) {
+  const auto sighash = sighash_cache.signature_hash(input_index, key_hash,
+                                                    value, sighash_type);
+
+  libbitcoin::ec_signature signature;
+  libbitcoin::der_signature der_signature;
+  if (!libbitcoin::sign(signature, secret, sighash) ||
+      !libbitcoin::encode_signature(der_signature, signature)) {
+    return false;
+  }
+
+  out.assign(der_signature.begin(), der_signature.end());
+  out.push_back(sighash_type);
+  return true;
+}
+
+}  // namespace segwit
+}  // namespace megabit
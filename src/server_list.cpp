@@ -0,0 +1,517 @@
+/*
+ * This file is part of Megabit, a BIP44 HD wallet built on
+ * libbitcoin.
+ *
+ * Copyright (C) 2017 Neill Miller (neillm@thecodefactory.org)
+ *
+ * Megabit is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Megabit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Megabit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../include/megabit/server_list.hpp"
+
+#include <algorithm>
+
+#include "../include/megabit/utils.hpp"
+
+namespace {
+
+RequestOutcome GetOutcome(const libbitcoin::code& connection_error,
+                          bool oversubscribed) {
+  if (oversubscribed ||
+      (connection_error == libbitcoin::error::channel_timeout)) {
+    return RequestOutcome::congested;
+  }
+  return (connection_error ? RequestOutcome::failed
+                           : RequestOutcome::success);
+}
+
+}  // namespace
+
+ServerList::ServerList(size_t max_connections)
+    : max_connections_(max_connections),
+      failover_metrics_{},
+      hedging_(false),
+      latency_metrics_{},
+      next_latency_sample_(0),
+      attempt_executor_(max_connections *
+                        megabit::constants::hedge_threads_per_connection) {}
+
+void ServerList::SetHedging(bool hedging) {
+  std::lock_guard<std::mutex> lock(lock_);
+  hedging_ = hedging;
+}
+
+void ServerList::SetServers(const std::vector<ServerInfo>& servers) {
+  std::lock_guard<std::mutex> lock(lock_);
+  for (auto& server : servers_) {
+    server->enabled = false;
+  }
+
+  for (const auto& info : servers) {
+    auto server_iter =
+        std::find_if(servers_.begin(), servers_.end(),
+                     [&info](const std::unique_ptr<Server>& server) {
+                       return server->info.address == info.address;
+                     });
+    if (server_iter == servers_.end()) {
+      std::unique_ptr<Server> server(new Server{});
+      server->pool.reset(new ConnectionPool(max_connections_));
+      server->limiter.reset(new ConcurrencyLimiter(max_connections_));
+      server->stats.address = info.address;
+      servers_.push_back(std::move(server));
+      server_iter = std::prev(servers_.end());
+    }
+
+    auto& server = *server_iter;
+    server->info = info;
+    server->pool->SetServerInfo(info.address, info.public_key);
+    server->enabled = true;
+  }
+}
+
+bool ServerList::Probe() {
+  std::vector<Server*> servers;
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    for (auto& server : servers_) {
+      if (server->enabled) {
+        servers.push_back(server.get());
+      }
+    }
+  }
+
+  bool reachable = false;
+  for (auto server : servers) {
+    const auto start_time = std::chrono::steady_clock::now();
+    bool failed = true;
+    auto lease = server->pool->Acquire();
+    if (lease) {
+      libbitcoin::code result = libbitcoin::error::success;
+      lease->blockchain_fetch_last_height(
+          [&result](const libbitcoin::code& error) { result = error; },
+          [](size_t /* height */) {});
+      lease->wait();
+      failed = static_cast<bool>(result);
+      if (failed) {
+        lease.Discard();
+      }
+    }
+
+    if (failed) {
+      OnFailure(server);
+      continue;
+    }
+    reachable = true;
+    OnSuccess(server,
+              std::chrono::duration_cast<std::chrono::microseconds>(
+                  std::chrono::steady_clock::now() - start_time)
+                  .count());
+  }
+
+  for (const auto& stats : GetServerStats()) {
+    std::cout << "Server " << stats.address << ": "
+              << (stats.consecutive_failures
+                      ? std::string("unreachable")
+                      : (std::to_string(stats.latency_us) + "us"))
+              << std::endl;
+  }
+  return reachable;
+}
+
+bool ServerList::Perform(const ServerRequest& request,
+                         const ServerErrorHandler& on_error) {
+  const auto start_time = std::chrono::steady_clock::now();
+  libbitcoin::code connection_error = libbitcoin::error::channel_timeout;
+  bool failed_over = false;
+
+  for (auto server : GetRanked()) {
+    const auto request_start_time = std::chrono::steady_clock::now();
+    auto permit = server->limiter->Acquire();
+    auto lease = (permit ? server->pool->Acquire() : ConnectionPool::Lease());
+    if (!lease) {
+      OnFailure(server);
+      failed_over = true;
+      continue;
+    }
+
+    // only the first connection error is kept, the request's own
+    // failures go to the caller
+    libbitcoin::code result = libbitcoin::error::success;
+    bool oversubscribed = false;
+    request(*lease, [&result, &oversubscribed,
+                     &on_error](const libbitcoin::code& error) {
+      if (IsConnectionError(error)) {
+        if (!result) {
+          result = error;
+        }
+      } else {
+        oversubscribed =
+            (oversubscribed || (error == libbitcoin::error::oversubscribed));
+        on_error(error);
+      }
+    });
+    permit.Release(GetOutcome(result, oversubscribed));
+
+    if (result) {
+      std::cout << "Request to " << server->info.address
+                << " failed: " << result << std::endl;
+      lease.Discard();
+      OnFailure(server);
+      connection_error = result;
+      failed_over = true;
+      continue;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    OnSuccess(server, std::chrono::duration_cast<std::chrono::microseconds>(
+                          now - request_start_time)
+                          .count());
+    if (failed_over) {
+      const uint64_t failover_us =
+          std::chrono::duration_cast<std::chrono::microseconds>(now -
+                                                                start_time)
+              .count();
+      std::lock_guard<std::mutex> lock(lock_);
+      ++failover_metrics_.failovers;
+      failover_metrics_.total_failover_us += failover_us;
+      failover_metrics_.max_failover_us =
+          std::max(failover_metrics_.max_failover_us, failover_us);
+      std::cout << "Request failed over to " << server->info.address << ": "
+                << failover_metrics_ << std::endl;
+    }
+    RecordLatency(std::chrono::duration_cast<std::chrono::microseconds>(
+                      now - start_time)
+                      .count());
+    return true;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    ++failover_metrics_.exhausted;
+  }
+  RecordLatency(std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start_time)
+                    .count());
+  on_error(connection_error);
+  return false;
+}
+
+bool ServerList::PerformHedged(
+    const std::function<void(size_t count)>& prepare,
+    const HedgedAttempt& attempt, size_t& winner,
+    const ServerErrorHandler& on_error) {
+  const auto start_time = std::chrono::steady_clock::now();
+  const auto ranked = GetRanked();
+  prepare(ranked.size());
+
+  struct Hedge {
+    std::mutex lock;
+    std::condition_variable done;
+    size_t finished;
+    bool won;
+    size_t winner;
+    libbitcoin::code connection_error;
+    std::vector<libbitcoin::code> request_errors;
+  };
+  auto hedge = std::make_shared<Hedge>();
+  hedge->finished = 0;
+  hedge->won = false;
+  hedge->winner = 0;
+  hedge->connection_error = libbitcoin::error::channel_timeout;
+
+  auto launch = [this, &ranked, &attempt, hedge](size_t index) {
+    auto server = ranked[index];
+    attempt_executor_.Submit<void>([this, server, attempt, hedge, index]() {
+      const auto attempt_start_time = std::chrono::steady_clock::now();
+      libbitcoin::code result = libbitcoin::error::success;
+      std::vector<libbitcoin::code> request_errors;
+      {
+        auto permit = server->limiter->Acquire();
+        auto lease =
+            (permit ? server->pool->Acquire() : ConnectionPool::Lease());
+        if (!lease) {
+          result = libbitcoin::error::channel_timeout;
+        } else {
+          try {
+            attempt(*lease,
+                    [&result, &request_errors](const libbitcoin::code& error) {
+                      if (!IsConnectionError(error)) {
+                        request_errors.push_back(error);
+                      } else if (!result) {
+                        result = error;
+                      }
+                    },
+                    index);
+          } catch (const std::exception& e) {
+            // the waiting read must still see this attempt finish
+            std::cout << "Read on " << server->info.address
+                      << " failed: " << e.what() << std::endl;
+            result = libbitcoin::error::operation_failed;
+          }
+          if (result) {
+            lease.Discard();
+          }
+          permit.Release(GetOutcome(
+              result,
+              std::find(request_errors.begin(), request_errors.end(),
+                        libbitcoin::error::oversubscribed) !=
+                  request_errors.end()));
+        }
+      }
+
+      if (result) {
+        OnFailure(server);
+      } else {
+        OnSuccess(server,
+                  std::chrono::duration_cast<std::chrono::microseconds>(
+                      std::chrono::steady_clock::now() - attempt_start_time)
+                      .count());
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(hedge->lock);
+        ++hedge->finished;
+        if (result) {
+          hedge->connection_error = result;
+        } else if (!hedge->won) {
+          hedge->won = true;
+          hedge->winner = index;
+          hedge->request_errors = request_errors;
+        }
+      }
+      hedge->done.notify_all();
+    });
+  };
+
+  // the first server gets the read, the second a duplicate once the
+  // read is slower than usual, and the others only on failures
+  size_t launched = 0;
+  bool hedged = false;
+  if (!ranked.empty()) {
+    launch(launched++);
+  }
+  const auto hedge_time =
+      start_time + (ranked.empty() ? std::chrono::microseconds(0)
+                                   : GetHedgeDelay(ranked.front()));
+
+  std::unique_lock<std::mutex> lock(hedge->lock);
+  while (!hedge->won) {
+    const auto all_failed = (hedge->finished == launched);
+    const auto hedge_due =
+        (!hedged && (std::chrono::steady_clock::now() >= hedge_time));
+    if ((launched < ranked.size()) && (all_failed || hedge_due)) {
+      hedged = (hedged || !all_failed);
+      lock.unlock();
+      launch(launched++);
+      lock.lock();
+      continue;
+    }
+    if (all_failed) {
+      break;
+    }
+
+    if (!hedged && (launched < ranked.size())) {
+      hedge->done.wait_until(lock, hedge_time);
+    } else {
+      hedge->done.wait(lock);
+    }
+  }
+
+  const auto won = hedge->won;
+  const auto connection_error = hedge->connection_error;
+  const auto request_errors = hedge->request_errors;
+  winner = hedge->winner;
+  lock.unlock();
+
+  {
+    std::lock_guard<std::mutex> list_lock(lock_);
+    if (hedged) {
+      ++latency_metrics_.hedged;
+      if (won && winner) {
+        ++latency_metrics_.hedge_wins;
+      }
+    }
+    if (!won) {
+      ++failover_metrics_.exhausted;
+    }
+  }
+  RecordLatency(std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start_time)
+                    .count());
+
+  for (const auto& error : request_errors) {
+    on_error(error);
+  }
+  if (!won) {
+    on_error(connection_error);
+  }
+  return won;
+}
+
+std::chrono::microseconds ServerList::GetHedgeDelay(Server* server) {
+  std::lock_guard<std::mutex> lock(lock_);
+  if (server->latency_samples.size() <
+      megabit::constants::min_hedge_latency_samples) {
+    return std::chrono::milliseconds(
+        megabit::constants::default_hedge_delay_ms);
+  }
+  return std::max<std::chrono::microseconds>(
+      std::chrono::milliseconds(megabit::constants::min_hedge_delay_ms),
+      std::chrono::microseconds(
+          megabit::utils::percentile(
+              server->latency_samples,
+              megabit::constants::hedge_latency_percentile)));
+}
+
+void ServerList::RecordLatency(uint64_t latency_us) {
+  std::lock_guard<std::mutex> lock(lock_);
+  ++latency_metrics_.requests;
+  if (latency_samples_.size() < megabit::constants::max_latency_samples) {
+    latency_samples_.push_back(latency_us);
+  } else {
+    latency_samples_[next_latency_sample_] = latency_us;
+  }
+  next_latency_sample_ =
+      (next_latency_sample_ + 1) % megabit::constants::max_latency_samples;
+}
+
+ServerInfo ServerList::GetPrimary() {
+  const auto ranked = GetRanked();
+  return (ranked.empty() ? ServerInfo{} : ranked.front()->info);
+}
+
+std::vector<ServerStats> ServerList::GetServerStats() {
+  std::lock_guard<std::mutex> lock(lock_);
+  std::vector<ServerStats> stats;
+  for (const auto& server : servers_) {
+    if (server->enabled) {
+      stats.push_back(server->stats);
+      stats.back().concurrency = server->limiter->GetMetrics();
+    }
+  }
+  return stats;
+}
+
+FailoverMetrics ServerList::GetFailoverMetrics() {
+  std::lock_guard<std::mutex> lock(lock_);
+  return failover_metrics_;
+}
+
+LatencyMetrics ServerList::GetLatencyMetrics() {
+  std::lock_guard<std::mutex> lock(lock_);
+  auto metrics = latency_metrics_;
+  metrics.p50_us = megabit::utils::percentile(latency_samples_, 0.5);
+  metrics.p99_us = megabit::utils::percentile(latency_samples_, 0.99);
+  return metrics;
+}
+
+ConnectionPoolMetrics ServerList::GetConnectionPoolMetrics() {
+  std::vector<ConnectionPool*> pools;
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    for (const auto& server : servers_) {
+      pools.push_back(server->pool.get());
+    }
+  }
+
+  ConnectionPoolMetrics total{};
+  for (auto pool : pools) {
+    const auto metrics = pool->GetMetrics();
+    total.connects += metrics.connects;
+    total.acquisitions += metrics.acquisitions;
+    total.acquire_timeouts += metrics.acquire_timeouts;
+    total.total_acquire_wait_us += metrics.total_acquire_wait_us;
+    total.max_acquire_wait_us =
+        std::max(total.max_acquire_wait_us, metrics.max_acquire_wait_us);
+    total.connections += metrics.connections;
+    total.in_use += metrics.in_use;
+    total.peak_in_use += metrics.peak_in_use;
+  }
+  return total;
+}
+
+bool ServerList::IsConnectionError(const libbitcoin::code& error) {
+  return ((error == libbitcoin::error::channel_timeout) ||
+          (error == libbitcoin::error::channel_stopped) ||
+          (error == libbitcoin::error::service_stopped) ||
+          (error == libbitcoin::error::network_unreachable) ||
+          (error == libbitcoin::error::resolve_failed) ||
+          (error == libbitcoin::error::bad_stream));
+}
+
+std::vector<ServerList::Server*> ServerList::GetRanked() {
+  std::lock_guard<std::mutex> lock(lock_);
+  const auto now = std::chrono::steady_clock::now();
+  std::vector<Server*> ranked;
+  for (auto& server : servers_) {
+    if (server->enabled) {
+      server->stats.backing_off = (now < server->backoff_until);
+      ranked.push_back(server.get());
+    }
+  }
+
+  // servers backing off are still tried last, so that requests can
+  // succeed when every server had failed recently
+  std::stable_sort(ranked.begin(), ranked.end(),
+                   [](const Server* lhs, const Server* rhs) {
+                     if (lhs->stats.backing_off != rhs->stats.backing_off) {
+                       return rhs->stats.backing_off;
+                     }
+                     if (lhs->stats.backing_off) {
+                       return lhs->backoff_until < rhs->backoff_until;
+                     }
+                     return lhs->stats.latency_us < rhs->stats.latency_us;
+                   });
+  return ranked;
+}
+
+void ServerList::OnSuccess(Server* server, uint64_t latency_us) {
+  std::lock_guard<std::mutex> lock(lock_);
+  auto& stats = server->stats;
+  stats.latency_us = (stats.requests && !stats.consecutive_failures)
+                         ? ((7 * stats.latency_us + latency_us) / 8)
+                         : latency_us;
+  stats.max_latency_us = std::max(stats.max_latency_us, latency_us);
+  ++stats.requests;
+  stats.consecutive_failures = 0;
+  server->backoff_until = {};
+
+  if (server->latency_samples.size() <
+      megabit::constants::max_hedge_latency_samples) {
+    server->latency_samples.push_back(latency_us);
+  } else {
+    server->latency_samples[server->next_sample] = latency_us;
+  }
+  server->next_sample = (server->next_sample + 1) %
+                        megabit::constants::max_hedge_latency_samples;
+}
+
+void ServerList::OnFailure(Server* server) {
+  std::lock_guard<std::mutex> lock(lock_);
+  auto& stats = server->stats;
+  ++stats.requests;
+  ++stats.failures;
+  ++stats.consecutive_failures;
+
+  const auto exponent = std::min<uint32_t>(stats.consecutive_failures - 1, 16);
+  const auto backoff_ms =
+      std::min<uint64_t>(megabit::constants::server_backoff_max_ms,
+                         static_cast<uint64_t>(
+                             megabit::constants::server_backoff_base_ms)
+                             << exponent);
+  server->backoff_until = std::chrono::steady_clock::now() +
+                          std::chrono::milliseconds(backoff_ms);
+  std::cout << "Backing off from " << server->info.address << " for "
+            << backoff_ms << "ms" << std::endl;
+}
@@ -0,0 +1,334 @@
+/*
+ * This file is part of Megabit, a BIP44 HD wallet built on
+ * libbitcoin.
+ *
+ * Copyright (C) 2017 Neill Miller (neillm@thecodefactory.org)
+ *
+ * Megabit is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Megabit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Megabit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../include/megabit/subscription_dispatcher.hpp"
+
+#include <algorithm>
+
+void SubscriptionDispatcher::Subscribe(const std::string& address,
+                                       AddressNotificationHandler handler) {
+  const auto query_address = bitcoin_interface_.GetQueryAddress(address);
+  if (!query_address) {
+    std::cout << "Cannot subscribe to invalid address " << address
+              << std::endl;
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(subscriptions_lock_);
+  auto& subscription = subscriptions_[query_address.hash()];
+  if (subscription.address.empty()) {
+    subscription.address = address;
+    subscription.query_address = query_address;
+    replan_ = true;
+  }
+  subscription.handler = handler;
+}
+
+void SubscriptionDispatcher::SetUnroutedHandler(
+    UnroutedNotificationHandler handler) {
+  std::lock_guard<std::mutex> lock(subscriptions_lock_);
+  unrouted_handler_ = handler;
+}
+
+void SubscriptionDispatcher::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(pending_lock_);
+    running_ = false;
+  }
+  pending_changed_.notify_all();
+}
+
+void SubscriptionDispatcher::Run() {
+  std::cout << "Subscription dispatcher running" << std::endl;
+  retry_thread_ = std::thread([this]() { RetryPending(); });
+  while (running_) {
+    if (!client_ && !Connect()) {
+      emit SubscriptionError(
+          tr("Cannot connect to the server to listen for transactions"));
+      QThread::msleep(megabit::constants::subscription_retry_ms);
+      continue;
+    }
+
+    // server side subscriptions expire, so they're renewed before then
+    const auto now = std::chrono::steady_clock::now();
+    if (now - last_renewal_ > std::chrono::seconds(
+                                  megabit::constants::subscription_renewal_s)) {
+      ResubscribeAll();
+      last_renewal_ = now;
+    }
+
+    SubscribePending();
+    if (client_) {
+      client_->monitor(megabit::constants::subscription_monitor_period_s);
+    }
+  }
+  retry_thread_.join();
+
+  if (client_) {
+    // the server keeps notifying this connection of the
+    // subscriptions, so it isn't handed out again
+    client_.Discard();
+  }
+
+  std::cout << "Subscription dispatcher stopped" << std::endl;
+  emit finished();
+}
+
+bool SubscriptionDispatcher::Connect() {
+  client_ = bitcoin_interface_.GetSubscriptionPool().Acquire();
+  if (!client_) {
+    return false;
+  }
+
+  client_->set_on_update(
+      [this](const libbitcoin::code& code, uint16_t sequence, size_t height,
+             const libbitcoin::hash_digest& tx_hash) {
+        OnNotification(code, sequence, height, tx_hash);
+      });
+
+  // a new connection has none of our subscriptions
+  ResubscribeAll();
+  last_renewal_ = std::chrono::steady_clock::now();
+  return true;
+}
+
+void SubscriptionDispatcher::ResubscribeAll() {
+  std::lock_guard<std::mutex> lock(subscriptions_lock_);
+  subscribed_prefixes_.clear();
+  replan_ = true;
+}
+
+void SubscriptionDispatcher::SubscribePending() {
+  static constexpr size_t key_hash_bits =
+      libbitcoin::short_hash_size * libbitcoin::byte_bits;
+
+  // full length prefixes are exact address subscriptions
+  std::vector<libbitcoin::binary> prefixes;
+  std::vector<libbitcoin::wallet::payment_address> query_addresses;
+  {
+    std::lock_guard<std::mutex> lock(subscriptions_lock_);
+    if (!replan_) {
+      return;
+    }
+    replan_ = false;
+
+    std::vector<libbitcoin::short_hash> key_hashes;
+    for (const auto& subscription : subscriptions_) {
+      key_hashes.push_back(subscription.first);
+    }
+    const auto plan = planner_.Plan(key_hashes);
+    std::cout << "Planned " << plan.prefixes.size() << " subscriptions of "
+              << plan.prefix_bits << " bits for " << key_hashes.size()
+              << " wallet addresses (false positive rate "
+              << plan.false_positive_rate << ")" << std::endl;
+
+    // prefixes of an earlier plan stay subscribed until the server
+    // expires them, their notifications are dropped as false positives
+    for (const auto& prefix : plan.prefixes) {
+      if (std::find(subscribed_prefixes_.begin(), subscribed_prefixes_.end(),
+                    prefix) != subscribed_prefixes_.end()) {
+        continue;
+      }
+      if (prefix.size() == key_hash_bits) {
+        libbitcoin::short_hash key_hash;
+        std::copy(prefix.blocks().begin(), prefix.blocks().end(),
+                  key_hash.begin());
+        query_addresses.push_back(subscriptions_[key_hash].query_address);
+      } else {
+        prefixes.push_back(prefix);
+      }
+    }
+    subscribed_prefixes_ = plan.prefixes;
+  }
+
+  const auto num_subscriptions = prefixes.size() + query_addresses.size();
+  if (!num_subscriptions) {
+    return;
+  }
+
+  size_t num_failed = 0;
+  auto on_error = [&num_failed](const libbitcoin::code& code) {
+    if (code && (code != libbitcoin::error::oversubscribed)) {
+      ++num_failed;
+    }
+  };
+  auto on_subscribed = [&num_failed](const libbitcoin::code& code) {
+    if (code) {
+      ++num_failed;
+    }
+  };
+
+  // all subscriptions are sent before waiting for the replies
+  for (const auto& prefix : prefixes) {
+    client_->subscribe_address(on_error, on_subscribed, prefix);
+  }
+  for (const auto& query_address : query_addresses) {
+    client_->subscribe_address(on_error, on_subscribed, query_address);
+  }
+  client_->wait();
+
+  std::cout << "Subscribed " << (num_subscriptions - num_failed) << " of "
+            << num_subscriptions << " address prefixes" << std::endl;
+
+  if (num_failed) {
+    // the connection is replaced, which subscribes everything again
+    client_.Discard();
+    ResubscribeAll();
+    emit SubscriptionError(tr("Failed to listen for transactions on ") +
+                           QString::number(num_failed) +
+                           tr(" address prefixes"));
+  }
+}
+
+void SubscriptionDispatcher::OnNotification(
+    const libbitcoin::code& code, uint16_t sequence, size_t height,
+    const libbitcoin::hash_digest& tx_hash) {
+  std::cout << "Subscription notification with code " << code
+            << ", height: " << height << ", seq: " << sequence
+            << ", tx_hash: " << libbitcoin::encode_base16(tx_hash)
+            << std::endl;
+
+  if (code == libbitcoin::error::channel_timeout) {
+    ResubscribeAll();
+    return;
+  } else if (code) {
+    return;
+  }
+
+  if (!Route(sequence, height, tx_hash)) {
+    {
+      std::lock_guard<std::mutex> lock(pending_lock_);
+      pending_.push_back(
+          {sequence, height, tx_hash, 0,
+           std::chrono::steady_clock::now() +
+               std::chrono::milliseconds(
+                   megabit::constants::notification_retry_base_ms)});
+    }
+    pending_changed_.notify_all();
+  }
+}
+
+bool SubscriptionDispatcher::Route(uint16_t sequence, size_t height,
+                                   const libbitcoin::hash_digest& tx_hash) {
+  // find the wallet addresses that the transaction pays or spends from
+  RequestExecutor::PriorityScope priority(RequestPriority::subscription);
+  TxBlockInfo tx_block_info{};
+  const auto unconfirmed = (height == 0);
+  const auto found =
+      (bitcoin_interface_.GetTransactionInfo(tx_hash, tx_block_info,
+                                             unconfirmed) ||
+       bitcoin_interface_.GetTransactionInfo(tx_hash, tx_block_info,
+                                             !unconfirmed));
+  if (!found) {
+    return false;
+  }
+  const auto key_hashes =
+      bitcoin_interface_.GetTransactionKeyHashes(tx_block_info.tx);
+
+  std::vector<std::pair<std::string, AddressNotificationHandler>> targets;
+  {
+    std::lock_guard<std::mutex> lock(subscriptions_lock_);
+    for (const auto& key_hash : key_hashes) {
+      const auto subscription_iter = subscriptions_.find(key_hash);
+      if ((subscription_iter != subscriptions_.end()) &&
+          subscription_iter->second.handler) {
+        targets.emplace_back(subscription_iter->second.address,
+                             subscription_iter->second.handler);
+      }
+    }
+  }
+
+  if (targets.empty()) {
+    // matched one of our prefixes, but none of our addresses
+    std::cout << "Dropped false positive notification ("
+              << ++false_positives_ << " so far)" << std::endl;
+    return true;
+  }
+
+  for (const auto& target : targets) {
+    target.second(target.first, libbitcoin::error::success, sequence, height,
+                  tx_hash);
+  }
+  return true;
+}
+
+void SubscriptionDispatcher::RetryPending() {
+  std::unique_lock<std::mutex> lock(pending_lock_);
+  while (running_) {
+    if (pending_.empty()) {
+      pending_changed_.wait(lock);
+      continue;
+    }
+
+    const auto next = std::min_element(
+        pending_.begin(), pending_.end(),
+        [](const PendingNotification& lhs, const PendingNotification& rhs) {
+          return lhs.retry_at < rhs.retry_at;
+        });
+    if (std::chrono::steady_clock::now() < next->retry_at) {
+      pending_changed_.wait_until(lock, next->retry_at);
+      continue;
+    }
+
+    auto notification = *next;
+    pending_.erase(next);
+    lock.unlock();
+
+    ++retries_;
+    auto done = true;
+    if (Route(notification.sequence, notification.height,
+              notification.tx_hash)) {
+      std::cout << "Routed notification after " << (notification.retries + 1)
+                << " retries (" << retries_ << " so far)" << std::endl;
+    } else if (++notification.retries >=
+               megabit::constants::notification_max_retries) {
+      std::cout << "Giving up on notification for "
+                << libbitcoin::encode_hash(notification.tx_hash) << std::endl;
+      Unrouted(notification.height, notification.tx_hash);
+    } else {
+      const auto exponent = std::min<uint32_t>(notification.retries, 16);
+      const auto delay_ms = std::min<uint64_t>(
+          megabit::constants::notification_retry_max_ms,
+          static_cast<uint64_t>(
+              megabit::constants::notification_retry_base_ms)
+              << exponent);
+      notification.retry_at = std::chrono::steady_clock::now() +
+                              std::chrono::milliseconds(delay_ms);
+      done = false;
+    }
+
+    lock.lock();
+    if (!done) {
+      pending_.push_back(notification);
+    }
+  }
+}
+
+void SubscriptionDispatcher::Unrouted(size_t height,
+                                      const libbitcoin::hash_digest& tx_hash) {
+  UnroutedNotificationHandler unrouted_handler;
+  {
+    std::lock_guard<std::mutex> lock(subscriptions_lock_);
+    unrouted_handler = unrouted_handler_;
+  }
+  if (unrouted_handler) {
+    unrouted_handler(height, tx_hash);
+  }
+}
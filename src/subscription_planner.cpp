@@ -0,0 +1,102 @@
+/*
+ * This file is part of Megabit, a BIP44 HD wallet built on
+ * libbitcoin.
+ *
+ * Copyright (C) 2017 Neill Miller (neillm@thecodefactory.org)
+ *
+ * Megabit is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Megabit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Megabit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../include/megabit/subscription_planner.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+static constexpr size_t key_hash_bits =
+    libbitcoin::short_hash_size * libbitcoin::byte_bits;
+
+// number of leading bits that two key hashes share
+static size_t CommonPrefixBits(const libbitcoin::short_hash& lhs,
+                               const libbitcoin::short_hash& rhs) {
+  for (size_t byte = 0; byte < libbitcoin::short_hash_size; byte++) {
+    const uint8_t difference = lhs[byte] ^ rhs[byte];
+    if (difference) {
+      size_t bits = byte * libbitcoin::byte_bits;
+      for (uint8_t mask = 0x80; !(difference & mask); mask >>= 1) {
+        ++bits;
+      }
+      return bits;
+    }
+  }
+  return key_hash_bits;
+}
+
+SubscriptionPlan SubscriptionPlanner::Plan(
+    std::vector<libbitcoin::short_hash> key_hashes) const {
+  SubscriptionPlan plan{key_hash_bits, {}, 0.0};
+  std::sort(key_hashes.begin(), key_hashes.end());
+  key_hashes.erase(std::unique(key_hashes.begin(), key_hashes.end()),
+                   key_hashes.end());
+  if (key_hashes.empty()) {
+    return plan;
+  }
+
+  // with the hashes sorted, the number of distinct prefixes of length
+  // bits is one more than the number of neighbours sharing fewer
+  // than bits leading bits.  splits[bits] counts those neighbours.
+  std::vector<size_t> splits(key_hash_bits + 1, 0);
+  for (size_t i = 1; i < key_hashes.size(); i++) {
+    ++splits[CommonPrefixBits(key_hashes[i - 1], key_hashes[i])];
+  }
+
+  size_t num_prefixes = 1;
+  size_t within_limit_bits = 0;
+  size_t chosen_bits = 0;
+  for (size_t bits = 1; bits <= key_hash_bits; bits++) {
+    num_prefixes += splits[bits - 1];
+    if (num_prefixes <= max_subscriptions_) {
+      within_limit_bits = bits;
+    }
+    const auto false_positive_rate =
+        num_prefixes * std::ldexp(1.0, -static_cast<int>(bits));
+    if (false_positive_rate <= max_false_positive_rate_) {
+      chosen_bits = bits;
+      break;
+    }
+  }
+
+  if (!chosen_bits ||
+      ((chosen_bits > within_limit_bits) && within_limit_bits)) {
+    chosen_bits = within_limit_bits ? within_limit_bits : key_hash_bits;
+  }
+
+  plan.prefix_bits = chosen_bits;
+  for (const auto& key_hash : key_hashes) {
+    const libbitcoin::binary prefix{chosen_bits, key_hash};
+    if (plan.prefixes.empty() || !(plan.prefixes.back() == prefix)) {
+      plan.prefixes.push_back(prefix);
+    }
+  }
+  plan.false_positive_rate =
+      (chosen_bits == key_hash_bits)
+          ? 0.0
+          : plan.prefixes.size() *
+                std::ldexp(1.0, -static_cast<int>(chosen_bits));
+  return plan;
+}
+
+bool SubscriptionPlanner::Matches(const libbitcoin::binary& prefix,
+                                  const libbitcoin::short_hash& key_hash) {
+  return prefix.is_prefix_of(key_hash);
+}
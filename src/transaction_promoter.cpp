@@ -18,33 +18,13 @@
  * along with Megabit.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#ifndef __BLOCK_HEIGHT_THREAD_HPP
-#define __BLOCK_HEIGHT_THREAD_HPP
-
-#include <QThread>
-
-#include "bitcoin_interface.hpp"
-
-class BlockHeightThread : public QObject {
-  Q_OBJECT
-
- public:
-  explicit BlockHeightThread(BitcoinInterface& bitcoin_interface,
-                             size_t& block_height)
-      : bitcoin_interface_(bitcoin_interface), block_height_(block_height) {}
-
-  ~BlockHeightThread() {}
-
- public slots:
-  void GetBlockHeight();
-
- signals:
-  void finished();
-  void BlockHeightError(QString error);
-
- private:
-  BitcoinInterface& bitcoin_interface_;
-  size_t& block_height_;
-};
-
-#endif  // __BLOCK_HEIGHT_THREAD_HPP
+#include "../include/megabit/transaction_promoter.hpp"
+
+void TransactionPromoter::Promote(quint32 generation) {
+  RequestExecutor::PriorityScope priority(RequestPriority::background);
+  const auto confirmed = bitcoin_interface_.PromoteConfirmedTransactions();
+  emit TransactionsPromoted(generation, confirmed);
+  if (!bitcoin_interface_.VerifyWitnessIndexing(confirmed)) {
+    emit WitnessHistoryMissing();
+  }
+}
@@ -20,6 +20,7 @@
 
 #include "../include/megabit/utils.hpp"
 
+#include <algorithm>
 #include <bitcoin/bitcoin.hpp>
 
 namespace megabit {
@@ -170,6 +171,16 @@ std::string to_string(const libbitcoin::chain::transaction& tx) {
   return value.str();
 }
 
+uint64_t percentile(std::vector<uint64_t> samples, double p) {
+  if (samples.empty()) {
+    return 0;
+  }
+  const auto rank = std::min(samples.size() - 1,
+                             static_cast<size_t>(p * samples.size()));
+  std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+  return samples[rank];
+}
+
 }  // namespace utils
 
 }  // namespace megabit
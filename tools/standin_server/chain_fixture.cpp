@@ -0,0 +1,375 @@
+/*
+ * This file is part of Megabit, a BIP44 HD wallet built on
+ * libbitcoin.
+ *
+ * Copyright (C) 2017 Neill Miller (neillm@thecodefactory.org)
+ *
+ * Megabit is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Megabit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Megabit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "chain_fixture.hpp"
+
+#include "../../include/megabit/segwit.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+// the genesis time of the main network, so that block times look
+// plausible
+const uint32_t fixture_genesis_time = 1231006505;
+const uint32_t fixture_block_interval_s = 600;
+// regtest difficulty, headers aren't actually mined
+const uint32_t fixture_bits = 0x207fffff;
+const uint64_t fixture_fee = 1000;
+
+}  // namespace
+
+ChainFixture::ChainFixture(const std::vector<std::string>& addresses,
+                           const FixtureOptions& options)
+    : random_(options.seed) {
+  std::vector<std::vector<libbitcoin::chain::transaction>> blocks(
+      options.chain_height + 1);
+  std::uniform_int_distribution<size_t> random_height(1,
+                                                      options.chain_height);
+  std::uniform_int_distribution<uint64_t> random_value(options.min_value,
+                                                       options.max_value);
+  std::bernoulli_distribution random_spend(options.spend_fraction);
+
+  const auto make_input = [](const libbitcoin::chain::output_point& point) {
+    return libbitcoin::chain::input(point, libbitcoin::chain::script{},
+                                    libbitcoin::max_input_sequence);
+  };
+
+  for (const auto& address : addresses) {
+    libbitcoin::short_hash key_hash;
+    const auto script = GetOutputScript(address, key_hash);
+
+    for (size_t i = 0; i < options.payments_per_address; i++) {
+      const auto height = random_height(random_);
+      const auto value = random_value(random_);
+
+      libbitcoin::chain::transaction payment;
+      payment.set_version(1);
+      payment.set_inputs({make_input({RandomHash(), 0})});
+      payment.set_outputs(
+          {{value, script},
+           {random_value(random_),
+            libbitcoin::chain::script::to_pay_key_hash_pattern(
+                RandomKeyHash())}});
+      blocks[height].push_back(payment);
+
+      if (height == options.chain_height || !random_spend(random_)) {
+        continue;
+      }
+
+      std::uniform_int_distribution<size_t> random_spend_height(
+          height + 1, options.chain_height);
+      libbitcoin::chain::transaction spend;
+      spend.set_version(1);
+      spend.set_inputs({make_input({payment.hash(), 0})});
+      spend.set_outputs(
+          {{value > fixture_fee ? value - fixture_fee : 0,
+            libbitcoin::chain::script::to_pay_key_hash_pattern(
+                RandomKeyHash())}});
+      blocks[random_spend_height(random_)].push_back(spend);
+    }
+  }
+
+  std::vector<std::pair<libbitcoin::hash_digest, libbitcoin::short_hash>>
+      touched;
+  for (auto& block : blocks) {
+    AddBlock(block, touched);
+  }
+
+  std::cout << "Fixture chain of height " << GetHeight() << " with "
+            << txs_.size() << " transactions paying " << addresses.size()
+            << " addresses" << std::endl;
+}
+
+size_t ChainFixture::GetHeight() const { return headers_.size() - 1; }
+
+bool ChainFixture::GetHeader(size_t height,
+                             libbitcoin::chain::header& header) const {
+  if (height >= headers_.size()) {
+    return false;
+  }
+  header = headers_[height];
+  return true;
+}
+
+bool ChainFixture::GetHeader(const libbitcoin::hash_digest& hash,
+                             libbitcoin::chain::header& header) const {
+  const auto it = header_heights_.find(hash);
+  return it != header_heights_.end() && GetHeader(it->second, header);
+}
+
+bool ChainFixture::GetBlockTransactionHashes(
+    size_t height, libbitcoin::hash_list& tx_hashes) const {
+  if (height >= block_tx_hashes_.size()) {
+    return false;
+  }
+  tx_hashes = block_tx_hashes_[height];
+  return true;
+}
+
+bool ChainFixture::GetBlockTransactionHashes(
+    const libbitcoin::hash_digest& hash,
+    libbitcoin::hash_list& tx_hashes) const {
+  const auto it = header_heights_.find(hash);
+  return it != header_heights_.end() &&
+         GetBlockTransactionHashes(it->second, tx_hashes);
+}
+
+bool ChainFixture::GetTransaction(const libbitcoin::hash_digest& hash,
+                                  libbitcoin::chain::transaction& tx,
+                                  size_t& height, size_t& index) const {
+  const auto it = txs_.find(hash);
+  if (it == txs_.end() || it->second.height == 0) {
+    return false;
+  }
+  tx = it->second.tx;
+  height = it->second.height;
+  index = it->second.index;
+  return true;
+}
+
+bool ChainFixture::GetPoolTransaction(
+    const libbitcoin::hash_digest& hash,
+    libbitcoin::chain::transaction& tx) const {
+  const auto it = txs_.find(hash);
+  if (it == txs_.end() || it->second.height != 0) {
+    return false;
+  }
+  tx = it->second.tx;
+  return true;
+}
+
+std::vector<HistoryRow> ChainFixture::GetHistory(
+    const libbitcoin::short_hash& key_hash, size_t from_height) const {
+  std::vector<HistoryRow> rows;
+  const auto it = outputs_.find(key_hash);
+  if (it == outputs_.end()) {
+    return rows;
+  }
+
+  // only confirmed outputs and spends are part of the history, as
+  // with a real server
+  for (const auto& entry : it->second) {
+    if (entry.height == 0 || entry.height < from_height) {
+      continue;
+    }
+    rows.push_back({false, entry.point, static_cast<uint32_t>(entry.height),
+                    entry.value});
+    if (entry.spent && entry.spend_height != 0 &&
+        entry.spend_height >= from_height) {
+      rows.push_back({true, entry.spender,
+                      static_cast<uint32_t>(entry.spend_height),
+                      entry.point.checksum()});
+    }
+  }
+  return rows;
+}
+
+libbitcoin::code ChainFixture::Validate(
+    const libbitcoin::chain::transaction& tx) const {
+  if (txs_.count(tx.hash())) {
+    return libbitcoin::error::unspent_duplicate;
+  }
+
+  for (const auto& input : tx.inputs()) {
+    libbitcoin::short_hash key_hash;
+    size_t position = 0;
+    if (!FindOutput(input.previous_output(), key_hash, position)) {
+      return libbitcoin::error::missing_previous_output;
+    }
+    if (outputs_.at(key_hash)[position].spent) {
+      return libbitcoin::error::double_spend;
+    }
+  }
+  return libbitcoin::error::success;
+}
+
+libbitcoin::code ChainFixture::Accept(
+    const libbitcoin::chain::transaction& tx,
+    std::vector<libbitcoin::short_hash>& key_hashes) {
+  const auto ec = Validate(tx);
+  if (ec) {
+    return ec;
+  }
+
+  const auto hash = tx.hash();
+  txs_[hash] = {tx, 0, 0};
+  pool_.push_back(hash);
+  Index(hash, 0, key_hashes);
+  return libbitcoin::error::success;
+}
+
+size_t ChainFixture::MineBlock(
+    std::vector<std::pair<libbitcoin::hash_digest, libbitcoin::short_hash>>&
+        touched) {
+  std::vector<libbitcoin::chain::transaction> txs;
+  txs.reserve(pool_.size());
+  for (const auto& hash : pool_) {
+    txs.push_back(txs_[hash].tx);
+  }
+  pool_.clear();
+
+  AddBlock(txs, touched);
+  return GetHeight();
+}
+
+bool ChainFixture::GetOutputKeyHash(const libbitcoin::chain::output& output,
+                                    libbitcoin::short_hash& key_hash) {
+  const auto& ops = output.script().operations();
+  if (libbitcoin::chain::script::is_pay_key_hash_pattern(ops)) {
+    std::copy(ops[2].data().begin(), ops[2].data().end(), key_hash.begin());
+    return true;
+  }
+  return megabit::segwit::is_pay_witness_key_hash(output.script(), key_hash);
+}
+
+libbitcoin::chain::script ChainFixture::GetOutputScript(
+    const std::string& address, libbitcoin::short_hash& key_hash) {
+  const libbitcoin::wallet::payment_address payment_address(address);
+  if (payment_address) {
+    key_hash = payment_address.hash();
+    return libbitcoin::chain::script::to_pay_key_hash_pattern(key_hash);
+  }
+
+  const auto separator = address.rfind('1');
+  if (separator != std::string::npos &&
+      megabit::segwit::decode_witness_address(
+          key_hash, address, address.substr(0, separator))) {
+    return megabit::segwit::to_pay_witness_key_hash_script(key_hash);
+  }
+  throw std::runtime_error("Unsupported fixture address " + address);
+}
+
+libbitcoin::hash_digest ChainFixture::RandomHash() {
+  libbitcoin::hash_digest hash;
+  for (auto& byte : hash) {
+    byte = static_cast<uint8_t>(random_());
+  }
+  return hash;
+}
+
+libbitcoin::short_hash ChainFixture::RandomKeyHash() {
+  libbitcoin::short_hash key_hash;
+  for (auto& byte : key_hash) {
+    byte = static_cast<uint8_t>(random_());
+  }
+  return key_hash;
+}
+
+void ChainFixture::AddBlock(
+    std::vector<libbitcoin::chain::transaction>& txs,
+    std::vector<std::pair<libbitcoin::hash_digest, libbitcoin::short_hash>>&
+        touched) {
+  const auto height = headers_.size();
+
+  libbitcoin::chain::block block;
+  block.set_transactions(txs);
+
+  libbitcoin::chain::header header;
+  header.set_version(1);
+  header.set_previous_block_hash(headers_.empty() ? libbitcoin::null_hash
+                                                  : headers_.back().hash());
+  header.set_merkle(block.generate_merkle_root());
+  header.set_timestamp(
+      fixture_genesis_time +
+      static_cast<uint32_t>(height) * fixture_block_interval_s);
+  header.set_bits(fixture_bits);
+  header.set_nonce(static_cast<uint32_t>(height));
+
+  header_heights_[header.hash()] = height;
+  headers_.push_back(header);
+  block_tx_hashes_.emplace_back();
+
+  for (size_t index = 0; index < txs.size(); index++) {
+    const auto hash = txs[index].hash();
+    txs_[hash] = {txs[index], height, index};
+    block_tx_hashes_.back().push_back(hash);
+
+    std::vector<libbitcoin::short_hash> key_hashes;
+    Index(hash, height, key_hashes);
+    for (const auto& key_hash : key_hashes) {
+      touched.push_back({hash, key_hash});
+    }
+  }
+}
+
+void ChainFixture::Index(const libbitcoin::hash_digest& tx_hash,
+                         size_t height,
+                         std::vector<libbitcoin::short_hash>& key_hashes) {
+  const auto& tx = txs_[tx_hash].tx;
+
+  // re-indexing a memory pool transaction as it's confirmed updates
+  // the heights of its existing entries
+  for (uint32_t i = 0; i < tx.outputs().size(); i++) {
+    libbitcoin::short_hash key_hash;
+    if (!GetOutputKeyHash(tx.outputs()[i], key_hash)) {
+      continue;
+    }
+    const libbitcoin::chain::output_point point{tx_hash, i};
+    auto& entries = outputs_[key_hash];
+    auto it = std::find_if(
+        entries.begin(), entries.end(),
+        [&point](const OutputEntry& entry) { return entry.point == point; });
+    if (it == entries.end()) {
+      entries.push_back({point, height, tx.outputs()[i].value(), false, {}, 0});
+    } else {
+      it->height = height;
+    }
+    key_hashes.push_back(key_hash);
+  }
+
+  for (uint32_t i = 0; i < tx.inputs().size(); i++) {
+    libbitcoin::short_hash key_hash;
+    size_t position = 0;
+    if (!FindOutput(tx.inputs()[i].previous_output(), key_hash, position)) {
+      continue;
+    }
+    auto& entry = outputs_[key_hash][position];
+    entry.spent = true;
+    entry.spender = {tx_hash, i};
+    entry.spend_height = height;
+    key_hashes.push_back(key_hash);
+  }
+}
+
+bool ChainFixture::FindOutput(const libbitcoin::chain::output_point& point,
+                              libbitcoin::short_hash& key_hash,
+                              size_t& position) const {
+  const auto tx = txs_.find(point.hash());
+  if (tx == txs_.end() || point.index() >= tx->second.tx.outputs().size() ||
+      !GetOutputKeyHash(tx->second.tx.outputs()[point.index()], key_hash)) {
+    return false;
+  }
+
+  const auto entries = outputs_.find(key_hash);
+  if (entries == outputs_.end()) {
+    return false;
+  }
+  const auto it = std::find_if(
+      entries->second.begin(), entries->second.end(),
+      [&point](const OutputEntry& entry) { return entry.point == point; });
+  if (it == entries->second.end()) {
+    return false;
+  }
+  position = static_cast<size_t>(it - entries->second.begin());
+  return true;
+}
@@ -0,0 +1,140 @@
+/*
+ * This file is part of Megabit, a BIP44 HD wallet built on
+ * libbitcoin.
+ *
+ * Copyright (C) 2017 Neill Miller (neillm@thecodefactory.org)
+ *
+ * Megabit is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Megabit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Megabit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CHAIN_FIXTURE_HPP
+#define __CHAIN_FIXTURE_HPP
+
+#include <bitcoin/bitcoin.hpp>
+
+#include <map>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+struct FixtureOptions {
+  uint32_t seed = 1;
+  size_t chain_height = 1000;
+  size_t payments_per_address = 4;
+  double spend_fraction = 0.5;
+  uint64_t min_value = 10000;
+  uint64_t max_value = 10000000;
+};
+
+// one row of a blockchain.fetch_history3 response.  Spends carry the
+// checksum of the output point they spend in place of a value
+struct HistoryRow {
+  bool spend;
+  libbitcoin::chain::output_point point;
+  uint32_t height;
+  uint64_t value_or_checksum;
+};
+
+// a deterministic synthetic chain paying a fixed set of addresses.
+// Every address receives a number of payments at pseudo-random
+// heights, some of which are spent again further up the chain, from
+// transactions with unsigned coinbase-like inputs.  The same options
+// and addresses always produce the same blocks, transaction hashes and
+// histories, so runs against the stand-in server are reproducible.
+//
+// Transactions accepted from clients go into a memory pool until they
+// are confirmed by MineBlock.
+class ChainFixture {
+ public:
+  ChainFixture(const std::vector<std::string>& addresses,
+               const FixtureOptions& options);
+
+  size_t GetHeight() const;
+  bool GetHeader(size_t height, libbitcoin::chain::header& header) const;
+  bool GetHeader(const libbitcoin::hash_digest& hash,
+                 libbitcoin::chain::header& header) const;
+  // the hashes of the transactions of a block, in block order
+  bool GetBlockTransactionHashes(size_t height,
+                                 libbitcoin::hash_list& tx_hashes) const;
+  bool GetBlockTransactionHashes(const libbitcoin::hash_digest& hash,
+                                 libbitcoin::hash_list& tx_hashes) const;
+
+  bool GetTransaction(const libbitcoin::hash_digest& hash,
+                      libbitcoin::chain::transaction& tx, size_t& height,
+                      size_t& index) const;
+  bool GetPoolTransaction(const libbitcoin::hash_digest& hash,
+                          libbitcoin::chain::transaction& tx) const;
+
+  std::vector<HistoryRow> GetHistory(const libbitcoin::short_hash& key_hash,
+                                     size_t from_height) const;
+
+  // checks that every input of the transaction spends a known,
+  // unspent output
+  libbitcoin::code Validate(const libbitcoin::chain::transaction& tx) const;
+
+  // adds a valid transaction to the memory pool, returning the key
+  // hashes it pays or spends from
+  libbitcoin::code Accept(const libbitcoin::chain::transaction& tx,
+                          std::vector<libbitcoin::short_hash>& key_hashes);
+
+  // confirms the memory pool in a new block, returning the key hashes
+  // the confirmed transactions touch
+  size_t MineBlock(std::vector<std::pair<libbitcoin::hash_digest,
+                                         libbitcoin::short_hash>>& touched);
+
+ private:
+  struct TxEntry {
+    libbitcoin::chain::transaction tx;
+    // 0 while in the memory pool
+    size_t height;
+    size_t index;
+  };
+
+  struct OutputEntry {
+    libbitcoin::chain::output_point point;
+    size_t height;
+    uint64_t value;
+    bool spent;
+    libbitcoin::chain::input_point spender;
+    size_t spend_height;
+  };
+
+  static bool GetOutputKeyHash(const libbitcoin::chain::output& output,
+                               libbitcoin::short_hash& key_hash);
+  static libbitcoin::chain::script GetOutputScript(const std::string& address,
+                                                   libbitcoin::short_hash&
+                                                       key_hash);
+
+  libbitcoin::hash_digest RandomHash();
+  libbitcoin::short_hash RandomKeyHash();
+
+  void AddBlock(std::vector<libbitcoin::chain::transaction>& txs,
+                std::vector<std::pair<libbitcoin::hash_digest,
+                                      libbitcoin::short_hash>>& touched);
+  void Index(const libbitcoin::hash_digest& tx_hash, size_t height,
+             std::vector<libbitcoin::short_hash>& key_hashes);
+  bool FindOutput(const libbitcoin::chain::output_point& point,
+                  libbitcoin::short_hash& key_hash, size_t& position) const;
+
+  std::mt19937_64 random_;
+  std::vector<libbitcoin::chain::header> headers_;
+  std::vector<libbitcoin::hash_list> block_tx_hashes_;
+  std::map<libbitcoin::hash_digest, size_t> header_heights_;
+  std::unordered_map<libbitcoin::hash_digest, TxEntry> txs_;
+  std::vector<libbitcoin::hash_digest> pool_;
+  std::unordered_map<libbitcoin::short_hash, std::vector<OutputEntry>>
+      outputs_;
+};
+
+#endif  // __CHAIN_FIXTURE_HPP
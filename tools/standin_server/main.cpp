@@ -0,0 +1,152 @@
+/*
+ * This file is part of Megabit, a BIP44 HD wallet built on
+ * libbitcoin.
+ *
+ * Copyright (C) 2017 Neill Miller (neillm@thecodefactory.org)
+ *
+ * Megabit is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Megabit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Megabit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "standin_server.hpp"
+
+#include <csignal>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+StandinServer* running_server = nullptr;
+
+void OnSignal(int) {
+  if (running_server) {
+    running_server->Stop();
+  }
+}
+
+void Usage(const char* name) {
+  std::cout
+      << "Usage: " << name << " --addresses FILE [options]\n\n"
+      << "Fixture options:\n"
+      << "  --addresses FILE       addresses to pay, one per line\n"
+      << "  --height N             chain height (1000)\n"
+      << "  --payments N           payments to each address (4)\n"
+      << "  --spend-fraction F     fraction of payments spent (0.5)\n"
+      << "  --seed N               fixture and fault seed (1)\n\n"
+      << "Server options:\n"
+      << "  --port N               query port, heartbeats and blocks on the\n"
+      << "                         next two ports (9091)\n"
+      << "  --latency-ms N         reply delay (0)\n"
+      << "  --jitter-ms N          random extra reply delay (0)\n"
+      << "  --error-rate F         fraction of replies failing (0)\n"
+      << "  --drop-rate F          fraction of requests unanswered (0)\n"
+      << "  --oversubscribed-rate F  fraction of subscriptions refused (0)\n"
+      << "  --max-subscriptions N  subscriptions before refusing (0, no "
+         "limit)\n"
+      << "  --block-interval-s N   mine the memory pool every N seconds\n"
+      << "                         (0, never)\n"
+      << "  --heartbeat-ms N       heartbeat interval (5000)" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  FixtureOptions fixture_options;
+  ServerOptions server_options;
+  std::string addresses_file;
+
+  for (int i = 1; i < argc; i++) {
+    const std::string option = argv[i];
+    if ((option == "-h") || (option == "--help") || (i + 1 == argc)) {
+      Usage(argv[0]);
+      return (option == "-h" || option == "--help") ? 0 : 1;
+    }
+
+    const std::string value = argv[++i];
+    try {
+      if (option == "--addresses") {
+        addresses_file = value;
+      } else if (option == "--height") {
+        fixture_options.chain_height = std::stoul(value);
+      } else if (option == "--payments") {
+        fixture_options.payments_per_address = std::stoul(value);
+      } else if (option == "--spend-fraction") {
+        fixture_options.spend_fraction = std::stod(value);
+      } else if (option == "--seed") {
+        fixture_options.seed = server_options.seed =
+            static_cast<uint32_t>(std::stoul(value));
+      } else if (option == "--port") {
+        server_options.port = static_cast<uint16_t>(std::stoul(value));
+      } else if (option == "--latency-ms") {
+        server_options.latency_ms = static_cast<uint32_t>(std::stoul(value));
+      } else if (option == "--jitter-ms") {
+        server_options.jitter_ms = static_cast<uint32_t>(std::stoul(value));
+      } else if (option == "--error-rate") {
+        server_options.error_rate = std::stod(value);
+      } else if (option == "--drop-rate") {
+        server_options.drop_rate = std::stod(value);
+      } else if (option == "--oversubscribed-rate") {
+        server_options.oversubscribed_rate = std::stod(value);
+      } else if (option == "--max-subscriptions") {
+        server_options.max_subscriptions = std::stoul(value);
+      } else if (option == "--block-interval-s") {
+        server_options.block_interval_s =
+            static_cast<uint32_t>(std::stoul(value));
+      } else if (option == "--heartbeat-ms") {
+        server_options.heartbeat_interval_ms =
+            static_cast<uint32_t>(std::stoul(value));
+      } else {
+        Usage(argv[0]);
+        return 1;
+      }
+    } catch (const std::exception&) {
+      std::cout << "Invalid value " << value << " for " << option
+                << std::endl;
+      return 1;
+    }
+  }
+
+  if (addresses_file.empty() || (fixture_options.chain_height == 0)) {
+    Usage(argv[0]);
+    return 1;
+  }
+
+  std::ifstream input(addresses_file);
+  if (!input) {
+    std::cout << "Cannot read " << addresses_file << std::endl;
+    return 1;
+  }
+  std::vector<std::string> addresses;
+  std::string address;
+  while (input >> address) {
+    addresses.push_back(address);
+  }
+
+  try {
+    ChainFixture fixture(addresses, fixture_options);
+    StandinServer server(fixture, server_options);
+    if (!server.Start()) {
+      return 1;
+    }
+
+    running_server = &server;
+    std::signal(SIGINT, OnSignal);
+    std::signal(SIGTERM, OnSignal);
+    server.Run();
+    running_server = nullptr;
+  } catch (const std::exception& e) {
+    std::cout << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,477 @@
+/*
+ * This file is part of Megabit, a BIP44 HD wallet built on
+ * libbitcoin.
+ *
+ * Copyright (C) 2017 Neill Miller (neillm@thecodefactory.org)
+ *
+ * Megabit is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Megabit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Megabit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "standin_server.hpp"
+
+#include "../../include/megabit/constants.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+namespace {
+
+// subscriptions are either a full key hash, or a prefix as
+// [ bits:1 ] [ blocks:... ]
+bool ParsePrefix(const libbitcoin::data_chunk& payload,
+                 libbitcoin::binary& prefix) {
+  if (payload.size() == libbitcoin::short_hash_size) {
+    prefix = libbitcoin::binary(libbitcoin::short_hash_size * 8, payload);
+    return true;
+  }
+  if (payload.empty() ||
+      payload.size() - 1 != libbitcoin::binary::blocks_size(payload[0])) {
+    return false;
+  }
+  prefix = libbitcoin::binary(
+      payload[0], libbitcoin::data_chunk(payload.begin() + 1, payload.end()));
+  return true;
+}
+
+libbitcoin::config::endpoint GetEndpoint(uint16_t port) {
+  return libbitcoin::config::endpoint("tcp://*:" + std::to_string(port));
+}
+
+}  // namespace
+
+StandinServer::StandinServer(ChainFixture& fixture,
+                             const ServerOptions& options)
+    : fixture_(fixture),
+      options_(options),
+      random_(options.seed),
+      running_(false),
+      query_socket_(context_, Socket::role::router),
+      heartbeat_socket_(context_, Socket::role::publisher),
+      block_socket_(context_, Socket::role::publisher),
+      heartbeat_sequence_(0),
+      block_sequence_(0),
+      notification_sequence_(0),
+      requests_(0),
+      errors_(0),
+      drops_(0),
+      notifications_(0) {}
+
+bool StandinServer::Start() {
+  const auto query_endpoint = GetEndpoint(options_.port);
+  const auto heartbeat_endpoint = GetEndpoint(static_cast<uint16_t>(
+      options_.port + megabit::constants::heartbeat_service_port_offset));
+  const auto block_endpoint = GetEndpoint(static_cast<uint16_t>(
+      options_.port + megabit::constants::block_service_port_offset));
+
+  if (query_socket_.bind(query_endpoint) ||
+      heartbeat_socket_.bind(heartbeat_endpoint) ||
+      block_socket_.bind(block_endpoint)) {
+    std::cout << "Failed to bind the server services on port "
+              << options_.port << std::endl;
+    return false;
+  }
+
+  std::cout << "Serving queries on " << query_endpoint << ", heartbeats on "
+            << heartbeat_endpoint << " and blocks on " << block_endpoint
+            << std::endl;
+  running_ = true;
+  return true;
+}
+
+void StandinServer::Stop() { running_ = false; }
+
+void StandinServer::Run() {
+  libbitcoin::protocol::zmq::poller poller;
+  poller.add(query_socket_);
+
+  const auto heartbeat_interval =
+      std::chrono::milliseconds(options_.heartbeat_interval_ms);
+  const auto block_interval = std::chrono::seconds(options_.block_interval_s);
+  auto next_heartbeat = Clock::now() + heartbeat_interval;
+  auto next_block = Clock::now() + block_interval;
+
+  while (running_) {
+    auto next_event = next_heartbeat;
+    if (options_.block_interval_s) {
+      next_event = std::min(next_event, next_block);
+    }
+    if (!replies_.empty()) {
+      next_event = std::min(next_event, replies_.top().due);
+    }
+
+    const auto timeout = std::max<int64_t>(
+        0, std::chrono::duration_cast<std::chrono::milliseconds>(
+               next_event - Clock::now())
+               .count());
+
+    // the timeout is capped so that Stop is noticed promptly
+    const auto ready = poller.wait(static_cast<int32_t>(std::min<int64_t>(
+        timeout, megabit::constants::chain_tip_monitor_period_ms)));
+    if (ready.contains(query_socket_.id())) {
+      Receive();
+    }
+
+    SendDue();
+
+    const auto now = Clock::now();
+    if (now >= next_heartbeat) {
+      PublishHeartbeat();
+      next_heartbeat = now + heartbeat_interval;
+    }
+    if (options_.block_interval_s && (now >= next_block)) {
+      PublishBlock();
+      next_block = now + block_interval;
+    }
+  }
+
+  std::cout << "Served " << requests_ << " requests, injected " << errors_
+            << " errors and dropped " << drops_ << ", sent "
+            << notifications_ << " notifications" << std::endl;
+}
+
+void StandinServer::Receive() {
+  // [ route ] [ delimiter? ] [ command ] [ id:4 ] [ payload ]
+  libbitcoin::protocol::zmq::message message;
+  if (query_socket_.receive(message)) {
+    return;
+  }
+
+  Reply request;
+  libbitcoin::data_chunk payload;
+  if (!message.dequeue(request.route)) {
+    return;
+  }
+  request.delimited = (message.size() == 4);
+  if (request.delimited) {
+    message.dequeue();
+  }
+  if (!message.dequeue(request.command) ||
+      !message.dequeue<uint32_t>(request.id) || !message.dequeue(payload)) {
+    return;
+  }
+
+  requests_++;
+  if (Chance(options_.drop_rate)) {
+    drops_++;
+    return;
+  }
+
+  Reply reply = request;
+  if (Chance(options_.error_rate)) {
+    errors_++;
+    libbitcoin::data_sink ostream(reply.payload);
+    libbitcoin::ostream_writer sink(ostream);
+    sink.write_4_bytes_little_endian(
+        libbitcoin::code(libbitcoin::error::service_stopped).value());
+    ostream.flush();
+  } else {
+    reply.payload = Query(request, payload);
+  }
+  reply.due = Clock::now() + GetDelay();
+  Schedule(std::move(reply));
+}
+
+libbitcoin::data_chunk StandinServer::Query(
+    const Reply& request, const libbitcoin::data_chunk& payload) {
+  libbitcoin::data_chunk reply;
+  libbitcoin::data_sink ostream(reply);
+  libbitcoin::ostream_writer sink(ostream);
+  libbitcoin::data_source istream(payload);
+  libbitcoin::istream_reader source(istream);
+
+  const auto write_code = [&sink](const libbitcoin::code& ec) {
+    sink.write_4_bytes_little_endian(ec.value());
+  };
+
+  const auto& command = request.command;
+  if (command == "blockchain.fetch_last_height") {
+    // [ ec:4 ] [ height:4 ]
+    write_code(libbitcoin::error::success);
+    sink.write_4_bytes_little_endian(
+        static_cast<uint32_t>(fixture_.GetHeight()));
+  } else if (command == "blockchain.fetch_history3") {
+    // [ key_hash:20 ] [ from_height:4 ]
+    // -> [ ec:4 ] ([ kind:1 ] [ hash:32 ] [ index:4 ] [ height:4 ]
+    //    [ value_or_checksum:8 ])...
+    const auto key_hash = source.read_short_hash();
+    const auto from_height = source.read_4_bytes_little_endian();
+    if (!source) {
+      write_code(libbitcoin::error::bad_stream);
+    } else {
+      write_code(libbitcoin::error::success);
+      for (const auto& row : fixture_.GetHistory(key_hash, from_height)) {
+        sink.write_byte(row.spend ? 1 : 0);
+        sink.write_hash(row.point.hash());
+        sink.write_4_bytes_little_endian(row.point.index());
+        sink.write_4_bytes_little_endian(row.height);
+        sink.write_8_bytes_little_endian(row.value_or_checksum);
+      }
+    }
+  } else if ((command == "blockchain.fetch_transaction") ||
+             (command == "blockchain.fetch_transaction2") ||
+             (command == "transaction_pool.fetch_transaction") ||
+             (command == "transaction_pool.fetch_transaction2")) {
+    // [ hash:32 ] -> [ ec:4 ] [ tx:... ]
+    const auto hash = source.read_hash();
+    libbitcoin::chain::transaction tx;
+    size_t height = 0;
+    size_t index = 0;
+    const auto found =
+        (command.find("transaction_pool") == 0)
+            ? fixture_.GetPoolTransaction(hash, tx)
+            : fixture_.GetTransaction(hash, tx, height, index);
+    if (!source || !found) {
+      write_code(libbitcoin::error::not_found);
+    } else {
+      write_code(libbitcoin::error::success);
+      sink.write_bytes(tx.to_data(true, true));
+    }
+  } else if (command == "blockchain.fetch_transaction_index") {
+    // [ hash:32 ] -> [ ec:4 ] [ height:4 ] [ index:4 ]
+    const auto hash = source.read_hash();
+    libbitcoin::chain::transaction tx;
+    size_t height = 0;
+    size_t index = 0;
+    if (!source || !fixture_.GetTransaction(hash, tx, height, index)) {
+      write_code(libbitcoin::error::not_found);
+    } else {
+      write_code(libbitcoin::error::success);
+      sink.write_4_bytes_little_endian(static_cast<uint32_t>(height));
+      sink.write_4_bytes_little_endian(static_cast<uint32_t>(index));
+    }
+  } else if (command == "blockchain.fetch_block_header") {
+    // [ height:4 ] or [ hash:32 ] -> [ ec:4 ] [ header:80 ]
+    libbitcoin::chain::header header;
+    bool found = false;
+    if (payload.size() == libbitcoin::hash_size) {
+      found = fixture_.GetHeader(source.read_hash(), header);
+    } else {
+      found = fixture_.GetHeader(source.read_4_bytes_little_endian(), header);
+    }
+    if (!source || !found) {
+      write_code(libbitcoin::error::not_found);
+    } else {
+      write_code(libbitcoin::error::success);
+      sink.write_bytes(header.to_data());
+    }
+  } else if (command == "blockchain.fetch_block_transaction_hashes") {
+    // [ height:4 ] or [ hash:32 ] -> [ ec:4 ] ([ tx_hash:32 ])...
+    libbitcoin::hash_list tx_hashes;
+    bool found = false;
+    if (payload.size() == libbitcoin::hash_size) {
+      found = fixture_.GetBlockTransactionHashes(source.read_hash(), tx_hashes);
+    } else {
+      found = fixture_.GetBlockTransactionHashes(
+          source.read_4_bytes_little_endian(), tx_hashes);
+    }
+    if (!source || !found) {
+      write_code(libbitcoin::error::not_found);
+    } else {
+      write_code(libbitcoin::error::success);
+      for (const auto& tx_hash : tx_hashes) {
+        sink.write_hash(tx_hash);
+      }
+    }
+  } else if ((command == "transaction_pool.validate2") ||
+             (command == "transaction_pool.broadcast")) {
+    // [ tx:... ] -> [ ec:4 ]
+    libbitcoin::chain::transaction tx;
+    if (!tx.from_data(payload, true, true)) {
+      write_code(libbitcoin::error::bad_stream);
+    } else if (command == "transaction_pool.validate2") {
+      write_code(fixture_.Validate(tx));
+    } else {
+      write_code(Broadcast(tx));
+    }
+  } else if (command == "subscribe.address") {
+    write_code(Subscribe(request, payload));
+  } else if (command == "unsubscribe.address") {
+    write_code(Unsubscribe(request, payload));
+  } else {
+    std::cout << "Unsupported command " << command << std::endl;
+    write_code(libbitcoin::error::not_implemented);
+  }
+
+  ostream.flush();
+  return reply;
+}
+
+libbitcoin::code StandinServer::Subscribe(
+    const Reply& request, const libbitcoin::data_chunk& payload) {
+  Subscription subscription{
+      request.route, request.delimited, request.id, {},
+      Clock::now() + std::chrono::seconds(options_.subscription_expiry_s)};
+  if (!ParsePrefix(payload, subscription.prefix)) {
+    return libbitcoin::error::bad_stream;
+  }
+
+  // renewals replace the existing subscription
+  const auto existing = std::find_if(
+      subscriptions_.begin(), subscriptions_.end(),
+      [&subscription](const Subscription& other) {
+        return (other.route == subscription.route) &&
+               (other.prefix == subscription.prefix);
+      });
+  if (existing != subscriptions_.end()) {
+    *existing = subscription;
+    return libbitcoin::error::success;
+  }
+
+  if (Chance(options_.oversubscribed_rate) ||
+      (options_.max_subscriptions &&
+       (subscriptions_.size() >= options_.max_subscriptions))) {
+    return libbitcoin::error::oversubscribed;
+  }
+  subscriptions_.push_back(subscription);
+  return libbitcoin::error::success;
+}
+
+libbitcoin::code StandinServer::Unsubscribe(
+    const Reply& request, const libbitcoin::data_chunk& payload) {
+  libbitcoin::binary prefix;
+  if (!ParsePrefix(payload, prefix)) {
+    return libbitcoin::error::bad_stream;
+  }
+
+  subscriptions_.erase(
+      std::remove_if(subscriptions_.begin(), subscriptions_.end(),
+                     [&request, &prefix](const Subscription& subscription) {
+                       return (subscription.route == request.route) &&
+                              (subscription.prefix == prefix);
+                     }),
+      subscriptions_.end());
+  return libbitcoin::error::success;
+}
+
+libbitcoin::code StandinServer::Broadcast(
+    const libbitcoin::chain::transaction& tx) {
+  std::vector<libbitcoin::short_hash> key_hashes;
+  const auto ec = fixture_.Accept(tx, key_hashes);
+  if (ec) {
+    return ec;
+  }
+
+  const auto tx_hash = tx.hash();
+  std::cout << "Accepted transaction " << libbitcoin::encode_hash(tx_hash)
+            << std::endl;
+  for (const auto& key_hash : key_hashes) {
+    Notify(tx_hash, key_hash, 0);
+  }
+  return libbitcoin::error::success;
+}
+
+void StandinServer::Notify(const libbitcoin::hash_digest& tx_hash,
+                           const libbitcoin::short_hash& key_hash,
+                           size_t height) {
+  const auto now = Clock::now();
+  subscriptions_.erase(
+      std::remove_if(subscriptions_.begin(), subscriptions_.end(),
+                     [&now](const Subscription& subscription) {
+                       return subscription.expiry < now;
+                     }),
+      subscriptions_.end());
+
+  // [ ec:4 ] [ sequence:2 ] [ height:4 ] [ tx_hash:32 ]
+  for (const auto& subscription : subscriptions_) {
+    if (!subscription.prefix.is_prefix_of(key_hash)) {
+      continue;
+    }
+
+    Reply notification{now + GetDelay(),       subscription.route,
+                       subscription.delimited, "notification.address",
+                       subscription.id,        {}};
+    libbitcoin::data_sink ostream(notification.payload);
+    libbitcoin::ostream_writer sink(ostream);
+    sink.write_4_bytes_little_endian(
+        libbitcoin::code(libbitcoin::error::success).value());
+    sink.write_2_bytes_little_endian(notification_sequence_++);
+    sink.write_4_bytes_little_endian(static_cast<uint32_t>(height));
+    sink.write_hash(tx_hash);
+    ostream.flush();
+
+    notifications_++;
+    Schedule(std::move(notification));
+  }
+}
+
+void StandinServer::Schedule(Reply reply) { replies_.push(std::move(reply)); }
+
+void StandinServer::SendDue() {
+  const auto now = Clock::now();
+  while (!replies_.empty() && (replies_.top().due <= now)) {
+    Send(replies_.top());
+    replies_.pop();
+  }
+}
+
+void StandinServer::Send(const Reply& reply) {
+  libbitcoin::protocol::zmq::message message;
+  message.enqueue(reply.route);
+  if (reply.delimited) {
+    message.enqueue();
+  }
+  message.enqueue(reply.command);
+  message.enqueue_little_endian(reply.id);
+  message.enqueue(reply.payload);
+  if (message.send(query_socket_)) {
+    std::cout << "Failed to send " << reply.command << " reply" << std::endl;
+  }
+}
+
+void StandinServer::PublishHeartbeat() {
+  // [ sequence:2 ] [ height:4 ]
+  libbitcoin::protocol::zmq::message message;
+  message.enqueue_little_endian(heartbeat_sequence_++);
+  message.enqueue_little_endian(static_cast<uint32_t>(fixture_.GetHeight()));
+  message.send(heartbeat_socket_);
+}
+
+void StandinServer::PublishBlock() {
+  std::vector<std::pair<libbitcoin::hash_digest, libbitcoin::short_hash>>
+      touched;
+  const auto height = fixture_.MineBlock(touched);
+  std::cout << "Mined block " << height << " confirming " << touched.size()
+            << " outputs and spends" << std::endl;
+
+  for (const auto& entry : touched) {
+    Notify(entry.first, entry.second, height);
+  }
+
+  // [ sequence:2 ] [ height:4 ] [ block:... ], only the header is
+  // sent since the wallet only follows the height
+  libbitcoin::chain::header header;
+  fixture_.GetHeader(height, header);
+  libbitcoin::protocol::zmq::message message;
+  message.enqueue_little_endian(block_sequence_++);
+  message.enqueue_little_endian(static_cast<uint32_t>(height));
+  message.enqueue(header.to_data());
+  message.send(block_socket_);
+}
+
+StandinServer::Clock::duration StandinServer::GetDelay() {
+  auto delay = std::chrono::milliseconds(options_.latency_ms);
+  if (options_.jitter_ms) {
+    std::uniform_int_distribution<uint32_t> jitter(0, options_.jitter_ms);
+    delay += std::chrono::milliseconds(jitter(random_));
+  }
+  return delay;
+}
+
+bool StandinServer::Chance(double rate) {
+  if (rate <= 0.0) {
+    return false;
+  }
+  std::bernoulli_distribution chance(std::min(rate, 1.0));
+  return chance(random_);
+}
@@ -0,0 +1,136 @@
+/*
+ * This file is part of Megabit, a BIP44 HD wallet built on
+ * libbitcoin.
+ *
+ * Copyright (C) 2017 Neill Miller (neillm@thecodefactory.org)
+ *
+ * Megabit is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Megabit is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Megabit.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __STANDIN_SERVER_HPP
+#define __STANDIN_SERVER_HPP
+
+#include "chain_fixture.hpp"
+
+#include <bitcoin/protocol.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <queue>
+#include <random>
+
+struct ServerOptions {
+  // the query service binds to the port, and the heartbeat and block
+  // services to the offsets the wallet expects above it
+  uint16_t port = 9091;
+  uint32_t seed = 1;
+  // every reply is delayed by the latency plus a uniformly random
+  // jitter
+  uint32_t latency_ms = 0;
+  uint32_t jitter_ms = 0;
+  // fraction of requests answered with service_stopped
+  double error_rate = 0.0;
+  // fraction of requests never answered, so the client times out
+  double drop_rate = 0.0;
+  // fraction of subscriptions refused with oversubscribed, in
+  // addition to any beyond max_subscriptions (0 is unlimited)
+  double oversubscribed_rate = 0.0;
+  size_t max_subscriptions = 0;
+  uint32_t subscription_expiry_s = 600;
+  // the memory pool is mined into a new block at this interval (0
+  // never mines)
+  uint32_t block_interval_s = 0;
+  uint32_t heartbeat_interval_ms = 5000;
+};
+
+// a single threaded stand-in for a libbitcoin server, answering the
+// obelisk query and subscription protocol from a ChainFixture so that
+// the wallet can be benchmarked and tested without a network.  Replies
+// are held back in a queue until their delay has passed, so latency
+// doesn't limit throughput.
+class StandinServer {
+ public:
+  StandinServer(ChainFixture& fixture, const ServerOptions& options);
+
+  bool Start();
+  void Run();
+  void Stop();
+
+ private:
+  using Clock = std::chrono::steady_clock;
+  using Socket = libbitcoin::protocol::zmq::socket;
+
+  struct Reply {
+    Clock::time_point due;
+    libbitcoin::data_chunk route;
+    bool delimited;
+    std::string command;
+    uint32_t id;
+    libbitcoin::data_chunk payload;
+
+    bool operator>(const Reply& other) const { return due > other.due; }
+  };
+
+  struct Subscription {
+    libbitcoin::data_chunk route;
+    bool delimited;
+    uint32_t id;
+    libbitcoin::binary prefix;
+    Clock::time_point expiry;
+  };
+
+  void Receive();
+  libbitcoin::data_chunk Query(const Reply& request,
+                               const libbitcoin::data_chunk& payload);
+  libbitcoin::code Subscribe(const Reply& request,
+                             const libbitcoin::data_chunk& payload);
+  libbitcoin::code Unsubscribe(const Reply& request,
+                               const libbitcoin::data_chunk& payload);
+  libbitcoin::code Broadcast(const libbitcoin::chain::transaction& tx);
+  void Notify(const libbitcoin::hash_digest& tx_hash,
+              const libbitcoin::short_hash& key_hash, size_t height);
+
+  void Schedule(Reply reply);
+  void SendDue();
+  void Send(const Reply& reply);
+  void PublishHeartbeat();
+  void PublishBlock();
+
+  Clock::duration GetDelay();
+  bool Chance(double rate);
+
+  ChainFixture& fixture_;
+  const ServerOptions options_;
+  std::mt19937_64 random_;
+  std::atomic<bool> running_;
+
+  libbitcoin::protocol::zmq::context context_;
+  Socket query_socket_;
+  Socket heartbeat_socket_;
+  Socket block_socket_;
+
+  std::priority_queue<Reply, std::vector<Reply>, std::greater<Reply>>
+      replies_;
+  std::vector<Subscription> subscriptions_;
+  uint16_t heartbeat_sequence_;
+  uint16_t block_sequence_;
+  uint16_t notification_sequence_;
+
+  size_t requests_;
+  size_t errors_;
+  size_t drops_;
+  size_t notifications_;
+};
+
+#endif  // __STANDIN_SERVER_HPP
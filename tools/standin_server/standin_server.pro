@@ -0,0 +1,32 @@
+# A stand-in libbitcoin server answering the wallet's queries from a
+# synthetic chain, for benchmarking and testing without a network.
+# Build with qmake && make from this directory.
+
+# segwit.cpp asserts through QtCore
+QT        = core
+
+TARGET = standin_server
+TEMPLATE = app
+
+CONFIG += console c++11 link_pkgconfig
+CONFIG -= app_bundle
+
+INCLUDEPATH = ../../include/megabit/
+
+SOURCES += ../../src/segwit.cpp \
+           chain_fixture.cpp \
+           standin_server.cpp \
+           main.cpp
+
+HEADERS += ../../include/megabit/constants.hpp \
+           ../../include/megabit/utils.hpp \
+           ../../include/megabit/segwit.hpp \
+           chain_fixture.hpp \
+           standin_server.hpp
+
+OBJECTS_DIR=build
+
+macx{
+        QT_CONFIG -= no-pkg-config
+}
+PKGCONFIG += libbitcoin-protocol